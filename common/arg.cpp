@@ -1293,6 +1293,36 @@ static std::string get_all_kv_cache_types() {
     return msg.str();
 }
 
+// comma-separated list of <layer>=<type> or <first layer>-<last layer>=<type>
+static void parse_kv_cache_type_layers(const std::string & value, std::vector<llama_kv_type_override> & overrides, bool is_k) {
+    for (const auto & override : string_split<std::string>(value, ',')) {
+        std::string::size_type pos = override.find('=');
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("invalid value");
+        }
+        const std::string layers = override.substr(0, pos);
+        const ggml_type   type   = kv_cache_type_from_str(override.substr(pos + 1));
+
+        const std::string::size_type pos_range = layers.find('-');
+
+        const int32_t il0 = std::stoi(layers.substr(0, pos_range));
+        const int32_t il1 = pos_range == std::string::npos ? il0 : std::stoi(layers.substr(pos_range + 1));
+        if (il0 < 0 || il1 < il0) {
+            throw std::invalid_argument("invalid layer range: " + layers);
+        }
+
+        for (int32_t il = il0; il <= il1; ++il) {
+            auto it = std::find_if(overrides.begin(), overrides.end(), [il](const llama_kv_type_override & o) { return o.il == il; });
+            if (it == overrides.end()) {
+                overrides.push_back({ il, GGML_TYPE_COUNT, GGML_TYPE_COUNT });
+                it = overrides.end() - 1;
+            }
+
+            (is_k ? it->type_k : it->type_v) = type;
+        }
+    }
+}
+
 //
 // CLI argument parsing functions
 //
@@ -1438,6 +1468,19 @@ static bool common_params_parse_ex(int argc, char ** argv, common_params_context
         params.tensor_buft_overrides.push_back({nullptr, nullptr});
     }
 
+    if (!params.cache_type_layers.empty()) {
+        // with -fa auto, the context cannot be created if flash attention resolves to disabled
+        for (const auto & o : params.cache_type_layers) {
+            if (o.type_v != GGML_TYPE_COUNT && ggml_is_quantized(o.type_v) && params.flash_attn_type != LLAMA_FLASH_ATTN_TYPE_ENABLED) {
+                throw std::invalid_argument(string_format(
+                    "error: the quantized V cache type %s of layer %d requires flash attention, use -fa on\n",
+                    ggml_type_name(o.type_v), o.il));
+            }
+        }
+
+        params.cache_type_layers.push_back({-1, GGML_TYPE_COUNT, GGML_TYPE_COUNT});
+    }
+
     if (!params.speculative.tensor_buft_overrides.empty()) {
         params.speculative.tensor_buft_overrides.push_back({nullptr, nullptr});
     }
@@ -1943,6 +1986,27 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.cache_ram_mib = value;
         }
     ).set_env("LLAMA_ARG_CACHE_RAM").set_examples({LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--cache-disk"}, "PATH",
+        "directory for the disk tier of the prompt cache, the states evicted from RAM are stored there and survive restarts (default: disabled)",
+        [](common_params & params, const std::string & value) {
+            params.cache_disk_path = value;
+        }
+    ).set_env("LLAMA_ARG_CACHE_DISK").set_examples({LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--cache-disk-size"}, "N",
+        string_format("set the maximum size in MiB of the disk tier of the prompt cache (default: %d, -1 - no limit)", params.cache_disk_mib),
+        [](common_params & params, int value) {
+            params.cache_disk_mib = value;
+        }
+    ).set_env("LLAMA_ARG_CACHE_DISK_SIZE").set_examples({LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--cache-idle"}, "N",
+        string_format("move the KV cache of the slots that are idle for more than N seconds to the prompt cache, it is restored on the next request (default: %d, 0 - disabled)", params.cache_idle_sec),
+        [](common_params & params, int value) {
+            params.cache_idle_sec = value;
+        }
+    ).set_env("LLAMA_ARG_CACHE_IDLE").set_examples({LLAMA_EXAMPLE_SERVER}));
     add_opt(common_arg(
         {"--kv-unified", "-kvu"},
         string_format("use single unified KV buffer for the KV cache of all sequences (default: %s)\n"
@@ -1951,6 +2015,45 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.kv_unified = true;
         }
     ).set_env("LLAMA_ARG_KV_SPLIT"));
+    add_opt(common_arg(
+        {"--kv-paged"},
+        string_format("allocate the KV cache of the sequences in blocks of cells taken from a shared pool, the server slots can\n"
+            "use the whole context and the requests are admitted by the free cells of the pool (implies --kv-unified, default: %s)", params.kv_paged ? "true" : "false"),
+        [](common_params & params) {
+            params.kv_paged   = true;
+            params.kv_unified = true;
+        }
+    ).set_env("LLAMA_ARG_KV_PAGED"));
+    add_opt(common_arg(
+        {"--kv-sink"}, "N",
+        string_format("when a sequence exceeds its context, evict its oldest tokens from the KV cache but keep the first N ones\n"
+            "as attention sinks, instead of shifting the context (default: %d, 0 = disabled)", params.n_kv_sink),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_kv_sink = value;
+        }
+    ).set_env("LLAMA_ARG_KV_SINK"));
+    add_opt(common_arg(
+        {"--kv-budget"}, "N",
+        string_format("max number of tokens of a sequence in the KV cache, beyond which the tokens that received the least attention\n"
+            "are evicted, instead of shifting the context - disables flash attention (default: %d, 0 = disabled)", params.n_kv_budget),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_kv_budget = value;
+        }
+    ).set_env("LLAMA_ARG_KV_BUDGET"));
+    add_opt(common_arg(
+        {"--no-kv-prefix-share"},
+        string_format("disable sharing the KV cells of common prompt prefixes between the slots of a unified KV cache (default: %s)",
+            params.kv_prefix_share ? "enabled" : "disabled"),
+        [](common_params & params) {
+            params.kv_prefix_share = false;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_NO_KV_PREFIX_SHARE"));
     add_opt(common_arg(
         {"--no-context-shift"},
         string_format("disables context shift on infinite text generation (default: %s)", params.ctx_shift ? "disabled" : "enabled"),
@@ -2625,6 +2728,37 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.cache_type_v = kv_cache_type_from_str(value);
         }
     ).set_env("LLAMA_ARG_CACHE_TYPE_V"));
+    add_opt(common_arg(
+        {"-ctkl", "--cache-type-k-layers"}, "LIST",
+        "KV cache data type for K of some layers, overriding --cache-type-k\n"
+        "comma-separated list of <layer>=<type> or <first>-<last>=<type>, e.g. 0-1=f16,2-29=q4_0",
+        [](common_params & params, const std::string & value) {
+            parse_kv_cache_type_layers(value, params.cache_type_layers, true);
+        }
+    ).set_env("LLAMA_ARG_CACHE_TYPE_K_LAYERS"));
+    add_opt(common_arg(
+        {"-ctvl", "--cache-type-v-layers"}, "LIST",
+        "KV cache data type for V of some layers, overriding --cache-type-v\n"
+        "comma-separated list of <layer>=<type> or <first>-<last>=<type>, e.g. 0-1=f16,2-29=q4_0\n"
+        "the quantized types require -fa on",
+        [](common_params & params, const std::string & value) {
+            parse_kv_cache_type_layers(value, params.cache_type_layers, false);
+        }
+    ).set_env("LLAMA_ARG_CACHE_TYPE_V_LAYERS"));
+    add_opt(common_arg(
+        {"--cache-type-auto"}, "N",
+        string_format(
+            "pick the KV cache data type of each layer with a short calibration run on the prompt or a built-in text:\n"
+            "the cheapest of q4_0, q8_0 and f16 whose relative error on the K and V of the layer is at most N, e.g. 0.01\n"
+            "the types of --cache-type-k-layers and --cache-type-v-layers are kept, V is only quantized with -fa on\n"
+            "(default: %.1f, 0.0 = disabled)", (double) params.cache_type_auto),
+        [](common_params & params, const std::string & value) {
+            params.cache_type_auto = std::stof(value);
+            if (params.cache_type_auto < 0.0f) {
+                throw std::invalid_argument("invalid value");
+            }
+        }
+    ).set_env("LLAMA_ARG_CACHE_TYPE_AUTO"));
     add_opt(common_arg(
         {"--hellaswag"},
         "compute HellaSwag score over random tasks from datafile supplied with -f",
@@ -2798,12 +2932,14 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         "- distribute: spread execution evenly over all nodes\n"
         "- isolate: only spawn threads on CPUs on the node that execution started on\n"
         "- numactl: use the CPU map provided by numactl\n"
+        "- partition: split the threads and the rows of the weights between the nodes, each node multiplying the rows in its memory\n"
         "if run without this previously, it is recommended to drop the system page cache before using this\n"
         "see https://github.com/ggml-org/llama.cpp/issues/1437",
         [](common_params & params, const std::string & value) {
             /**/ if (value == "distribute" || value == "") { params.numa = GGML_NUMA_STRATEGY_DISTRIBUTE; }
             else if (value == "isolate") { params.numa = GGML_NUMA_STRATEGY_ISOLATE; }
             else if (value == "numactl") { params.numa = GGML_NUMA_STRATEGY_NUMACTL; }
+            else if (value == "partition") { params.numa = GGML_NUMA_STRATEGY_PARTITION; }
             else { throw std::invalid_argument("invalid value"); }
         }
     ).set_env("LLAMA_ARG_NUMA"));
@@ -2869,6 +3005,17 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             }
         }
     ).set_env("LLAMA_ARG_N_CPU_MOE"));
+    add_opt(common_arg(
+        {"--moe-hot"}, "N",
+        "keep the N most used experts of each Mixture of Experts (MoE) layer locked in RAM, prefetch the used experts\n"
+        "and release the unused ones first, for MoE models larger than the RAM (requires mmap, not used with --mlock, default: 0 = disabled)",
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_moe_hot = value;
+        }
+    ).set_env("LLAMA_ARG_MOE_HOT"));
     add_opt(common_arg(
         {"--cpu-moe-draft", "-cmoed"},
         "keep all Mixture of Experts (MoE) weights in the CPU for the draft model",
@@ -3341,6 +3488,18 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             key_file.close();
         }
     ).set_examples({LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--api-key-priority"}, "KEY:N",
+        "priority class of the requests authenticated with the API key KEY; the \"priority\" field of these requests\n"
+        "is capped to N and defaults to it, the other requests are capped to 0 (default: none)",
+        [](common_params & params, const std::string & value) {
+            const auto pos = value.rfind(':');
+            if (pos == std::string::npos || pos == 0) {
+                throw std::invalid_argument("invalid value, expected KEY:N");
+            }
+            params.api_key_priority[value.substr(0, pos)] = std::stoi(value.substr(pos + 1));
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}));
     add_opt(common_arg(
         {"--ssl-key-file"}, "FNAME",
         "path to file a PEM-encoded SSL private key",
@@ -3390,6 +3549,33 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.n_cache_reuse = value;
         }
     ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_CACHE_REUSE"));
+    add_opt(common_arg(
+        {"--batch-budget"}, "N",
+        string_format(
+            "max number of tokens to process per server iteration; tokens of the generating slots are always admitted and\n"
+            "the pending prompts fill the remaining budget, keeping the latency between generated tokens stable (default: %d, 0 = n_batch)", params.n_batch_budget
+        ),
+        [](common_params & params, int value) {
+            params.n_batch_budget = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_BATCH_BUDGET"));
+    add_opt(common_arg(
+        {"--prefill-chunk"}, "N",
+        string_format(
+            "max number of prompt tokens of a single slot per server iteration; the slots receive their chunks\n"
+            "round-robin, so a long prompt does not hold back the other prompts (default: %d, 0 = no limit)", params.n_prefill_chunk
+        ),
+        [](common_params & params, int value) {
+            params.n_prefill_chunk = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_PREFILL_CHUNK"));
+    add_opt(common_arg(
+        {"--no-slot-preempt"},
+        "disable the preemption of lower priority generations by higher priority requests when no slot is available",
+        [](common_params & params) {
+            params.slot_preempt = false;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_NO_SLOT_PREEMPT"));
     add_opt(common_arg(
         {"--metrics"},
         string_format("enable prometheus compatible metrics endpoint (default: %s)", params.endpoint_metrics ? "enabled" : "disabled"),
@@ -3754,7 +3940,18 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         [](common_params & params, const std::string & value) {
             params.speculative.p_split = std::stof(value);
         }
-    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE}).set_env("LLAMA_ARG_DRAFT_P_SPLIT"));
+    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_P_SPLIT"));
+    add_opt(common_arg(
+        {"--draft-branch"}, "N",
+        string_format("max number of alternative draft tokens with a probability of at least --draft-p-split, verified together\n"
+                      "with the draft as a token tree in a single target decode (default: %d, requires --kv-unified)", params.speculative.n_branch),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_branch = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_BRANCH"));
     add_opt(common_arg(
         {"--draft-p-min"}, "P",
         string_format("minimum speculative decoding probability (greedy) (default: %.1f)", (double)params.speculative.p_min),
@@ -3762,6 +3959,14 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.speculative.p_min = std::stof(value);
         }
     ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_P_MIN"));
+    add_opt(common_arg(
+        {"--no-draft-adaptive"},
+        "use a fixed max draft length instead of the length that maximizes the expected tokens per unit of time,\n"
+        "given the measured acceptance rate of each draft position and the draft and target timings",
+        [](common_params & params) {
+            params.speculative.adaptive = false;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_NO_DRAFT_ADAPTIVE"));
     add_opt(common_arg(
         {"-cd", "--ctx-size-draft"}, "N",
         string_format("size of the prompt context for the draft model (default: %d, 0 = loaded from model)", params.speculative.n_ctx),
@@ -3803,6 +4008,35 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.speculative.replacements.push_back({ tgt, dft });
         }
     ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--draft-lookup"},
+        "without a draft model, draft the tokens that follow the longest earlier occurrence of the end of the context,\n"
+        "in the prompt, the generated text or the --draft-lookup-corpus files (default: disabled)",
+        [](common_params & params) {
+            params.speculative.lookup = true;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_LOOKUP"));
+    add_opt(common_arg(
+        {"--draft-lookup-min"}, "N",
+        string_format("min length of the match of the end of the context to draft from with --draft-lookup (default: %d)", params.speculative.lookup_min),
+        [](common_params & params, int value) {
+            if (value < 1) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.lookup_min = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_LOOKUP_MIN"));
+    add_opt(common_arg(
+        {"--draft-lookup-corpus"}, "FNAME",
+        "text file to draft from with --draft-lookup, in addition to the context (can be repeated)",
+        [](common_params & params, const std::string & value) {
+            std::ifstream file(value);
+            if (!file) {
+                throw std::runtime_error(string_format("error: failed to open file '%s'\n", value.c_str()));
+            }
+            params.speculative.lookup_corpus.push_back(value);
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}));
     add_opt(common_arg(
         {"-ctkd", "--cache-type-k-draft"}, "TYPE",
         string_format(
@@ -913,6 +913,199 @@ std::string fs_get_cache_file(const std::string & filename) {
 // Model utils
 //
 
+// the K and V computed by each layer during the calibration of the KV cache types
+struct common_kv_calib {
+    struct data {
+        int64_t n_embd_head = 0;
+        int64_t n_per_row   = 0;
+
+        std::vector<float> x;
+    };
+
+    std::map<int32_t, data> k;
+    std::map<int32_t, data> v;
+};
+
+static bool common_kv_calib_cb(struct ggml_tensor * t, bool ask, void * user_data) {
+    auto * calib = (common_kv_calib *) user_data;
+
+    const bool is_k = strncmp(t->name, "Kcur-", 5) == 0;
+    const bool is_v = strncmp(t->name, "Vcur-", 5) == 0;
+
+    if (ask) {
+        return is_k || is_v;
+    }
+
+    // the tensors are named several times in the graph of a layer, the last one is what is stored in the cache
+    // note: skip the views, e.g. "Kcur-0 (view)"
+    char * end = nullptr;
+    const long il = strtol(t->name + 5, &end, 10);
+
+    if ((!is_k && !is_v) || *end != '\0' || t->type != GGML_TYPE_F32 || !ggml_is_contiguous(t)) {
+        return true;
+    }
+
+    auto & dst = (is_k ? calib->k : calib->v)[il];
+
+    // [n_embd_head, n_head, n_tokens] or [n_embd_gqa, n_tokens]
+    dst.n_embd_head = t->ne[0];
+    dst.n_per_row   = ggml_nelements(t) / t->ne[ggml_n_dims(t) - 1];
+
+    dst.x.resize(ggml_nelements(t));
+    ggml_backend_tensor_get(t, dst.x.data(), 0, ggml_nbytes(t));
+
+    return true;
+}
+
+// relative squared error of the rows of x quantized to type
+static double common_kv_calib_error(const common_kv_calib::data & d, ggml_type type) {
+    // the heads are quantized separately
+    if (d.n_embd_head % ggml_blck_size(type) != 0 || d.n_per_row % ggml_blck_size(type) != 0) {
+        return INFINITY;
+    }
+
+    const auto * traits = ggml_get_type_traits(type);
+
+    std::vector<uint8_t> q(ggml_row_size(type, d.n_per_row));
+    std::vector<float>   y(d.n_per_row);
+
+    double err = 0.0;
+    double sum = 0.0;
+
+    for (size_t i = 0; i + d.n_per_row <= d.x.size(); i += d.n_per_row) {
+        traits->from_float_ref(d.x.data() + i, q.data(), d.n_per_row);
+        traits->to_float(q.data(), y.data(), d.n_per_row);
+
+        for (int64_t j = 0; j < d.n_per_row; ++j) {
+            const double x = d.x[i + j];
+
+            err += (x - y[j])*(x - y[j]);
+            sum += x*x;
+        }
+    }
+
+    return sum > 0.0 ? err/sum : 0.0;
+}
+
+// pick the cheapest type of the KV cache of each layer whose relative error on the K and V of a short text is below
+// params.cache_type_auto - the layers with outliers in their K or V get more bits than the others
+// the types set explicitly with params.cache_type_layers are kept
+static bool common_kv_calibrate(llama_model * model, common_params & params) {
+    static const char * calib_text =
+        "The history of the city goes back more than two thousand years. It was founded on the banks of a river, "
+        "where merchants traded grain, wine and salt. Over the centuries it grew into a center of learning, with a "
+        "university, several libraries and a famous observatory. Today, the old town attracts visitors from all over "
+        "the world, who come to see its cathedral, its narrow streets and its markets. In 1889, a bridge of 1,024 meters "
+        "was built across the river; it was the longest in the country at the time.";
+
+    if (llama_model_is_recurrent(model)) {
+        LOG_WRN("%s: the model has no KV cache, skipping the calibration\n", __func__);
+        return true;
+    }
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+
+    auto tokens = common_tokenize(vocab, params.prompt.empty() ? calib_text : params.prompt, true, true);
+    if (tokens.size() > 512) {
+        tokens.resize(512);
+    }
+
+    common_kv_calib calib;
+
+    auto cparams = common_context_params_to_llama(params);
+
+    cparams.n_ctx             = 512;
+    cparams.n_batch           = 512;
+    cparams.n_ubatch          = 512;
+    cparams.n_seq_max         = 1;
+    cparams.n_moe_hot         = 0;
+    cparams.n_kv_sink         = 0;
+    cparams.n_kv_budget       = 0;
+    cparams.kv_paged          = false;
+    cparams.embeddings        = false;
+    cparams.type_k            = GGML_TYPE_F16;
+    cparams.type_v            = GGML_TYPE_F16;
+    cparams.kv_type_overrides = nullptr;
+    cparams.cb_eval           = common_kv_calib_cb;
+    cparams.cb_eval_user_data = &calib;
+
+    llama_context * lctx = llama_init_from_model(model, cparams);
+    if (lctx == NULL) {
+        LOG_ERR("%s: failed to create the calibration context\n", __func__);
+        return false;
+    }
+
+    const int ret = llama_decode(lctx, llama_batch_get_one(tokens.data(), tokens.size()));
+
+    llama_free(lctx);
+
+    if (ret != 0) {
+        LOG_ERR("%s: failed to evaluate the calibration text, ret = %d\n", __func__, ret);
+        return false;
+    }
+
+    // the quantized V cache requires flash attention, and the FA kernels are mostly built for equal K and V types
+    // with -fa auto, flash attention can still resolve to disabled when the context is created
+    const bool quantize_v = params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_ENABLED;
+
+    const ggml_type types[] = { GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_F16 };
+
+    std::map<int32_t, llama_kv_type_override> res;
+
+    for (const auto & it : calib.k) {
+        const int32_t il = it.first;
+
+        ggml_type type = GGML_TYPE_F16;
+
+        for (ggml_type t : types) {
+            const double err_k = common_kv_calib_error(it.second, t);
+            const double err_v = quantize_v && calib.v.count(il) ? common_kv_calib_error(calib.v.at(il), t) : 0.0;
+
+            if (t == GGML_TYPE_F16 || (err_k <= params.cache_type_auto && err_v <= params.cache_type_auto)) {
+                LOG_DBG("%s: layer %3d: %s, err_k = %.6f, err_v = %.6f\n", __func__, il, ggml_type_name(t), err_k, err_v);
+                type = t;
+                break;
+            }
+        }
+
+        res[il] = { il, type, quantize_v ? type : GGML_TYPE_COUNT };
+    }
+
+    for (const auto & o : params.cache_type_layers) {
+        if (o.il < 0) {
+            continue;
+        }
+
+        auto & r = res.emplace(o.il, llama_kv_type_override { o.il, GGML_TYPE_COUNT, GGML_TYPE_COUNT }).first->second;
+
+        if (o.type_k != GGML_TYPE_COUNT) {
+            r.type_k = o.type_k;
+        }
+        if (o.type_v != GGML_TYPE_COUNT) {
+            r.type_v = o.type_v;
+        }
+    }
+
+    std::map<ggml_type, int> n_type;
+
+    params.cache_type_layers.clear();
+    for (const auto & it : res) {
+        params.cache_type_layers.push_back(it.second);
+        n_type[it.second.type_k == GGML_TYPE_COUNT ? params.cache_type_k : it.second.type_k]++;
+    }
+    params.cache_type_layers.push_back({ -1, GGML_TYPE_COUNT, GGML_TYPE_COUNT });
+
+    std::string msg;
+    for (const auto & it : n_type) {
+        msg += string_format("%s%s: %d", msg.empty() ? "" : ", ", ggml_type_name(it.first), it.second);
+    }
+
+    LOG_INF("%s: KV cache types of the %zu layers from %zu tokens: %s%s\n", __func__, res.size(), tokens.size(), msg.c_str(),
+            quantize_v ? "" : " (K only, the quantized V cache requires -fa on)");
+
+    return true;
+}
+
 struct common_init_result common_init_from_params(common_params & params) {
     common_init_result iparams;
     auto mparams = common_model_params_to_llama(params);
@@ -926,6 +1119,11 @@ struct common_init_result common_init_from_params(common_params & params) {
 
     const llama_vocab * vocab = llama_model_get_vocab(model);
 
+    if (params.cache_type_auto > 0.0f && !common_kv_calibrate(model, params)) {
+        llama_model_free(model);
+        return iparams;
+    }
+
     auto cparams = common_context_params_to_llama(params);
 
     llama_context * lctx = llama_init_from_model(model, cparams);
@@ -1174,6 +1372,9 @@ struct llama_context_params common_context_params_to_llama(const common_params &
     cparams.yarn_beta_fast    = params.yarn_beta_fast;
     cparams.yarn_beta_slow    = params.yarn_beta_slow;
     cparams.yarn_orig_ctx     = params.yarn_orig_ctx;
+    cparams.n_moe_hot         = params.n_moe_hot;
+    cparams.n_kv_sink         = params.n_kv_sink;
+    cparams.n_kv_budget       = params.n_kv_budget;
     cparams.pooling_type      = params.pooling_type;
     cparams.attention_type    = params.attention_type;
     cparams.flash_attn_type   = params.flash_attn_type;
@@ -1184,10 +1385,21 @@ struct llama_context_params common_context_params_to_llama(const common_params &
     cparams.op_offload        = !params.no_op_offload;
     cparams.swa_full          = params.swa_full;
     cparams.kv_unified        = params.kv_unified;
+    cparams.kv_paged          = params.kv_paged;
 
     cparams.type_k = params.cache_type_k;
     cparams.type_v = params.cache_type_v;
 
+    if (!params.cache_type_layers.empty()) {
+        GGML_ASSERT(params.cache_type_layers.back().il < 0 && "KV cache type overrides not terminated with a negative layer");
+        cparams.kv_type_overrides = params.cache_type_layers.data();
+    }
+
+    if (params.speculative.n_branch > 0 && params.kv_unified) {
+        // the branches of the draft trees are verified in sequences of their own
+        cparams.n_seq_max = params.n_parallel*(1 + params.speculative.n_branch);
+    }
+
     return cparams;
 }
 
@@ -207,9 +207,15 @@ struct common_params_speculative {
     int32_t n_max        =    16; // maximum number of tokens to draft during speculative decoding
     int32_t n_min        =     0; // minimum number of draft tokens to use for speculative decoding
     int32_t n_gpu_layers =    -1; // number of layers to store in VRAM for the draft model (-1 - use default)
+    int32_t n_branch     =     0; // max number of alternative draft tokens verified as a token tree (0 = disabled)
     float   p_split      =  0.1f; // speculative decoding split probability
     float   p_min        = 0.75f; // minimum speculative decoding probability (greedy)
+    bool    adaptive     =  true; // adapt the draft length to the measured acceptance rate and timings
     std::vector<std::pair<std::string, std::string>> replacements; // main to speculative model replacements
+
+    bool    lookup     = false; // draft from earlier occurrences in the context and the lookup corpus, without a draft model
+    int32_t lookup_min =     3; // min length of the match to draft from
+    std::vector<std::string> lookup_corpus; // text files to draft from
     std::vector<llama_model_tensor_buft_override> tensor_buft_overrides;
 
     ggml_type cache_type_k = GGML_TYPE_F16; // KV cache data type for the K
@@ -292,6 +298,9 @@ struct common_params {
     float   yarn_beta_fast        = -1.0f; // YaRN low correction dim
     float   yarn_beta_slow        = -1.0f; // YaRN high correction dim
     int32_t yarn_orig_ctx         =     0; // YaRN original context length
+    int32_t n_moe_hot             =     0; // number of most used experts of each MoE layer kept locked in RAM (0 = disabled)
+    int32_t n_kv_sink             =     0; // number of attention sink tokens kept when evicting the old KV cells (0 = disabled)
+    int32_t n_kv_budget           =     0; // max number of KV cells of a sequence, the least attended are evicted (0 = disabled)
 
     // offload params
     std::vector<ggml_backend_dev_t> devices; // devices to use for offloading
@@ -381,6 +390,8 @@ struct common_params {
     bool ctx_shift         = false; // context shift on infinite text generation
     bool swa_full          = false; // use full-size SWA cache (https://github.com/ggml-org/llama.cpp/pull/13194#issuecomment-2868343055)
     bool kv_unified        = false; // enable unified KV cache
+    bool kv_paged          = false; // allocate the KV cells of the sequences in blocks from a shared pool
+    bool kv_prefix_share   = true;  // share common prompt prefixes between sequences of the unified KV cache
 
     bool input_prefix_bos  = false; // prefix BOS to user inputs, preceding input_prefix
     bool use_mmap          = true;  // use mmap for faster loads
@@ -399,6 +410,9 @@ struct common_params {
     ggml_type cache_type_k = GGML_TYPE_F16; // KV cache data type for the K
     ggml_type cache_type_v = GGML_TYPE_F16; // KV cache data type for the V
 
+    std::vector<llama_kv_type_override> cache_type_layers; // per-layer KV cache data types, terminated by il = -1
+    float cache_type_auto = 0.0f; // pick the KV cache data type of each layer from a calibration run, max relative error (0 = disabled)
+
     common_conversation_mode conversation_mode = COMMON_CONVERSATION_MODE_AUTO;
 
     // multimodal models (see tools/mtmd)
@@ -427,6 +441,10 @@ struct common_params {
     int32_t n_cache_reuse     = 0;            // min chunk size to reuse from the cache via KV shifting
     int32_t n_ctx_checkpoints = 8;            // max number of context checkpoints per slot
     int32_t cache_ram_mib     = 8192;         // -1 = no limit, 0 - disable, 1 = 1 MiB, etc.
+    int32_t cache_disk_mib    = 32768;        // -1 = no limit, 1 = 1 MiB, etc.
+    int32_t cache_idle_sec    = 0;            // seconds after which the KV cells of an idle slot are moved to the prompt cache (0 = disabled)
+    int32_t n_batch_budget    = 0;            // max tokens per server batch, generated tokens are always admitted (0 = n_batch)
+    int32_t n_prefill_chunk   = 0;            // max prompt tokens per slot in a server batch (0 = no limit)
 
     std::string hostname      = "127.0.0.1";
     std::string public_path   = "";                                                                         // NOLINT
@@ -437,8 +455,10 @@ struct common_params {
     common_reasoning_format reasoning_format = COMMON_REASONING_FORMAT_DEEPSEEK;
     int reasoning_budget = -1;
     bool prefill_assistant = true;                                                                          // if true, any trailing assistant message will be prefilled into the response
+    bool slot_preempt = true;                                                                               // if true, requests with a higher priority may suspend lower priority generations
 
     std::vector<std::string> api_keys;
+    std::map<std::string, int32_t> api_key_priority; // highest request priority allowed for an API key
 
     std::string ssl_file_key  = "";                                                                         // NOLINT
     std::string ssl_file_cert = "";                                                                         // NOLINT
@@ -454,6 +474,7 @@ struct common_params {
     bool log_json = false;
 
     std::string slot_save_path;
+    std::string cache_disk_path; // directory of the disk tier of the prompt cache (empty = disabled)
 
     float slot_prompt_similarity = 0.1f;
 
@@ -6,6 +6,7 @@
 #include "common.h"
 #include "sampling.h"
 
+#include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <map>
@@ -18,19 +19,62 @@ struct common_speculative {
     struct llama_context * ctx_dft;
     struct common_sampler * smpl;
 
+    llama_seq_id seq_id; // sequence of the draft context used by this speculator
+
     llama_batch batch;
     llama_tokens prompt_dft;
     bool vocab_dft_compatible = true; // whether retokenization is needed
     std::map<std::string, std::string> tgt_dft_replacements = {};
+
+    // state of the draft in progress
+    llama_token id_next = LLAMA_TOKEN_NULL; // next token to evaluate in the draft sequence
+    int32_t     i_batch = -1;               // index of the logits of the last evaluated token
+
+    // decayed counts of the verified drafts, per draft position:
+    // the drafts that reached the position with all previous tokens accepted, and those that were also accepted there
+    std::vector<double> n_reach = {};
+    std::vector<double> n_hit   = {};
+
+    // decayed least-squares fit of the verification time t = a + b*n, with n the number of tokens in the target batch
+    double fit_s1  = 0.0;
+    double fit_sn  = 0.0;
+    double fit_snn = 0.0;
+    double fit_st  = 0.0;
+    double fit_snt = 0.0;
+
+    // decayed mean of the number of tokens of the other sequences in the target batches of the verifications
+    double n_other_s  = 0.0;
+    double n_other_s1 = 0.0;
+
+    double t_draft_us = 0.0; // moving average of the time of a draft step
+
+    uint64_t n_choices = 0;
+
+    common_speculative_stats stats = {};
+
+    // lookup drafting, without a draft model
+    common_suffix_automaton         sam        = {};      // the prompt and id_last of the last draft
+    const common_suffix_automaton * sam_corpus = nullptr; // static corpus, not owned
+    common_suffix_automaton_cursor  sam_cursor = {};      // match of the end of the text in the corpus
 };
 
+// weight of the past observations in the statistics, per new observation
+#define SPEC_STATS_DECAY 0.98
+
+// the longest draft is used for the first drafts, and then periodically, so that the acceptance of all positions stays known
+#define SPEC_STATS_EXPLORE 16
+
 struct common_speculative * common_speculative_init(
         struct llama_context * ctx_tgt,
-        struct llama_context * ctx_dft) {
+        struct llama_context * ctx_dft,
+        llama_seq_id seq_id) {
+    GGML_ASSERT(seq_id >= 0 && seq_id < (llama_seq_id) llama_n_seq_max(ctx_dft));
+
     auto * result = new common_speculative {
         /* .ctx_tgt    = */ ctx_tgt,
         /* .ctx_dft    = */ ctx_dft,
         /* .smpl       = */ nullptr,
+        /* .seq_id     = */ seq_id,
         /* .batch      = */ llama_batch_init(llama_n_batch(ctx_dft), 0, 1),
         /* .prompt_dft = */ {},
         /* .vocab_dft_compatible = */ false,
@@ -74,6 +118,31 @@ struct common_speculative * common_speculative_init(
     return result;
 }
 
+struct common_speculative * common_speculative_init_lookup(
+        struct llama_context * ctx_tgt,
+        const struct common_suffix_automaton * corpus) {
+    auto * result = new common_speculative {
+        /* .ctx_tgt    = */ ctx_tgt,
+        /* .ctx_dft    = */ nullptr,
+        /* .smpl       = */ nullptr,
+        /* .seq_id     = */ 0,
+        /* .batch      = */ {},
+        /* .prompt_dft = */ {},
+        /* .vocab_dft_compatible = */ true,
+    };
+
+    result->sam_corpus = corpus;
+
+    common_suffix_automaton_clear(result->sam);
+
+    return result;
+}
+
+void common_speculative_reset(struct common_speculative * spec) {
+    common_suffix_automaton_clear(spec->sam);
+    spec->sam_cursor = {};
+}
+
 void common_speculative_free(struct common_speculative * spec) {
     if (spec == nullptr) {
         return;
@@ -153,6 +222,145 @@ void common_speculative_add_replacement_tgt_dft(
     spec->tgt_dft_replacements[source] = dest;
 }
 
+static double common_speculative_p_accept(const struct common_speculative * spec, int i) {
+    if (i >= (int) spec->n_reach.size()) {
+        return 0.5;
+    }
+
+    // uniform prior, for the positions that have rarely been reached
+    return (spec->n_hit[i] + 1.0) / (spec->n_reach[i] + 2.0);
+}
+
+// estimated verification time of a target batch of n tokens
+static double common_speculative_t_verify(const struct common_speculative * spec, int n) {
+    const double det = spec->fit_s1*spec->fit_snn - spec->fit_sn*spec->fit_sn;
+
+    if (spec->fit_s1 < 2.0 || det < 1e-6*spec->fit_s1*spec->fit_s1) {
+        return spec->fit_s1 > 0.0 ? spec->fit_st/spec->fit_s1 : 0.0;
+    }
+
+    double b = (spec->fit_s1*spec->fit_snt - spec->fit_sn*spec->fit_st)/det;
+    double a = (spec->fit_st - b*spec->fit_sn)/spec->fit_s1;
+
+    if (b < 0.0) {
+        b = 0.0;
+        a = spec->fit_st/spec->fit_s1;
+    } else if (a < 0.0) {
+        a = 0.0;
+        b = spec->fit_st/spec->fit_sn;
+    }
+
+    return a + b*n;
+}
+
+int common_speculative_n_draft(struct common_speculative * spec, int n_min, int n_max) {
+    auto & stats = spec->stats;
+
+    int res = n_max;
+
+    // the drafts are verified together with the other sequences of the target batch, so a draft of k tokens costs the
+    // verification of a batch with k + 1 more tokens than the other sequences
+    const int n_other = spec->n_other_s1 > 0.0 ? (int) std::lround(spec->n_other_s/spec->n_other_s1) : 0;
+
+    const bool explore = stats.n_drafts < SPEC_STATS_EXPLORE || spec->n_choices % SPEC_STATS_EXPLORE == 0;
+
+    spec->n_choices++;
+
+    if (!explore && n_min < n_max) {
+        double score_best = -1.0;
+
+        if (n_min == 0) {
+            // no draft - only the sampled token is evaluated
+            score_best = 1.0/std::max(1.0, common_speculative_t_verify(spec, n_other + 1));
+            res = 0;
+        }
+
+        // expected number of accepted tokens of a draft of length k
+        double p_all = 1.0;
+        double n_exp = 0.0;
+
+        for (int k = 1; k <= n_max; ++k) {
+            p_all *= common_speculative_p_accept(spec, k - 1);
+            n_exp += p_all;
+
+            if (k < n_min) {
+                continue;
+            }
+
+            const double t = std::max(1.0, common_speculative_t_verify(spec, n_other + k + 1) + k*spec->t_draft_us);
+            const double score = (1.0 + n_exp)/t;
+
+            if (score > score_best) {
+                score_best = score;
+                res = k;
+            }
+        }
+    }
+
+    if (stats.hist_n_draft.size() <= (size_t) res) {
+        stats.hist_n_draft.resize(res + 1, 0);
+    }
+
+    stats.hist_n_draft[res]++;
+    stats.n_draft_last = res;
+
+    return res;
+}
+
+void common_speculative_accept(struct common_speculative * spec, int n_draft, int n_accept, bool hit_branch, int n_batch, int n_batch_other, int64_t t_verify_us) {
+    GGML_ASSERT(n_accept <= n_draft);
+
+    auto & stats = spec->stats;
+
+    if ((int) spec->n_reach.size() < n_draft) {
+        spec->n_reach.resize(n_draft, 0.0);
+        spec->n_hit  .resize(n_draft, 0.0);
+    }
+
+    // the positions after the first rejected token are not reached
+    for (int i = 0; i < std::min(n_draft, n_accept + 1); ++i) {
+        spec->n_reach[i] = spec->n_reach[i]*SPEC_STATS_DECAY + 1.0;
+        spec->n_hit[i]   = spec->n_hit[i]  *SPEC_STATS_DECAY + (i < n_accept ? 1.0 : 0.0);
+    }
+
+    const double n = n_batch;
+    const double t = t_verify_us;
+
+    spec->fit_s1  = spec->fit_s1 *SPEC_STATS_DECAY + 1.0;
+    spec->fit_sn  = spec->fit_sn *SPEC_STATS_DECAY + n;
+    spec->fit_snn = spec->fit_snn*SPEC_STATS_DECAY + n*n;
+    spec->fit_st  = spec->fit_st *SPEC_STATS_DECAY + t;
+    spec->fit_snt = spec->fit_snt*SPEC_STATS_DECAY + n*t;
+
+    spec->n_other_s  = spec->n_other_s *SPEC_STATS_DECAY + n_batch_other;
+    spec->n_other_s1 = spec->n_other_s1*SPEC_STATS_DECAY + 1.0;
+
+    if (stats.hist_n_accept.size() <= (size_t) n_accept) {
+        stats.hist_n_accept.resize(n_accept + 1, 0);
+    }
+
+    stats.hist_n_accept[n_accept]++;
+    stats.n_drafts++;
+
+    if (hit_branch) {
+        stats.n_branch_hit++;
+    }
+}
+
+common_speculative_stats common_speculative_get_stats(const struct common_speculative * spec) {
+    common_speculative_stats res = spec->stats;
+
+    res.p_accept.resize(spec->n_reach.size());
+    for (size_t i = 0; i < res.p_accept.size(); ++i) {
+        res.p_accept[i] = common_speculative_p_accept(spec, i);
+    }
+
+    res.t_draft_ms  = spec->t_draft_us/1e3;
+    res.t_verify_ms = common_speculative_t_verify(spec, 2)/1e3;
+
+    return res;
+}
+
 static std::string replace_to_dft(
         struct common_speculative * spec,
         const std::string& input) {
@@ -182,28 +390,34 @@ static std::string replace_to_tgt(
 }
 
 
-llama_tokens common_speculative_gen_draft(
-        struct common_speculative * spec,
-        struct common_speculative_params params,
-        const llama_tokens & prompt_tgt_main_model, // specified in target model vocab
-        llama_token id_last) {
-    auto & batch  = spec->batch;
+// evaluate the prompt of the draft sequence up to id_last, reusing as much as possible from the previous draft
+// returns false if the draft is already complete, e.g. when a previous draft can be passed back as it is
+static bool common_speculative_draft_begin(struct common_speculative_draft & draft) {
+    auto * spec = draft.spec;
+
+    const auto & params = draft.params;
+
+    auto & batch   = spec->batch;
     auto & ctx_tgt = spec->ctx_tgt;
     auto & ctx_dft = spec->ctx_dft;
-    auto & smpl   = spec->smpl;
     auto & prompt_dft = spec->prompt_dft;
 
+    const llama_seq_id seq_id = spec->seq_id;
+
     auto * mem_dft = llama_get_memory(ctx_dft);
 
+    llama_token id_last = draft.id_last;
+
     int reuse_i = 0;
     int reuse_n = 0;
 
-    const int n_ctx = llama_n_ctx(ctx_dft) - params.n_draft;
+    // the draft context is split evenly between its sequences
+    const int n_ctx = llama_n_ctx(ctx_dft)/llama_n_seq_max(ctx_dft) - params.n_draft;
 
     llama_tokens prompt_tgt_draft_model;
     if (!spec->vocab_dft_compatible) {
         std::string text;
-        text = common_detokenize(ctx_tgt, prompt_tgt_main_model, true);
+        text = common_detokenize(ctx_tgt, *draft.prompt, true);
         text = replace_to_dft(spec, text);
         LOG_DBG("%s: main->draft detokenized string: '%s'\n", __func__, text.c_str());
         prompt_tgt_draft_model = common_tokenize(ctx_dft, text, false, true);
@@ -223,7 +437,7 @@ llama_tokens common_speculative_gen_draft(
     }
     // prompt_tgt's tokens will always be compatible with ctx_dft
     const llama_tokens &prompt_tgt =
-        spec->vocab_dft_compatible ? prompt_tgt_main_model : prompt_tgt_draft_model;
+        spec->vocab_dft_compatible ? *draft.prompt : prompt_tgt_draft_model;
 
     const int i_start = std::max<int>(0, (int) prompt_tgt.size() - n_ctx);
 
@@ -243,13 +457,17 @@ llama_tokens common_speculative_gen_draft(
         }
     }
 
-    LOG_DBG("%s: reuse_i = %d, reuse_n = %d, prompt = %d\n", __func__, reuse_i, reuse_n, (int) prompt_dft.size());
+    LOG_DBG("%s: seq_id = %d, reuse_i = %d, reuse_n = %d, prompt = %d\n", __func__, seq_id, reuse_i, reuse_n, (int) prompt_dft.size());
 
-    llama_tokens result;
+    auto & result = draft.result;
+
+    result.clear();
     result.reserve(params.n_draft);
 
+    draft.branches.clear();
+
     if (reuse_n == 0) {
-        llama_memory_clear(mem_dft, false);
+        llama_memory_seq_rm(mem_dft, seq_id, -1, -1);
         prompt_dft.clear();
     } else {
         // this happens when a previous draft has been discarded (for example, due to being too small), but the
@@ -263,18 +481,18 @@ llama_tokens common_speculative_gen_draft(
                 }
             }
 
-            return result;
+            return false;
         }
 
         if (reuse_i > 0) {
-            llama_memory_seq_rm (mem_dft, 0, 0, reuse_i);
-            llama_memory_seq_add(mem_dft, 0, reuse_i, -1, -reuse_i);
+            llama_memory_seq_rm (mem_dft, seq_id, 0, reuse_i);
+            llama_memory_seq_add(mem_dft, seq_id, reuse_i, -1, -reuse_i);
 
             prompt_dft.erase(prompt_dft.begin(), prompt_dft.begin() + reuse_i);
         }
 
         if (reuse_n < (int) prompt_dft.size()) {
-            llama_memory_seq_rm (mem_dft, 0, reuse_n, -1);
+            llama_memory_seq_rm (mem_dft, seq_id, reuse_n, -1);
             prompt_dft.erase(prompt_dft.begin() + reuse_n, prompt_dft.end());
         }
     }
@@ -284,7 +502,7 @@ llama_tokens common_speculative_gen_draft(
 
     for (size_t i = i_start + reuse_n; i < prompt_tgt.size(); ++i) {
         //LOG_DBG("i = %d, i_start = %d, reuse_n = %d, i - i_start = %d, id = %6d\n", i, i_start, reuse_n, i - i_start, prompt_tgt[i]);
-        common_batch_add(batch, prompt_tgt[i], i - i_start, { 0 }, false);
+        common_batch_add(batch, prompt_tgt[i], i - i_start, { seq_id }, false);
 
         prompt_dft.push_back(prompt_tgt[i]);
     }
@@ -296,66 +514,348 @@ llama_tokens common_speculative_gen_draft(
         llama_decode(ctx_dft, batch);
     }
 
-    const llama_pos n_past = prompt_dft.size();
+    // id_last is evaluated together with the drafted tokens
+    spec->id_next = id_last;
+
+    common_sampler_reset(spec->smpl);
+
+    return true;
+}
+
+// convert the draft back to the vocab of the target model
+static void common_speculative_draft_end(struct common_speculative_draft & draft) {
+    auto * spec = draft.spec;
+
+    auto & result = draft.result;
+
+    if (!spec->vocab_dft_compatible) {
+        std::string detokenized = common_detokenize(spec->ctx_dft, result, true);
+        detokenized = replace_to_tgt(spec, detokenized);
+        LOG_DBG("draft->main detokenized string: '%s'\n", detokenized.c_str());
+        result = common_tokenize(spec->ctx_tgt, detokenized, false, true);
+        if (result.size() > (size_t) draft.params.n_draft) {
+            result.resize(draft.params.n_draft);
+        }
+
+        // the positions of the branches do not carry over to the retokenized draft
+        draft.branches.clear();
+    }
+}
+
+// draft the tokens that follow the longest earlier occurrence of the end of the prompt and id_last
+static void common_speculative_draft_lookup(struct common_speculative_draft & draft) {
+    auto * spec = draft.spec;
+
+    const auto & params = draft.params;
+    const auto & prompt = *draft.prompt;
+
+    auto & sam = spec->sam;
+
+    const int64_t t_start = ggml_time_us();
+
+    draft.result.clear();
+    draft.branches.clear();
+
+    // the text of the automaton only grows with the new tokens of the context
+    // the caller resets the speculator when the context is not a continuation, only its last token is checked here
+    const size_t n_text = prompt.size() + 1;
+
+    const auto text_at = [&](size_t i) { return i < prompt.size() ? prompt[i] : draft.id_last; };
+
+    if (sam.text.size() > n_text || (!sam.text.empty() && sam.text.back() != text_at(sam.text.size() - 1))) {
+        common_speculative_reset(spec);
+    }
+
+    for (size_t i = sam.text.size(); i < n_text; ++i) {
+        const llama_token id = i < prompt.size() ? prompt[i] : draft.id_last;
+
+        common_suffix_automaton_add(sam, &id, 1);
+
+        if (spec->sam_corpus) {
+            common_suffix_automaton_step(*spec->sam_corpus, spec->sam_cursor, id);
+        }
+    }
+
+    int32_t pos = -1;
+    int32_t n_match = common_suffix_automaton_match(sam, pos);
+
+    const common_suffix_automaton * src = &sam;
+
+    // prefer the context over the corpus for matches of the same length
+    if (spec->sam_corpus && spec->sam_cursor.len > n_match) {
+        src     = spec->sam_corpus;
+        n_match = spec->sam_cursor.len;
+        pos     = spec->sam_corpus->states[spec->sam_cursor.state].pos;
+    }
+
+    if (n_match >= params.n_lookup_min) {
+        common_suffix_automaton_draft(*src, pos, params.n_draft, draft.result);
+    }
 
-    LOG_DBG("%s: n_past = %d\n", __func__, n_past);
+    LOG_DBG("%s: n_match = %d, pos = %d (%s), n_draft = %d\n", __func__, n_match, pos, src == &sam ? "context" : "corpus", (int) draft.result.size());
 
+    const double t_step = (ggml_time_us() - t_start)/(double) std::max<size_t>(1, draft.result.size());
+
+    spec->t_draft_us = spec->t_draft_us > 0.0 ? SPEC_STATS_DECAY*spec->t_draft_us + (1.0 - SPEC_STATS_DECAY)*t_step : t_step;
+}
+
+void common_speculative_gen_draft_batch(std::vector<common_speculative_draft> & drafts) {
+    llama_batch   * batch_ptr = nullptr;
+    llama_context * ctx_dft   = nullptr;
+
+    // the drafts that are still growing
+    std::vector<common_speculative_draft *> active;
+    active.reserve(drafts.size());
+
+    for (auto & draft : drafts) {
+        if (draft.spec->ctx_dft == nullptr) {
+            common_speculative_draft_lookup(draft);
+            continue;
+        }
+
+        if (ctx_dft == nullptr) {
+            batch_ptr = &draft.spec->batch;
+            ctx_dft   = draft.spec->ctx_dft;
+        }
+
+        GGML_ASSERT(draft.spec->ctx_dft == ctx_dft && "the speculators must share the draft context");
+
+        if (common_speculative_draft_begin(draft)) {
+            active.push_back(&draft);
+        }
+    }
+
+    if (active.empty()) {
+        for (auto & draft : drafts) {
+            if (draft.spec->ctx_dft) {
+                common_speculative_draft_end(draft);
+            }
+        }
+
+        return;
+    }
+
+    auto & batch = *batch_ptr;
+
+    GGML_ASSERT(active.size() <= (size_t) llama_n_batch(ctx_dft));
+
+    // evaluate id_last of all sequences, then one drafted token of each sequence per decode
     common_batch_clear(batch);
-    common_batch_add  (batch, id_last, n_past, { 0 }, true);
 
-    prompt_dft.push_back(id_last);
+    for (auto * draft : active) {
+        auto * spec = draft->spec;
 
-    LOG_DBG("%s: draft prompt: %s\n", __func__, string_from(ctx_dft, prompt_dft).c_str());
+        LOG_DBG("%s: seq_id = %d, n_past = %d\n", __func__, spec->seq_id, (int) spec->prompt_dft.size());
 
-    llama_decode(ctx_dft, batch);
+        spec->i_batch = batch.n_tokens;
+        common_batch_add(batch, spec->id_next, spec->prompt_dft.size(), { spec->seq_id }, true);
 
-    common_sampler_reset(smpl);
+        spec->prompt_dft.push_back(spec->id_next);
+    }
+
+    while (!active.empty()) {
+        const int64_t t_start = ggml_time_us();
+
+        llama_decode(ctx_dft, batch);
 
-    // sample n_draft tokens from the draft model
-    for (int i = 0; i < params.n_draft; ++i) {
         common_batch_clear(batch);
 
-        common_sampler_sample(smpl, ctx_dft, 0, true);
+        std::vector<common_speculative_draft *> next;
+
+        for (auto * draft : active) {
+            auto * spec = draft->spec;
+            auto * smpl = spec->smpl;
+
+            common_sampler_sample(smpl, ctx_dft, spec->i_batch, true);
+
+            const auto * cur_p = common_sampler_get_candidates(smpl, true);
+
+            for (int k = 0; k < std::min(3, (int) cur_p->size); ++k) {
+                LOG_DBG(" - draft candidate %3d, seq %d, pos %3d: %6d (%8.3f) '%s'\n",
+                        k, spec->seq_id, (int) draft->result.size(), cur_p->data[k].id, cur_p->data[k].p, common_token_to_piece(ctx_dft, cur_p->data[k].id).c_str());
+            }
+
+            const llama_token id = cur_p->data[0].id;
+
+            // branch off the draft with the likely alternatives, they are verified together with the draft
+            for (int k = 1; k < (int) cur_p->size && (int) draft->branches.size() < draft->params.n_branch; ++k) {
+                if (cur_p->data[k].p < draft->params.p_split) {
+                    break;
+                }
+
+                draft->branches.push_back({ (int32_t) draft->result.size(), cur_p->data[k].id });
+            }
+
+            common_sampler_accept(smpl, id, true);
+
+            draft->result.push_back(id);
+
+            if (draft->params.n_draft <= (int) draft->result.size()) {
+                continue;
+            }
+
+            // only collect very high-confidence draft tokens
+            if (cur_p->data[0].p < draft->params.p_min) {
+                continue;
+            }
 
-        const auto * cur_p = common_sampler_get_candidates(smpl, true);
+            // evaluate the drafted token on the draft model
+            spec->i_batch = batch.n_tokens;
+            common_batch_add(batch, id, spec->prompt_dft.size(), { spec->seq_id }, true);
 
-        for (int k = 0; k < std::min(3, (int) cur_p->size); ++k) {
-            LOG_DBG(" - draft candidate %3d, pos %3d: %6d (%8.3f) '%s'\n",
-                    k, i, cur_p->data[k].id, cur_p->data[k].p, common_token_to_piece(ctx_dft, cur_p->data[k].id).c_str());
+            spec->prompt_dft.push_back(id);
+
+            next.push_back(draft);
+        }
+
+        // the step took the same time for each sequence that was drafted in it
+        const double t_step = ggml_time_us() - t_start;
+
+        for (auto * draft : active) {
+            auto * spec = draft->spec;
+            spec->t_draft_us = spec->t_draft_us > 0.0 ? SPEC_STATS_DECAY*spec->t_draft_us + (1.0 - SPEC_STATS_DECAY)*t_step : t_step;
+        }
+
+        active = std::move(next);
+    }
+
+    for (auto & draft : drafts) {
+        if (draft.spec->ctx_dft) {
+            common_speculative_draft_end(draft);
+        }
+    }
+}
+
+llama_tokens common_speculative_gen_draft(
+        struct common_speculative * spec,
+        struct common_speculative_params params,
+        const llama_tokens & prompt_tgt_main_model, // specified in target model vocab
+        llama_token id_last) {
+    std::vector<common_speculative_draft> drafts(1);
+
+    drafts[0].spec    = spec;
+    drafts[0].params  = params;
+    drafts[0].prompt  = &prompt_tgt_main_model;
+    drafts[0].id_last = id_last;
+
+    common_speculative_gen_draft_batch(drafts);
+
+    return std::move(drafts[0].result);
+}
+
+std::vector<int> common_speculative_tree_add(
+        struct llama_context * ctx_tgt,
+        llama_batch & batch,
+        llama_seq_id seq_id,
+        const std::vector<llama_seq_id> & seq_ids_branch,
+        llama_pos n_past,
+        llama_token id_last,
+        const llama_tokens & draft,
+        const std::vector<common_speculative_branch> & branches) {
+    GGML_ASSERT(branches.size() <= seq_ids_branch.size());
+
+    auto * mem = llama_get_memory(ctx_tgt);
+
+    for (size_t b = 0; b < branches.size(); ++b) {
+        llama_memory_seq_cp(mem, seq_id, seq_ids_branch[b], -1, -1);
+    }
+
+    std::vector<int> idxs;
+    idxs.reserve(1 + draft.size() + branches.size());
+
+    // the token at position i of the draft is in the path of the branches that replace a later token
+    std::vector<llama_seq_id> seq_ids;
+
+    for (size_t i = 0; i <= draft.size(); ++i) {
+        seq_ids.clear();
+        seq_ids.push_back(seq_id);
+
+        for (size_t b = 0; b < branches.size(); ++b) {
+            if (branches[b].i_pos >= (int32_t) i) {
+                seq_ids.push_back(seq_ids_branch[b]);
+            }
         }
 
-        // add drafted token for each sequence
-        const llama_token id = cur_p->data[0].id;
+        idxs.push_back(batch.n_tokens);
+        common_batch_add(batch, i == 0 ? id_last : draft[i - 1], n_past + i, seq_ids, true);
+    }
+
+    for (size_t b = 0; b < branches.size(); ++b) {
+        idxs.push_back(batch.n_tokens);
+        common_batch_add(batch, branches[b].id, n_past + 1 + branches[b].i_pos, { seq_ids_branch[b] }, true);
+    }
+
+    return idxs;
+}
+
+llama_tokens common_speculative_tree_sample(
+        struct common_sampler * smpl,
+        struct llama_context * ctx_tgt,
+        const std::vector<int> & idxs,
+        const llama_tokens & draft,
+        const std::vector<common_speculative_branch> & branches,
+        int & i_branch) {
+    GGML_ASSERT(idxs.size() == 1 + draft.size() + branches.size());
+
+    i_branch = -1;
+
+    llama_tokens result;
+    result.reserve(draft.size() + 2);
+
+    for (size_t i = 0; i <= draft.size(); ++i) {
+        const llama_token id = common_sampler_sample(smpl, ctx_tgt, idxs[i]);
 
         common_sampler_accept(smpl, id, true);
 
         result.push_back(id);
 
-        if (params.n_draft <= (int) result.size()) {
-            break;
+        if (i == draft.size() || draft[i] == id) {
+            continue;
         }
 
-        // only collect very high-confidence draft tokens
-        if (cur_p->data[0].p < params.p_min) {
-            break;
+        // the draft is rejected here - continue on a branch that agrees with the target model, if any
+        for (size_t b = 0; b < branches.size(); ++b) {
+            if (branches[b].i_pos == (int32_t) i && branches[b].id == id) {
+                i_branch = b;
+                break;
+            }
         }
 
-        common_batch_add(batch, id, n_past + i + 1, { 0 }, true);
-
-        // evaluate the drafted tokens on the draft model
-        llama_decode(ctx_dft, batch);
+        if (i_branch >= 0) {
+            const llama_token id_next = common_sampler_sample(smpl, ctx_tgt, idxs[1 + draft.size() + i_branch]);
 
-        prompt_dft.push_back(id);
-    }
+            common_sampler_accept(smpl, id_next, true);
 
-    if (!spec->vocab_dft_compatible) {
-        std::string detokenized = common_detokenize(ctx_dft, result, true);
-        detokenized = replace_to_tgt(spec, detokenized);
-        LOG_DBG("draft->main detokenized string: '%s'\n", detokenized.c_str());
-        result = common_tokenize(ctx_tgt, detokenized, false, true);
-        if (result.size() > (size_t)params.n_draft) {
-            result.resize(params.n_draft);
+            result.push_back(id_next);
         }
+
+        break;
     }
+
     return result;
 }
+
+void common_speculative_tree_keep(
+        struct llama_context * ctx_tgt,
+        llama_seq_id seq_id,
+        const std::vector<llama_seq_id> & seq_ids_branch,
+        llama_pos n_past,
+        int n_ids,
+        int i_branch) {
+    auto * mem = llama_get_memory(ctx_tgt);
+
+    // the last returned token is not evaluated yet
+    const llama_pos n_keep = n_past + n_ids;
+
+    if (i_branch < 0) {
+        llama_memory_seq_rm(mem, seq_id, n_keep, -1);
+    } else {
+        // the path ends with the token of the branch, the draft token at its position was rejected
+        llama_memory_seq_rm(mem, seq_id, n_keep - 1, -1);
+        llama_memory_seq_cp(mem, seq_ids_branch[i_branch], seq_id, n_keep - 1, n_keep);
+    }
+
+    for (const llama_seq_id s : seq_ids_branch) {
+        llama_memory_seq_rm(mem, s, -1, -1);
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "llama.h"
 #include "common.h"
+#include "suffix-automaton.h"
 
 struct common_speculative;
 
@@ -10,15 +11,39 @@ struct common_speculative_params {
     int n_reuse = 256;
 
     float p_min = 0.75f; // min probability required to accept a token in the draft
+
+    int   n_branch = 0;    // max number of alternative tokens to branch off the draft, 0 = linear draft
+
+    int n_lookup_min = 3; // min length of the context match to draft from, for the lookup speculators
+    float p_split  = 0.1f; // min probability of an alternative token to branch off the draft
+};
+
+// an alternative to the drafted token at position i_pos, verified in a sequence of its own
+struct common_speculative_branch {
+    int32_t     i_pos;
+    llama_token id;
 };
 
+// several speculators can share a draft context, each drafting in its own sequence seq_id
 struct common_speculative * common_speculative_init(
         struct llama_context * ctx_tgt,
-        struct llama_context * ctx_dft
+        struct llama_context * ctx_dft,
+        llama_seq_id seq_id = 0
 );
 
+// model-free speculator that drafts the tokens following the longest earlier occurrence of the end of the context,
+// in the context itself (prompt and generated tokens) or in the static corpus, if any
+// the corpus is not copied and can be shared by several speculators
+struct common_speculative * common_speculative_init_lookup(
+        struct llama_context * ctx_tgt,
+        const struct common_suffix_automaton * corpus = nullptr);
+
 void common_speculative_free(struct common_speculative * spec);
 
+// forget the context of the previous drafts, when the next prompt is not a continuation of it
+// the lookup speculators extend their automaton with the new tokens of the prompt only
+void common_speculative_reset(struct common_speculative * spec);
+
 bool common_speculative_are_compatible(
         const struct llama_context * ctx_tgt,
         const struct llama_context * ctx_dft);
@@ -27,9 +52,93 @@ void common_speculative_add_replacement_tgt_dft(
         struct common_speculative * spec,
         const char *source, const char *dest);
 
+// online statistics of the drafts of a speculator
+struct common_speculative_stats {
+    int32_t  n_draft_last = 0; // draft length chosen for the last draft
+    uint64_t n_drafts     = 0; // number of verified drafts
+    uint64_t n_branch_hit = 0; // number of verified drafts that continued on one of their branches
+
+    std::vector<float>    p_accept;      // estimated probability to accept the token at each draft position, given that the previous ones were accepted
+    std::vector<uint64_t> hist_n_draft;  // number of drafts for each chosen draft length
+    std::vector<uint64_t> hist_n_accept; // number of verified drafts for each number of accepted tokens
+
+    float t_draft_ms  = 0.0f; // average time to draft one token
+    float t_verify_ms = 0.0f; // estimated time to verify a draft of a single token
+};
+
+// pick the draft length in [n_min, n_max] that maximizes the expected number of generated tokens per unit of time,
+// given the measured acceptance rate of each draft position and the draft and verification timings
+// returns 0 if drafting is not expected to pay off
+// with n_min == n_max, the length is not chosen but it is still recorded in the statistics
+int common_speculative_n_draft(struct common_speculative * spec, int n_min, int n_max);
+
+// record the outcome of a draft of n_draft tokens, of which n_accept were accepted by the target model
+// n_accept counts the tokens of the draft only, hit_branch tells if the path then continued on one of its branches
+// the verification took t_verify_us for a target batch of n_batch tokens, of which n_batch_other belong to other sequences
+void common_speculative_accept(struct common_speculative * spec, int n_draft, int n_accept, bool hit_branch, int n_batch, int n_batch_other, int64_t t_verify_us);
+
+common_speculative_stats common_speculative_get_stats(const struct common_speculative * spec);
+
 // sample up to n_draft tokens and add them to the batch using the draft model
 llama_tokens common_speculative_gen_draft(
                struct common_speculative * spec,
         struct common_speculative_params   params,
                       const llama_tokens & prompt,
                              llama_token   id_last);
+
+struct common_speculative_draft {
+    struct common_speculative      * spec;
+    struct common_speculative_params params;
+
+    const llama_tokens * prompt; // specified in target model vocab
+    llama_token          id_last;
+
+    llama_tokens result;
+
+    std::vector<common_speculative_branch> branches; // alternatives to the tokens of the result, at most params.n_branch
+};
+
+// generate the drafts of several speculators that share the same draft context
+// the sequences are drafted in lock-step, with a single draft decode per drafted position for all of them
+// the lookup speculators can be mixed in, they do not use the draft context
+void common_speculative_gen_draft_batch(std::vector<common_speculative_draft> & drafts);
+
+//
+// token tree verification
+//
+// the draft and its branches are evaluated in a single target decode: the tokens of the draft belong to the sequence
+// of the draft and to the sequences of the branches that come after them, so that each branch attends only to its own path
+// this requires a target context with a unified KV cache and a free sequence id for each branch
+//
+
+// copy the past of seq_id to the branch sequences and add id_last, the draft and the branches to the target batch
+// returns the batch indices of id_last, of the draft tokens and of the branches, in that order
+std::vector<int> common_speculative_tree_add(
+               struct llama_context * ctx_tgt,
+                        llama_batch & batch,
+                       llama_seq_id   seq_id,
+    const std::vector<llama_seq_id> & seq_ids_branch,
+                          llama_pos   n_past, // position of id_last
+                        llama_token   id_last,
+                 const llama_tokens & draft,
+    const std::vector<common_speculative_branch> & branches);
+
+// sample the longest path of the tree that the target model agrees with
+// returns the accepted tokens followed by a new sampled token, and the branch that ends the path in i_branch (-1 if none)
+llama_tokens common_speculative_tree_sample(
+               struct common_sampler * smpl,
+                struct llama_context * ctx_tgt,
+                const std::vector<int> & idxs,
+                  const llama_tokens & draft,
+    const std::vector<common_speculative_branch> & branches,
+                                 int & i_branch);
+
+// keep the accepted path in seq_id and remove the branch sequences from the target memory
+// n_ids is the number of tokens returned by common_speculative_tree_sample
+void common_speculative_tree_keep(
+               struct llama_context * ctx_tgt,
+                       llama_seq_id   seq_id,
+    const std::vector<llama_seq_id> & seq_ids_branch,
+                          llama_pos   n_past,
+                                int   n_ids,
+                                int   i_branch);
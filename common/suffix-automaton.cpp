@@ -0,0 +1,146 @@
+#include "suffix-automaton.h"
+
+#include <algorithm>
+
+static int32_t common_suffix_automaton_next(const common_suffix_automaton_state & s, llama_token token) {
+    const auto it = std::lower_bound(s.next.begin(), s.next.end(), token,
+            [](const std::pair<llama_token, int32_t> & a, llama_token b) { return a.first < b; });
+
+    return it != s.next.end() && it->first == token ? it->second : -1;
+}
+
+static void common_suffix_automaton_set_next(common_suffix_automaton_state & s, llama_token token, int32_t state) {
+    auto it = std::lower_bound(s.next.begin(), s.next.end(), token,
+            [](const std::pair<llama_token, int32_t> & a, llama_token b) { return a.first < b; });
+
+    if (it != s.next.end() && it->first == token) {
+        it->second = state;
+    } else {
+        s.next.insert(it, { token, state });
+    }
+}
+
+void common_suffix_automaton_clear(common_suffix_automaton & sam) {
+    sam.states.clear();
+    sam.states.emplace_back();
+    sam.text.clear();
+    sam.last = 0;
+}
+
+void common_suffix_automaton_add(common_suffix_automaton & sam, const llama_token * tokens, int32_t n_tokens) {
+    if (sam.states.empty()) {
+        common_suffix_automaton_clear(sam);
+    }
+
+    auto & states = sam.states;
+
+    for (int32_t i = 0; i < n_tokens; ++i) {
+        const llama_token token = tokens[i];
+
+        // the suffixes of the text so far end at its last position
+        // the state of the whole text has it already, and the root has no position
+        for (int32_t p = states[sam.last].link; p > 0; p = states[p].link) {
+            states[p].pos = sam.text.size() - 1;
+        }
+
+        sam.text.push_back(token);
+
+        // note: states can be reallocated, only refer to them by index
+        const int32_t cur = states.size();
+        states.emplace_back();
+        states[cur].len = states[sam.last].len + 1;
+        states[cur].pos = sam.text.size() - 1;
+
+        int32_t p = sam.last;
+        while (p != -1 && common_suffix_automaton_next(states[p], token) == -1) {
+            common_suffix_automaton_set_next(states[p], token, cur);
+            p = states[p].link;
+        }
+
+        if (p == -1) {
+            states[cur].link = 0;
+        } else {
+            const int32_t q = common_suffix_automaton_next(states[p], token);
+
+            if (states[p].len + 1 == states[q].len) {
+                states[cur].link = q;
+            } else {
+                // split q, so that the state of the suffix has the right length
+                const int32_t clone = states.size();
+                states.push_back(states[q]);
+                states[clone].len = states[p].len + 1;
+
+                while (p != -1 && common_suffix_automaton_next(states[p], token) == q) {
+                    common_suffix_automaton_set_next(states[p], token, clone);
+                    p = states[p].link;
+                }
+
+                states[q].link   = clone;
+                states[cur].link = clone;
+            }
+        }
+
+        sam.last = cur;
+    }
+}
+
+int32_t common_suffix_automaton_match(const common_suffix_automaton & sam, int32_t & pos) {
+    pos = -1;
+
+    if (sam.states.empty()) {
+        return 0;
+    }
+
+    // the suffix link of the whole text is the longest suffix that also ends elsewhere - necessarily earlier
+    const int32_t s = sam.states[sam.last].link;
+    if (s <= 0) {
+        return 0;
+    }
+
+    pos = sam.states[s].pos;
+
+    return sam.states[s].len;
+}
+
+void common_suffix_automaton_step(const common_suffix_automaton & sam, common_suffix_automaton_cursor & cur, llama_token token) {
+    if (sam.states.empty()) {
+        return;
+    }
+
+    const auto & states = sam.states;
+
+    // shorten the match until it can be extended with the token
+    while (cur.state > 0 && common_suffix_automaton_next(states[cur.state], token) == -1) {
+        cur.state = states[cur.state].link;
+        cur.len   = states[cur.state].len;
+    }
+
+    const int32_t next = common_suffix_automaton_next(states[cur.state], token);
+    if (next == -1) {
+        cur.state = 0;
+        cur.len   = 0;
+    } else {
+        cur.state = next;
+        cur.len  += 1;
+    }
+}
+
+void common_suffix_automaton_draft(const common_suffix_automaton & sam, int32_t pos, int32_t n_draft, std::vector<llama_token> & draft) {
+    const int32_t n_text  = sam.text.size();
+    const int32_t n_start = draft.size();
+
+    // nothing follows the end of the text
+    if (pos >= n_text - 1) {
+        return;
+    }
+
+    for (int32_t i = pos + 1; n_draft > 0; ++i, --n_draft) {
+        // past the end of the text, the tokens are those drafted from pos + 1
+        const llama_token token = i < n_text ? sam.text[i] : draft[n_start + i - n_text];
+        if (token == LLAMA_TOKEN_NULL) {
+            break;
+        }
+
+        draft.push_back(token);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "llama.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Suffix automaton of a token sequence, built online:
+// each state is a set of substrings that end at the same positions of the text, the longest one having len tokens.
+// Finding the longest suffix of the text that occurred before, and the end of its last occurrence, is O(1).
+// Appending a token takes amortized O(1) time to extend the automaton, plus a walk of the suffix links of the text
+// to record the last end position of its suffixes - the walk is short unless the text repeats a short pattern.
+
+struct common_suffix_automaton_state {
+    int32_t len  = 0;  // length of the longest substring of the state
+    int32_t link = -1; // suffix link: the state of the longest suffix that ends at more positions
+    int32_t pos  = -1; // end position in the text of the last occurrence of the substrings, see common_suffix_automaton_add
+
+    std::vector<std::pair<llama_token, int32_t>> next; // transitions, sorted by token
+};
+
+struct common_suffix_automaton {
+    std::vector<common_suffix_automaton_state> states;
+
+    std::vector<llama_token> text;
+
+    int32_t last = 0; // state of the whole text
+};
+
+// position in an automaton of the longest suffix of another text that is a substring of the automaton text
+struct common_suffix_automaton_cursor {
+    int32_t state = 0;
+    int32_t len   = 0;
+};
+
+// Reset an automaton to the empty text.
+void common_suffix_automaton_clear(common_suffix_automaton & sam);
+
+// Append tokens to the text of an automaton.
+// LLAMA_TOKEN_NULL can be used as a separator between unrelated texts, no match continues past it.
+// The last token of the text is only recorded in the state of the whole text, the other states have their last
+// occurrence before it.
+void common_suffix_automaton_add(common_suffix_automaton & sam, const llama_token * tokens, int32_t n_tokens);
+
+// Find the longest suffix of the text that also ends at an earlier position of the text.
+// pos:     set to the end position of the last earlier occurrence of the suffix.
+// returns: the length of the suffix, 0 if none.
+int32_t common_suffix_automaton_match(const common_suffix_automaton & sam, int32_t & pos);
+
+// Advance a cursor with the next token of the text to match.
+void common_suffix_automaton_step(const common_suffix_automaton & sam, common_suffix_automaton_cursor & cur, llama_token token);
+
+// Append to draft up to n_draft tokens of the automaton text that follow position pos.
+// Past the end of the text, the draft continues with its own tokens, so that a repeated pattern is drafted in full.
+void common_suffix_automaton_draft(const common_suffix_automaton & sam, int32_t pos, int32_t n_draft, std::vector<llama_token> & draft);
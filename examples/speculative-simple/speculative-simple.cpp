@@ -39,6 +39,13 @@ int main(int argc, char ** argv) {
     llama_context * ctx_tgt = NULL;
     llama_context * ctx_dft = NULL;
 
+    // the branches of the draft tree are verified in their own sequences of the target context
+    const int n_branch = params.speculative.n_branch;
+
+    if (n_branch > 0) {
+        params.kv_unified = true;
+    }
+
     // load the target model
     common_init_result llama_init_tgt = common_init_from_params(params);
 
@@ -61,6 +68,8 @@ int main(int argc, char ** argv) {
     params.cpuparams_batch.n_threads = params.speculative.cpuparams_batch.n_threads;
     params.tensor_buft_overrides     = params.speculative.tensor_buft_overrides;
 
+    params.speculative.n_branch = 0;
+
     common_init_result llama_init_dft = common_init_from_params(params);
 
     //model_dft = llama_init_dft.model.get();
@@ -101,6 +110,7 @@ int main(int argc, char ** argv) {
     int n_predict = 0;
     int n_drafted = 0;
     int n_accept  = 0;
+    int n_branched = 0; // drafts accepted through a branch
 
     // used to determine end of generation
     bool has_eos = false;
@@ -132,12 +142,20 @@ int main(int argc, char ** argv) {
     params_spec.n_reuse = llama_n_ctx(ctx_dft) - n_draft;
     params_spec.p_min   = p_min;
 
+    params_spec.n_branch = n_branch;
+    params_spec.p_split  = params.speculative.p_split;
+
+    std::vector<llama_seq_id> seq_ids_branch(n_branch);
+    for (int b = 0; b < n_branch; ++b) {
+        seq_ids_branch[b] = 1 + b;
+    }
+
     struct common_speculative * spec = common_speculative_init(ctx_tgt, ctx_dft);
     for (auto &pair : params.speculative.replacements) {
         common_speculative_add_replacement_tgt_dft(spec, pair.first.c_str(), pair.second.c_str());
     }
 
-    llama_batch batch_tgt = llama_batch_init(llama_n_batch(ctx_tgt), 0, 1);
+    llama_batch batch_tgt = llama_batch_init(llama_n_batch(ctx_tgt), 0, 1 + n_branch);
 
     const auto t_enc_end = ggml_time_us();
 
@@ -151,24 +169,35 @@ int main(int argc, char ** argv) {
         // offloaded to a remote device. it doesn't even have to be based on an LLM. instead, it can provide tokens
         // from a cache or lookup tables.
         //
-        llama_tokens draft = common_speculative_gen_draft(spec, params_spec, prompt_tgt, id_last);
+        // with --draft-branch, the likely alternatives to the drafted tokens are returned as branches of the draft
+        //
+        std::vector<common_speculative_draft> drafts(1);
+        drafts[0].spec    = spec;
+        drafts[0].params  = params_spec;
+        drafts[0].prompt  = &prompt_tgt;
+        drafts[0].id_last = id_last;
+
+        common_speculative_gen_draft_batch(drafts);
+
+        llama_tokens & draft = drafts[0].result;
+
+        std::vector<common_speculative_branch> & branches = drafts[0].branches;
 
         //LOG_DBG("draft: %s\n", string_from(ctx_dft, draft).c_str());
 
+        // evaluate the target model on [id_last, draft0, draft1, ..., draftN-1] and on the branches
         // always have a token to evaluate from before - id_last
         common_batch_clear(batch_tgt);
-        common_batch_add  (batch_tgt, id_last, n_past++, { 0 }, true);
 
-        // evaluate the target model on [id_last, draft0, draft1, ..., draftN-1]
+        std::vector<int> idxs;
         {
             // do not waste time on small drafts
             if (draft.size() < (size_t) n_draft_min) {
                 draft.clear();
+                branches.clear();
             }
 
-            for (size_t i = 0; i < draft.size(); ++i) {
-                common_batch_add(batch_tgt, draft[i], n_past + i, { 0 }, true);
-            }
+            idxs = common_speculative_tree_add(ctx_tgt, batch_tgt, 0, seq_ids_branch, n_past, id_last, draft, branches);
 
             //LOG_DBG("target batch: %s\n", string_from(ctx_tgt, batch_tgt).c_str());
 
@@ -182,16 +211,27 @@ int main(int argc, char ** argv) {
         // available logits from the batch and sample the next token until we run out of logits or the sampler
         // disagrees with the draft
         //
-        const auto ids = common_sampler_sample_and_accept_n(smpl, ctx_tgt, draft);
+        // when the sampler disagrees with the draft, the path can continue on a branch with the sampled token
+        //
+        int i_branch = -1;
+
+        const auto ids = common_speculative_tree_sample(smpl, ctx_tgt, idxs, draft, branches, i_branch);
 
         //LOG_DBG("ids: %s\n", string_from(ctx_tgt, ids).c_str());
 
         GGML_ASSERT(ids.size() > 0); // there will always be at least one accepted token
 
-        n_past    += ids.size() - 1;
+        {
+            LOG_DBG("keep the accepted path in the kv cache, n_past = %d, branch = %d\n", n_past + (int) ids.size(), i_branch);
+
+            common_speculative_tree_keep(ctx_tgt, 0, { seq_ids_branch.begin(), seq_ids_branch.begin() + branches.size() }, n_past, ids.size(), i_branch);
+        }
+
+        n_past    += ids.size();
         n_drafted += draft.size(); // note: we ignore the discarded small drafts
         n_accept  += ids.size() - 1;
         n_predict += ids.size();
+        n_branched += i_branch >= 0;
 
         // process the accepted tokens and update contexts
         //
@@ -219,12 +259,6 @@ int main(int argc, char ** argv) {
 
         LOG_DBG("accepted %d/%d draft tokens, the last target token is: (%d)\n", (int) ids.size() - 1, (int) draft.size(), id_last);
 
-        {
-            LOG_DBG("clear kv cache from any extra tokens, n_past = %d\n", n_past);
-
-            llama_memory_seq_rm(llama_get_memory(ctx_tgt), 0, n_past, -1);
-        }
-
         if ((params.n_predict >= 0 && n_predict > params.n_predict) || has_eos) {
             break;
         }
@@ -245,6 +279,9 @@ int main(int argc, char ** argv) {
     LOG_INF("n_drafted = %d\n", n_drafted);
     LOG_INF("n_accept  = %d\n", n_accept);
     LOG_INF("accept    = %.3f%%\n", 100.0f * n_accept / n_drafted);
+    if (n_branch > 0) {
+        LOG_INF("n_branched = %d\n", n_branched);
+    }
 
     LOG_INF("\n");
     LOG_INF("draft:\n\n");
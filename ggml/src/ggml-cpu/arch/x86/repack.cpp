@@ -1938,6 +1938,177 @@ void ggml_gemv_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+void ggml_gemv_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // The pairwise horizontal add of the dot products leaves the columns in the order 0 1 4 5 2 3 6 7
+    // The scales are loaded in the same order and the sums are put back in order when stored
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+
+    for (int64_t x = 0; x < nc / 8; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        __m256 acc_row = _mm256_setzero_ps();
+
+        for (int64_t b = 0; b < nb; b++) {
+            __m256i iacc_0123 = _mm256_setzero_si256();
+            __m256i iacc_4567 = _mm256_setzero_si256();
+
+            for (int k = 0; k < 4; k++) {
+                // 8 quants of the columns 0-3 and 4-7, multiplied with the same 8 quants of the row
+                const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64));
+                const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64 + 32));
+
+                int64_t lhs_raw;
+                memcpy(&lhs_raw, a_ptr[b].qs + k * 8, sizeof(int64_t));
+                const __m256i lhs_vec = _mm256_set1_epi64x(lhs_raw);
+
+                iacc_0123 = mul_sum_i8_pairs_acc_int32x8(iacc_0123, rhs_vec_0123, lhs_vec);
+                iacc_4567 = mul_sum_i8_pairs_acc_int32x8(iacc_4567, rhs_vec_4567, lhs_vec);
+            }
+
+            const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+            const __m256 row_scale_f32 = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[b].d));
+
+            const __m256i iacc = _mm256_hadd_epi32(iacc_0123, iacc_4567);
+            acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+        }
+
+        _mm256_storeu_ps(s + x * 8, _mm256_permutevar8x32_ps(acc_row, finalpermutemask));
+    }
+    return;
+#endif
+
+    ggml_gemv_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    const __m256i m4b  = _mm256_set1_epi8(0x0F);
+    const __m256i m2h  = _mm256_set1_epi8(0x30);
+    const __m256i m32s = _mm256_set1_epi8(32);
+
+    // Spread the 16 bit scales of the columns over the four 16 bit products of each column
+    const __m256i scalemask_0123 = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 2, 3,
+                                                    4, 5, 4, 5, 4, 5, 4, 5, 6, 7, 6, 7, 6, 7, 6, 7);
+    const __m256i scalemask_4567 = _mm256_setr_epi8(8, 9, 8, 9, 8, 9, 8, 9, 10, 11, 10, 11, 10, 11, 10, 11,
+                                                    12, 13, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15, 14, 15);
+
+    // The pairwise horizontal add of the dot products leaves the columns in the order 0 1 4 5 2 3 6 7
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+
+    for (int64_t x = 0; x < nc / 8; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        __m256 acc_row = _mm256_setzero_ps();
+
+        for (int64_t b = 0; b < nb; b++) {
+            __m256i iacc_0123 = _mm256_setzero_si256();
+            __m256i iacc_4567 = _mm256_setzero_si256();
+
+            // 8 quants of each of the four 32-quant groups of a half super block at a time
+            for (int k = 0; k < 8; k++) {
+                const int half = k / 4;
+                const int t    = k % 4;
+
+                const uint8_t * ql_0 = b_ptr[b].ql + (half * 8 + t) * 64;
+                const uint8_t * ql_1 = b_ptr[b].ql + (half * 8 + t + 4) * 64;
+                const uint8_t * qh   = b_ptr[b].qh + (half * 4 + t) * 64;
+
+                const __m256i ql_0_0123 = _mm256_loadu_si256((const __m256i *)(ql_0));
+                const __m256i ql_0_4567 = _mm256_loadu_si256((const __m256i *)(ql_0 + 32));
+                const __m256i ql_1_0123 = _mm256_loadu_si256((const __m256i *)(ql_1));
+                const __m256i ql_1_4567 = _mm256_loadu_si256((const __m256i *)(ql_1 + 32));
+                const __m256i qh_0123   = _mm256_loadu_si256((const __m256i *)(qh));
+                const __m256i qh_4567   = _mm256_loadu_si256((const __m256i *)(qh + 32));
+
+                // 6-bit quants offset to signed bytes
+                __m256i rhs_vec_0123[4];
+                __m256i rhs_vec_4567[4];
+                rhs_vec_0123[0] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_0_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_0123, 4), m2h)), m32s);
+                rhs_vec_4567[0] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_0_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_4567, 4), m2h)), m32s);
+                rhs_vec_0123[1] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_1_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_0123, 2), m2h)), m32s);
+                rhs_vec_4567[1] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_1_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_4567, 2), m2h)), m32s);
+                rhs_vec_0123[2] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_0_0123, 4), m4b), _mm256_and_si256(qh_0123, m2h)), m32s);
+                rhs_vec_4567[2] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_0_4567, 4), m4b), _mm256_and_si256(qh_4567, m2h)), m32s);
+                rhs_vec_0123[3] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_1_0123, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(qh_0123, 2), m2h)), m32s);
+                rhs_vec_4567[3] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_1_4567, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(qh_4567, 2), m2h)), m32s);
+
+                for (int g = 0; g < 4; g++) {
+                    const int sb = half * 8 + g * 2 + t / 2;
+
+                    const __m256i scales = _mm256_broadcastsi128_si256(_mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8))));
+                    const __m256i scale_0123 = _mm256_shuffle_epi8(scales, scalemask_0123);
+                    const __m256i scale_4567 = _mm256_shuffle_epi8(scales, scalemask_4567);
+
+                    int64_t lhs_raw;
+                    memcpy(&lhs_raw, a_ptr[b].qs + half * 128 + g * 32 + t * 8, sizeof(int64_t));
+                    const __m256i lhs_vec = _mm256_set1_epi64x(lhs_raw);
+
+                    const __m256i dot_0123 = _mm256_maddubs_epi16(_mm256_sign_epi8(rhs_vec_0123[g], rhs_vec_0123[g]), _mm256_sign_epi8(lhs_vec, rhs_vec_0123[g]));
+                    const __m256i dot_4567 = _mm256_maddubs_epi16(_mm256_sign_epi8(rhs_vec_4567[g], rhs_vec_4567[g]), _mm256_sign_epi8(lhs_vec, rhs_vec_4567[g]));
+
+                    iacc_0123 = _mm256_add_epi32(iacc_0123, _mm256_madd_epi16(dot_0123, scale_0123));
+                    iacc_4567 = _mm256_add_epi32(iacc_4567, _mm256_madd_epi16(dot_4567, scale_4567));
+                }
+            }
+
+            const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+            const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d);
+
+            const __m256i iacc = _mm256_hadd_epi32(iacc_0123, iacc_4567);
+            acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+        }
+
+        _mm256_storeu_ps(s + x * 8, _mm256_permutevar8x32_ps(acc_row, finalpermutemask));
+    }
+    return;
+#endif
+
+    ggml_gemv_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
 void ggml_gemm_q4_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
 #if defined(__AVX2__) || defined(__AVX512F__)
     {
@@ -6305,3 +6476,583 @@ void ggml_gemm_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 
 #endif
 }
+
+void ggml_gemm_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // The pairwise horizontal add of the dot products leaves the columns in the order 0 1 4 5 2 3 6 7
+    // The scales are loaded in the same order and the sums are put back in order when stored
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    for (int64_t y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+            __m256 acc_rows[4];
+            for (int i = 0; i < 4; i++) {
+                acc_rows[i] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                __m256i iacc_0123[4];
+                __m256i iacc_4567[4];
+                for (int i = 0; i < 4; i++) {
+                    iacc_0123[i] = _mm256_setzero_si256();
+                    iacc_4567[i] = _mm256_setzero_si256();
+                }
+
+                for (int k = 0; k < 4; k++) {
+                    // 8 quants of the columns 0-3 and 4-7, and the same 8 quants of the 4 rows
+                    const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64));
+                    const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64 + 32));
+                    const __m256i lhs_mat      = _mm256_loadu_si256((const __m256i *)(a_ptr[b].qs + k * 32));
+
+                    const __m256i lhs_vec[4] = {
+                        _mm256_permute4x64_epi64(lhs_mat, 0x00),
+                        _mm256_permute4x64_epi64(lhs_mat, 0x55),
+                        _mm256_permute4x64_epi64(lhs_mat, 0xAA),
+                        _mm256_permute4x64_epi64(lhs_mat, 0xFF),
+                    };
+
+                    for (int i = 0; i < 4; i++) {
+                        iacc_0123[i] = mul_sum_i8_pairs_acc_int32x8(iacc_0123[i], rhs_vec_0123, lhs_vec[i]);
+                        iacc_4567[i] = mul_sum_i8_pairs_acc_int32x8(iacc_4567[i], rhs_vec_4567, lhs_vec[i]);
+                    }
+                }
+
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+
+                for (int i = 0; i < 4; i++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[b].d[i]));
+                    const __m256i iacc = _mm256_hadd_epi32(iacc_0123[i], iacc_4567[i]);
+                    acc_rows[i] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[i]);
+                }
+            }
+
+            for (int i = 0; i < 4; i++) {
+                _mm256_storeu_ps(s + (y * 4 + i) * bs + x * 8, _mm256_permutevar8x32_ps(acc_rows[i], finalpermutemask));
+            }
+        }
+    }
+    return;
+#endif
+
+    ggml_gemm_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    const __m256i m4b  = _mm256_set1_epi8(0x0F);
+    const __m256i m2h  = _mm256_set1_epi8(0x30);
+    const __m256i m32s = _mm256_set1_epi8(32);
+
+    // Spread the 16 bit scales of the columns over the four 16 bit products of each column
+    const __m256i scalemask_0123 = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 2, 3,
+                                                    4, 5, 4, 5, 4, 5, 4, 5, 6, 7, 6, 7, 6, 7, 6, 7);
+    const __m256i scalemask_4567 = _mm256_setr_epi8(8, 9, 8, 9, 8, 9, 8, 9, 10, 11, 10, 11, 10, 11, 10, 11,
+                                                    12, 13, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15, 14, 15);
+
+    // The pairwise horizontal add of the dot products leaves the columns in the order 0 1 4 5 2 3 6 7
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    for (int64_t y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+            __m256 acc_rows[4];
+            for (int i = 0; i < 4; i++) {
+                acc_rows[i] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                __m256i iacc_0123[4];
+                __m256i iacc_4567[4];
+                for (int i = 0; i < 4; i++) {
+                    iacc_0123[i] = _mm256_setzero_si256();
+                    iacc_4567[i] = _mm256_setzero_si256();
+                }
+
+                // 8 quants of each of the four 32-quant groups of a half super block at a time
+                for (int k = 0; k < 8; k++) {
+                    const int half = k / 4;
+                    const int t    = k % 4;
+
+                    const uint8_t * ql_0 = b_ptr[b].ql + (half * 8 + t) * 64;
+                    const uint8_t * ql_1 = b_ptr[b].ql + (half * 8 + t + 4) * 64;
+                    const uint8_t * qh   = b_ptr[b].qh + (half * 4 + t) * 64;
+
+                    const __m256i ql_0_0123 = _mm256_loadu_si256((const __m256i *)(ql_0));
+                    const __m256i ql_0_4567 = _mm256_loadu_si256((const __m256i *)(ql_0 + 32));
+                    const __m256i ql_1_0123 = _mm256_loadu_si256((const __m256i *)(ql_1));
+                    const __m256i ql_1_4567 = _mm256_loadu_si256((const __m256i *)(ql_1 + 32));
+                    const __m256i qh_0123   = _mm256_loadu_si256((const __m256i *)(qh));
+                    const __m256i qh_4567   = _mm256_loadu_si256((const __m256i *)(qh + 32));
+
+                    // 6-bit quants offset to signed bytes
+                    __m256i rhs_vec_0123[4];
+                    __m256i rhs_vec_4567[4];
+                    rhs_vec_0123[0] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_0_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_0123, 4), m2h)), m32s);
+                    rhs_vec_4567[0] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_0_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_4567, 4), m2h)), m32s);
+                    rhs_vec_0123[1] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_1_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_0123, 2), m2h)), m32s);
+                    rhs_vec_4567[1] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(ql_1_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(qh_4567, 2), m2h)), m32s);
+                    rhs_vec_0123[2] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_0_0123, 4), m4b), _mm256_and_si256(qh_0123, m2h)), m32s);
+                    rhs_vec_4567[2] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_0_4567, 4), m4b), _mm256_and_si256(qh_4567, m2h)), m32s);
+                    rhs_vec_0123[3] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_1_0123, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(qh_0123, 2), m2h)), m32s);
+                    rhs_vec_4567[3] = _mm256_sub_epi8(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql_1_4567, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(qh_4567, 2), m2h)), m32s);
+
+                    for (int g = 0; g < 4; g++) {
+                        const int sb = half * 8 + g * 2 + t / 2;
+
+                        const __m256i scales = _mm256_broadcastsi128_si256(_mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8))));
+                        const __m256i scale_0123 = _mm256_shuffle_epi8(scales, scalemask_0123);
+                        const __m256i scale_4567 = _mm256_shuffle_epi8(scales, scalemask_4567);
+
+                        // the quants of the 4 rows are interleaved in groups of 8
+                        const __m256i lhs_mat = _mm256_loadu_si256((const __m256i *)(a_ptr[b].qs + half * 512 + g * 128 + t * 32));
+
+                        const __m256i rhs_abs_0123 = _mm256_sign_epi8(rhs_vec_0123[g], rhs_vec_0123[g]);
+                        const __m256i rhs_abs_4567 = _mm256_sign_epi8(rhs_vec_4567[g], rhs_vec_4567[g]);
+
+                        const __m256i lhs_vec[4] = {
+                            _mm256_permute4x64_epi64(lhs_mat, 0x00),
+                            _mm256_permute4x64_epi64(lhs_mat, 0x55),
+                            _mm256_permute4x64_epi64(lhs_mat, 0xAA),
+                            _mm256_permute4x64_epi64(lhs_mat, 0xFF),
+                        };
+
+                        for (int i = 0; i < 4; i++) {
+                            const __m256i dot_0123 = _mm256_maddubs_epi16(rhs_abs_0123, _mm256_sign_epi8(lhs_vec[i], rhs_vec_0123[g]));
+                            const __m256i dot_4567 = _mm256_maddubs_epi16(rhs_abs_4567, _mm256_sign_epi8(lhs_vec[i], rhs_vec_4567[g]));
+
+                            iacc_0123[i] = _mm256_add_epi32(iacc_0123[i], _mm256_madd_epi16(dot_0123, scale_0123));
+                            iacc_4567[i] = _mm256_add_epi32(iacc_4567[i], _mm256_madd_epi16(dot_4567, scale_4567));
+                        }
+                    }
+                }
+
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+
+                for (int i = 0; i < 4; i++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d[i]);
+                    const __m256i iacc = _mm256_hadd_epi32(iacc_0123[i], iacc_4567[i]);
+                    acc_rows[i] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[i]);
+                }
+            }
+
+            for (int i = 0; i < 4; i++) {
+                _mm256_storeu_ps(s + (y * 4 + i) * bs + x * 8, _mm256_permutevar8x32_ps(acc_rows[i], finalpermutemask));
+            }
+        }
+    }
+    return;
+#endif
+
+    ggml_gemm_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+// F16 and BF16 weights, interleaved in panels of 16 rows
+// the gemm goes through the rows in blocks of GEMM_F16_KBLOCK values: the part of a panel in the block stays in the L1
+// cache while all the rows of src1 use it, and the partial sums are accumulated in s
+
+#define GEMM_F16_KBLOCK 256
+
+#if defined(__AVX512F__)
+// NR rows of src1 times NP panels, on the values [k0, k1) of the rows
+template <int NR, int NP>
+static inline void gemm_f16_16x1_f32_tile(int n, int k0, int k1, float * GGML_RESTRICT s, size_t bs, const ggml_fp16_t * GGML_RESTRICT b_ptr, const float * GGML_RESTRICT a_ptr) {
+    __m512 acc[NR][NP];
+
+    for (int m = 0; m < NR; m++) {
+        for (int p = 0; p < NP; p++) {
+            acc[m][p] = k0 == 0 ? _mm512_setzero_ps() : _mm512_loadu_ps(s + m * bs + p * 16);
+        }
+    }
+
+    for (int l = k0; l < k1; l++) {
+        __m512 b[NP];
+        for (int p = 0; p < NP; p++) {
+            b[p] = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b_ptr + (size_t) p * n * 16 + l * 16)));
+        }
+        for (int m = 0; m < NR; m++) {
+            const __m512 a = _mm512_set1_ps(a_ptr[m * n + l]);
+            for (int p = 0; p < NP; p++) {
+                acc[m][p] = _mm512_fmadd_ps(b[p], a, acc[m][p]);
+            }
+        }
+    }
+
+    for (int m = 0; m < NR; m++) {
+        for (int p = 0; p < NP; p++) {
+            _mm512_storeu_ps(s + m * bs + p * 16, acc[m][p]);
+        }
+    }
+}
+#elif defined(__AVX2__) && defined(__F16C__)
+// 4 rows of src1 times one panel, the lower and upper 8 rows of the panel are in separate registers
+static inline void gemm_f16_16x1_f32_tile(int n, int k0, int k1, float * GGML_RESTRICT s, size_t bs, const ggml_fp16_t * GGML_RESTRICT b_ptr, const float * GGML_RESTRICT a_ptr) {
+    __m256 acc[4][2];
+
+    for (int m = 0; m < 4; m++) {
+        for (int h = 0; h < 2; h++) {
+            acc[m][h] = k0 == 0 ? _mm256_setzero_ps() : _mm256_loadu_ps(s + m * bs + h * 8);
+        }
+    }
+
+    for (int l = k0; l < k1; l++) {
+        const __m256 b_lo = GGML_F32Cx8_LOAD(b_ptr + l * 16);
+        const __m256 b_hi = GGML_F32Cx8_LOAD(b_ptr + l * 16 + 8);
+        for (int m = 0; m < 4; m++) {
+            const __m256 a = _mm256_set1_ps(a_ptr[m * n + l]);
+            acc[m][0] = _mm256_fmadd_ps(b_lo, a, acc[m][0]);
+            acc[m][1] = _mm256_fmadd_ps(b_hi, a, acc[m][1]);
+        }
+    }
+
+    for (int m = 0; m < 4; m++) {
+        for (int h = 0; h < 2; h++) {
+            _mm256_storeu_ps(s + m * bs + h * 8, acc[m][h]);
+        }
+    }
+}
+#endif
+
+#if defined(__AVX512BF16__)
+// NR rows of src1 times NP panels, on the values [k0, k1) of the rows, two values at a time
+template <int NR, int NP>
+static inline void gemm_bf16_16x2_bf16_tile(int n, int k0, int k1, float * GGML_RESTRICT s, size_t bs, const ggml_bf16_t * GGML_RESTRICT b_ptr, const ggml_bf16_t * GGML_RESTRICT a_ptr) {
+    __m512 acc[NR][NP];
+
+    for (int m = 0; m < NR; m++) {
+        for (int p = 0; p < NP; p++) {
+            acc[m][p] = k0 == 0 ? _mm512_setzero_ps() : _mm512_loadu_ps(s + m * bs + p * 16);
+        }
+    }
+
+    for (int l = k0; l < k1; l += 2) {
+        __m512bh b[NP];
+        for (int p = 0; p < NP; p++) {
+            b[p] = (__m512bh) _mm512_loadu_si512((const __m512i *)(b_ptr + (size_t) p * n * 16 + l * 16));
+        }
+        for (int m = 0; m < NR; m++) {
+            int32_t a_pair;
+            memcpy(&a_pair, a_ptr + m * n + l, sizeof(int32_t));
+            const __m512bh a = (__m512bh) _mm512_set1_epi32(a_pair);
+            for (int p = 0; p < NP; p++) {
+                acc[m][p] = _mm512_dpbf16_ps(acc[m][p], b[p], a);
+            }
+        }
+    }
+
+    for (int m = 0; m < NR; m++) {
+        for (int p = 0; p < NP; p++) {
+            _mm512_storeu_ps(s + m * bs + p * 16, acc[m][p]);
+        }
+    }
+}
+#elif defined(__AVX2__)
+// a BF16 value is the upper half of the F32 value, the even and odd values of the pairs are extracted with a shift and a mask
+static inline void bf16_pairs_to_fp32(const __m256i v, __m256 & even, __m256 & odd) {
+    even = _mm256_castsi256_ps(_mm256_slli_epi32(v, 16));
+    odd  = _mm256_castsi256_ps(_mm256_and_si256(v, _mm256_set1_epi32((int32_t) 0xffff0000)));
+}
+
+// 4 rows of src1 times one panel, the lower and upper 8 rows of the panel are in separate registers
+static inline void gemm_bf16_16x2_bf16_tile(int n, int k0, int k1, float * GGML_RESTRICT s, size_t bs, const ggml_bf16_t * GGML_RESTRICT b_ptr, const ggml_bf16_t * GGML_RESTRICT a_ptr) {
+    __m256 acc[4][2];
+
+    for (int m = 0; m < 4; m++) {
+        for (int h = 0; h < 2; h++) {
+            acc[m][h] = k0 == 0 ? _mm256_setzero_ps() : _mm256_loadu_ps(s + m * bs + h * 8);
+        }
+    }
+
+    for (int l = k0; l < k1; l += 2) {
+        __m256 b_even[2];
+        __m256 b_odd[2];
+        for (int h = 0; h < 2; h++) {
+            bf16_pairs_to_fp32(_mm256_loadu_si256((const __m256i *)(b_ptr + l * 16 + h * 16)), b_even[h], b_odd[h]);
+        }
+        for (int m = 0; m < 4; m++) {
+            const __m256 a_even = _mm256_set1_ps(GGML_BF16_TO_FP32(a_ptr[m * n + l]));
+            const __m256 a_odd  = _mm256_set1_ps(GGML_BF16_TO_FP32(a_ptr[m * n + l + 1]));
+            for (int h = 0; h < 2; h++) {
+                acc[m][h] = _mm256_fmadd_ps(b_even[h], a_even, acc[m][h]);
+                acc[m][h] = _mm256_fmadd_ps(b_odd[h],  a_odd,  acc[m][h]);
+            }
+        }
+    }
+
+    for (int m = 0; m < 4; m++) {
+        for (int h = 0; h < 2; h++) {
+            _mm256_storeu_ps(s + m * bs + h * 8, acc[m][h]);
+        }
+    }
+}
+#endif
+
+void ggml_gemv_f16_16x1_f32(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int ncols_interleaved = 16;
+
+    assert (nr == 1);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(ncols_interleaved);
+
+#if defined(__AVX512F__)
+    const float * a_ptr = (const float *) vy;
+
+    for (int x = 0; x < nc / 16; x++) {
+        const ggml_fp16_t * b_ptr = (const ggml_fp16_t *) vx + (size_t) x * n * 16;
+
+        __m512 acc[4] = { _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps() };
+
+        int l = 0;
+        for (; l + 4 <= n; l += 4) {
+            for (int i = 0; i < 4; i++) {
+                const __m512 b = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b_ptr + (l + i) * 16)));
+                acc[i] = _mm512_fmadd_ps(b, _mm512_set1_ps(a_ptr[l + i]), acc[i]);
+            }
+        }
+        for (; l < n; l++) {
+            const __m512 b = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b_ptr + l * 16)));
+            acc[0] = _mm512_fmadd_ps(b, _mm512_set1_ps(a_ptr[l]), acc[0]);
+        }
+
+        _mm512_storeu_ps(s + x * 16, _mm512_add_ps(_mm512_add_ps(acc[0], acc[1]), _mm512_add_ps(acc[2], acc[3])));
+    }
+    return;
+#elif defined(__AVX2__) && defined(__F16C__)
+    const float * a_ptr = (const float *) vy;
+
+    for (int x = 0; x < nc / 16; x++) {
+        const ggml_fp16_t * b_ptr = (const ggml_fp16_t *) vx + (size_t) x * n * 16;
+
+        __m256 acc[2][2] = { { _mm256_setzero_ps(), _mm256_setzero_ps() }, { _mm256_setzero_ps(), _mm256_setzero_ps() } };
+
+        int l = 0;
+        for (; l + 2 <= n; l += 2) {
+            for (int i = 0; i < 2; i++) {
+                const __m256 a = _mm256_set1_ps(a_ptr[l + i]);
+                acc[i][0] = _mm256_fmadd_ps(GGML_F32Cx8_LOAD(b_ptr + (l + i) * 16),     a, acc[i][0]);
+                acc[i][1] = _mm256_fmadd_ps(GGML_F32Cx8_LOAD(b_ptr + (l + i) * 16 + 8), a, acc[i][1]);
+            }
+        }
+        for (; l < n; l++) {
+            const __m256 a = _mm256_set1_ps(a_ptr[l]);
+            acc[0][0] = _mm256_fmadd_ps(GGML_F32Cx8_LOAD(b_ptr + l * 16),     a, acc[0][0]);
+            acc[0][1] = _mm256_fmadd_ps(GGML_F32Cx8_LOAD(b_ptr + l * 16 + 8), a, acc[0][1]);
+        }
+
+        _mm256_storeu_ps(s + x * 16,     _mm256_add_ps(acc[0][0], acc[1][0]));
+        _mm256_storeu_ps(s + x * 16 + 8, _mm256_add_ps(acc[0][1], acc[1][1]));
+    }
+    return;
+#endif
+
+    ggml_gemv_f16_16x1_f32_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_bf16_16x2_bf16(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int ncols_interleaved = 16;
+    const int blocklen = 2;
+
+    assert (nr == 1);
+    assert (n % blocklen == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX512BF16__)
+    const ggml_bf16_t * a_ptr = (const ggml_bf16_t *) vy;
+
+    for (int x = 0; x < nc / 16; x++) {
+        const ggml_bf16_t * b_ptr = (const ggml_bf16_t *) vx + (size_t) x * n * 16;
+
+        __m512 acc[4] = { _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps() };
+
+        int l = 0;
+        for (; l + 8 <= n; l += 8) {
+            for (int i = 0; i < 4; i++) {
+                int32_t a_pair;
+                memcpy(&a_pair, a_ptr + l + i * 2, sizeof(int32_t));
+                const __m512bh b = (__m512bh) _mm512_loadu_si512((const __m512i *)(b_ptr + (l + i * 2) * 16));
+                acc[i] = _mm512_dpbf16_ps(acc[i], b, (__m512bh) _mm512_set1_epi32(a_pair));
+            }
+        }
+        for (; l < n; l += 2) {
+            int32_t a_pair;
+            memcpy(&a_pair, a_ptr + l, sizeof(int32_t));
+            const __m512bh b = (__m512bh) _mm512_loadu_si512((const __m512i *)(b_ptr + l * 16));
+            acc[0] = _mm512_dpbf16_ps(acc[0], b, (__m512bh) _mm512_set1_epi32(a_pair));
+        }
+
+        _mm512_storeu_ps(s + x * 16, _mm512_add_ps(_mm512_add_ps(acc[0], acc[1]), _mm512_add_ps(acc[2], acc[3])));
+    }
+    return;
+#elif defined(__AVX2__)
+    const ggml_bf16_t * a_ptr = (const ggml_bf16_t *) vy;
+
+    for (int x = 0; x < nc / 16; x++) {
+        const ggml_bf16_t * b_ptr = (const ggml_bf16_t *) vx + (size_t) x * n * 16;
+
+        __m256 acc[2][2] = { { _mm256_setzero_ps(), _mm256_setzero_ps() }, { _mm256_setzero_ps(), _mm256_setzero_ps() } };
+
+        for (int l = 0; l < n; l += 2) {
+            const __m256 a_even = _mm256_set1_ps(GGML_BF16_TO_FP32(a_ptr[l]));
+            const __m256 a_odd  = _mm256_set1_ps(GGML_BF16_TO_FP32(a_ptr[l + 1]));
+            for (int h = 0; h < 2; h++) {
+                __m256 b_even;
+                __m256 b_odd;
+                bf16_pairs_to_fp32(_mm256_loadu_si256((const __m256i *)(b_ptr + l * 16 + h * 16)), b_even, b_odd);
+                acc[0][h] = _mm256_fmadd_ps(b_even, a_even, acc[0][h]);
+                acc[1][h] = _mm256_fmadd_ps(b_odd,  a_odd,  acc[1][h]);
+            }
+        }
+
+        _mm256_storeu_ps(s + x * 16,     _mm256_add_ps(acc[0][0], acc[1][0]));
+        _mm256_storeu_ps(s + x * 16 + 8, _mm256_add_ps(acc[0][1], acc[1][1]));
+    }
+    return;
+#endif
+
+    ggml_gemv_bf16_16x2_bf16_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_f16_16x1_f32(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int ncols_interleaved = 16;
+
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(ncols_interleaved);
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__F16C__))
+    const ggml_fp16_t * b_ptr = (const ggml_fp16_t *) vx;
+    const float       * a_ptr = (const float *) vy;
+
+    for (int k0 = 0; k0 < n; k0 += GEMM_F16_KBLOCK) {
+        const int k1 = MIN(n, k0 + GEMM_F16_KBLOCK);
+
+        for (int x = 0; x < nc / 16; ) {
+#if defined(__AVX512F__)
+            // two panels and 8 rows of src1 at a time
+            if (x + 2 <= nc / 16) {
+                int y = 0;
+                for (; y + 2 <= nr / 4; y += 2) {
+                    gemm_f16_16x1_f32_tile<8, 2>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+                }
+                for (; y < nr / 4; y++) {
+                    gemm_f16_16x1_f32_tile<4, 2>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+                }
+                x += 2;
+                continue;
+            }
+            for (int y = 0; y < nr / 4; y++) {
+                gemm_f16_16x1_f32_tile<4, 1>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+            }
+#else
+            for (int y = 0; y < nr / 4; y++) {
+                gemm_f16_16x1_f32_tile(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+            }
+#endif
+            x += 1;
+        }
+    }
+    return;
+#endif
+
+    ggml_gemm_f16_16x1_f32_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_bf16_16x2_bf16(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int ncols_interleaved = 16;
+    const int blocklen = 2;
+
+    assert (n % blocklen == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX512BF16__) || defined(__AVX2__)
+    const ggml_bf16_t * b_ptr = (const ggml_bf16_t *) vx;
+    const ggml_bf16_t * a_ptr = (const ggml_bf16_t *) vy;
+
+    for (int k0 = 0; k0 < n; k0 += GEMM_F16_KBLOCK) {
+        const int k1 = MIN(n, k0 + GEMM_F16_KBLOCK);
+
+        for (int x = 0; x < nc / 16; ) {
+#if defined(__AVX512BF16__)
+            // two panels and 8 rows of src1 at a time
+            if (x + 2 <= nc / 16) {
+                int y = 0;
+                for (; y + 2 <= nr / 4; y += 2) {
+                    gemm_bf16_16x2_bf16_tile<8, 2>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+                }
+                for (; y < nr / 4; y++) {
+                    gemm_bf16_16x2_bf16_tile<4, 2>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+                }
+                x += 2;
+                continue;
+            }
+            for (int y = 0; y < nr / 4; y++) {
+                gemm_bf16_16x2_bf16_tile<4, 1>(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+            }
+#else
+            for (int y = 0; y < nr / 4; y++) {
+                gemm_bf16_16x2_bf16_tile(n, k0, k1, s + y * 4 * bs + x * 16, bs, b_ptr + (size_t) x * n * 16, a_ptr + (size_t) y * 4 * n);
+            }
+#endif
+            x += 1;
+        }
+    }
+    return;
+#endif
+
+    ggml_gemm_bf16_16x2_bf16_generic(n, s, bs, vx, vy, nr, nc);
+}
@@ -0,0 +1,210 @@
+#include "autotune.h"
+
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+#include "ggml-impl.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// the number of src1 rows is rounded up to a power of 2, so that a few benchmarks cover all the batch sizes
+struct ggml_cpu_autotune_mul_mat_key {
+    int     type;
+    int64_t ne00;
+    int64_t nr0;
+    int64_t nr1;
+    int     nth;
+
+    bool operator<(const ggml_cpu_autotune_mul_mat_key & other) const {
+        return std::tie(type, ne00, nr0, nr1, nth) < std::tie(other.type, other.ne00, other.nr0, other.nr1, other.nth);
+    }
+};
+
+struct ggml_cpu_autotune_cache {
+    std::mutex mutex;
+
+    bool loaded = false;
+
+    std::string path; // empty if the results are not persisted
+    std::string cpu;  // description of the CPU the results are for
+
+    // the file has one section per CPU model, the sections of the other CPUs are kept as they are
+    std::vector<std::string> other_cpus;
+
+    std::map<ggml_cpu_autotune_mul_mat_key, int> mul_mat;
+};
+
+static bool g_autotune_enabled = false;
+
+static ggml_cpu_autotune_cache & ggml_cpu_autotune_get_cache() {
+    static ggml_cpu_autotune_cache cache;
+    return cache;
+}
+
+static int64_t ggml_cpu_autotune_bucket(int64_t n) {
+    int64_t b = 1;
+    while (b < n) {
+        b *= 2;
+    }
+    return b;
+}
+
+// only the chunk sizes that are benchmarked are accepted from the file, anything else would break the chunking
+static bool ggml_cpu_autotune_mul_mat_valid(int chunk_size) {
+    static const int chunk_sizes[] = GGML_CPU_AUTOTUNE_MUL_MAT_CHUNK_SIZES;
+    for (int cs : chunk_sizes) {
+        if (cs == chunk_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string ggml_cpu_autotune_header(const ggml_cpu_autotune_cache & cache) {
+    return "cpu " + cache.cpu;
+}
+
+// must be called with the mutex held
+static void ggml_cpu_autotune_load(ggml_cpu_autotune_cache & cache) {
+    if (cache.loaded) {
+        return;
+    }
+    cache.loaded = true;
+
+    ggml_backend_dev_t dev = ggml_backend_reg_dev_get(ggml_backend_cpu_reg(), 0);
+    cache.cpu = dev ? ggml_backend_dev_description(dev) : "CPU";
+
+    const char * path = getenv("GGML_CPU_AUTOTUNE_CACHE");
+    if (path == nullptr || path[0] == '\0') {
+        return;
+    }
+    cache.path = path;
+
+    std::ifstream file(cache.path);
+    if (!file) {
+        return;
+    }
+
+    const std::string header = ggml_cpu_autotune_header(cache);
+
+    bool this_cpu = false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("cpu ", 0) == 0) {
+            this_cpu = line == header;
+        }
+        if (!this_cpu) {
+            cache.other_cpus.push_back(line);
+            continue;
+        }
+
+        std::istringstream ss(line);
+
+        std::string op;
+        ss >> op;
+
+        if (op == "mul_mat") {
+            ggml_cpu_autotune_mul_mat_key key;
+            int chunk_size;
+            if (ss >> key.type >> key.ne00 >> key.nr0 >> key.nr1 >> key.nth >> chunk_size && ggml_cpu_autotune_mul_mat_valid(chunk_size)) {
+                cache.mul_mat[key] = chunk_size;
+            }
+        }
+    }
+
+    GGML_LOG_INFO("%s: loaded %zu tuned kernels from %s\n", __func__, cache.mul_mat.size(), cache.path.c_str());
+}
+
+static void ggml_cpu_autotune_write_mul_mat(FILE * file, const ggml_cpu_autotune_mul_mat_key & key, int chunk_size) {
+    fprintf(file, "mul_mat %d %" PRId64 " %" PRId64 " %" PRId64 " %d %d\n", key.type, key.ne00, key.nr0, key.nr1, key.nth, chunk_size);
+}
+
+// must be called with the mutex held
+// the file is written to a temporary file and renamed, so that a concurrent reader never sees a partial file
+static void ggml_cpu_autotune_save(const ggml_cpu_autotune_cache & cache) {
+    if (cache.path.empty()) {
+        return;
+    }
+
+    const std::string path_tmp = cache.path + ".tmp";
+
+    FILE * file = fopen(path_tmp.c_str(), "w");
+    if (file == nullptr) {
+        GGML_LOG_WARN("%s: failed to open %s: %s\n", __func__, path_tmp.c_str(), strerror(errno));
+        return;
+    }
+
+    for (const auto & line : cache.other_cpus) {
+        fprintf(file, "%s\n", line.c_str());
+    }
+
+    fprintf(file, "%s\n", ggml_cpu_autotune_header(cache).c_str());
+    for (const auto & [key, chunk_size] : cache.mul_mat) {
+        ggml_cpu_autotune_write_mul_mat(file, key, chunk_size);
+    }
+
+    if (fclose(file) != 0 || rename(path_tmp.c_str(), cache.path.c_str()) != 0) {
+        GGML_LOG_WARN("%s: failed to write %s: %s\n", __func__, cache.path.c_str(), strerror(errno));
+        remove(path_tmp.c_str());
+    }
+}
+
+void ggml_cpu_autotune_init(void) {
+    const char * autotune = getenv("GGML_CPU_AUTOTUNE");
+    const char * path     = getenv("GGML_CPU_AUTOTUNE_CACHE");
+
+    g_autotune_enabled = (autotune != nullptr && strcmp(autotune, "0") != 0) || (path != nullptr && path[0] != '\0');
+}
+
+bool ggml_cpu_autotune_enabled(void) {
+    return g_autotune_enabled;
+}
+
+int ggml_cpu_autotune_mul_mat_get(enum ggml_type type, int64_t ne00, int64_t nr0, int64_t nr1, int nth) {
+    const ggml_cpu_autotune_mul_mat_key key = { type, ne00, nr0, ggml_cpu_autotune_bucket(nr1), nth };
+
+    // a tuned result never changes, so each thread keeps a copy and only takes the mutex for the shapes it has not seen
+    static thread_local std::map<ggml_cpu_autotune_mul_mat_key, int> tuned;
+
+    const auto it_tuned = tuned.find(key);
+    if (it_tuned != tuned.end()) {
+        return it_tuned->second;
+    }
+
+    auto & cache = ggml_cpu_autotune_get_cache();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    ggml_cpu_autotune_load(cache);
+
+    const auto it = cache.mul_mat.find(key);
+    if (it == cache.mul_mat.end()) {
+        return GGML_CPU_AUTOTUNE_PENDING;
+    }
+
+    tuned[key] = it->second;
+
+    return it->second;
+}
+
+void ggml_cpu_autotune_mul_mat_set(enum ggml_type type, int64_t ne00, int64_t nr0, int64_t nr1, int nth, int chunk_size) {
+    auto & cache = ggml_cpu_autotune_get_cache();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    ggml_cpu_autotune_load(cache);
+
+    const ggml_cpu_autotune_mul_mat_key key = { type, ne00, nr0, ggml_cpu_autotune_bucket(nr1), nth };
+
+    cache.mul_mat[key] = chunk_size;
+    ggml_cpu_autotune_save(cache);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ggml.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// GGML CPU internal header
+
+// Autotuning of the CPU kernels, enabled with GGML_CPU_AUTOTUNE=1
+// The candidates are benchmarked on the first use of each key and the fastest one is used afterwards.
+// With GGML_CPU_AUTOTUNE_CACHE=<path>, the results are persisted to a file and reused by the next runs on the same CPU model.
+// The file can be shared by several CPU models, each one has its own section.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of times each candidate is run, the fastest run is kept
+#define GGML_CPU_AUTOTUNE_N_RUNS 3
+
+// mul_mat chunk sizes to try, 0 is one chunk per thread
+#define GGML_CPU_AUTOTUNE_MUL_MAT_CHUNK_SIZES { 0, 16, 32, 64, 128 }
+
+// returned when there is no result yet and the candidates should be benchmarked
+#define GGML_CPU_AUTOTUNE_PENDING -1
+
+void ggml_cpu_autotune_init(void);
+bool ggml_cpu_autotune_enabled(void);
+
+// chunk size of a mul_mat, or GGML_CPU_AUTOTUNE_PENDING
+int  ggml_cpu_autotune_mul_mat_get(enum ggml_type type, int64_t ne00, int64_t nr0, int64_t nr1, int nth);
+void ggml_cpu_autotune_mul_mat_set(enum ggml_type type, int64_t ne00, int64_t nr0, int64_t nr1, int nth, int chunk_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,6 +4,7 @@
 #include "ggml-backend-impl.h"
 #include "ggml-backend.h"
 #include "traits.h"
+#include "autotune.h"
 #include "ggml-cpu-impl.h"
 #include "ggml-cpu.h"
 #include "ggml-impl.h"
@@ -453,6 +454,11 @@ struct ggml_threadpool {
     atomic_int GGML_CACHE_ALIGN n_barrier;
     atomic_int GGML_CACHE_ALIGN n_barrier_passed;
     atomic_int GGML_CACHE_ALIGN current_chunk; // currently processing chunk during Mat_Mul, shared between all the threads.
+    int mul_mat_chunk_size;                    // chunk size of the current Mat_Mul, chosen by the first thread.
+
+    size_t src1_cache_size;                    // size of the mul_mat src1 cache at the end of the work buffer
+    const struct ggml_tensor * src1_cached;    // src1 converted in the cache, set by the first thread.
+    enum ggml_type src1_cached_type;           // type src1 was converted to in the cache.
 
     // these are atomic as an annotation for thread-sanitizer
     atomic_bool stop;         // Used for stopping the threadpool altogether
@@ -682,6 +688,115 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+// with the partition strategy, the threads are split in contiguous groups, one per node,
+// and the rows of each matrix in contiguous slabs, one per node
+// the threads of a node multiply the rows of the slab of the node, which are moved to the node memory
+
+static bool ggml_numa_is_partition(void) {
+    return ggml_is_numa() && g_state.numa.numa_strategy == GGML_NUMA_STRATEGY_PARTITION;
+}
+
+static int ggml_numa_thread_node(int ith, int nth) {
+    return (int) ((int64_t) ith * g_state.numa.n_nodes / nth);
+}
+
+static void ggml_numa_node_rows(int node, int64_t nr, int64_t * ir0, int64_t * ir1) {
+    *ir0 = nr * node       / g_state.numa.n_nodes;
+    *ir1 = nr * (node + 1) / g_state.numa.n_nodes;
+}
+
+// rows of the slab of the node of thread ith that are computed by the thread
+static void ggml_numa_thread_rows(int ith, int nth, int64_t nr, int64_t * ir0, int64_t * ir1) {
+    const int64_t n_nodes = g_state.numa.n_nodes;
+    const int     node    = ggml_numa_thread_node(ith, nth);
+
+    // first and last + 1 threads of the node
+    const int64_t it0 = (node       * (int64_t) nth + n_nodes - 1) / n_nodes;
+    const int64_t it1 = ((node + 1) * (int64_t) nth + n_nodes - 1) / n_nodes;
+
+    int64_t node_ir0;
+    int64_t node_ir1;
+    ggml_numa_node_rows(node, nr, &node_ir0, &node_ir1);
+
+    *ir0 = node_ir0 + (node_ir1 - node_ir0) * (ith - it0)     / (it1 - it0);
+    *ir1 = node_ir0 + (node_ir1 - node_ir0) * (ith - it0 + 1) / (it1 - it0);
+}
+
+#if defined(__gnu_linux__)
+#include <sys/syscall.h>
+
+#define GGML_NUMA_MPOL_MF_MOVE (1 << 1)
+#define GGML_NUMA_MOVE_PAGES_BATCH 1024
+
+// only the rows of the 2D matrices are split by node in mul_mat, so the tensors that are never multiplied that way are
+// left where they are:
+//  - the stacked matrices of the experts, that mul_mat_id splits in its own tiles
+//  - the tensors of the extra buffer types (repacked weights), that are not in host buffers
+// the llamafile sgemm path, used for the prompt batches of some types, also splits the rows without regard to the nodes,
+// the node-local rows are used by the token generation batches, that are the ones limited by the memory bandwidth
+void ggml_numa_partition_tensor(const struct ggml_tensor * tensor) {
+    if (!ggml_numa_is_partition() || tensor->data == NULL || !ggml_is_contiguous(tensor)) {
+        return;
+    }
+
+    if (tensor->ne[2] != 1 || tensor->ne[3] != 1) {
+        return;
+    }
+
+    if (tensor->buffer != NULL && !ggml_backend_buffer_is_host(tensor->buffer)) {
+        return;
+    }
+
+    const int64_t nr = tensor->ne[1];
+    if (nr < (int64_t) g_state.numa.n_nodes) {
+        return;
+    }
+
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    // pages that start in the tensor, a page that starts in the previous tensor stays where it is
+    const uintptr_t data  = (uintptr_t) tensor->data;
+    const uintptr_t begin = (data + page_size - 1) & ~(page_size - 1);
+    const uintptr_t end   = data + ggml_nbytes(tensor);
+
+    void * pages [GGML_NUMA_MOVE_PAGES_BATCH];
+    int    nodes [GGML_NUMA_MOVE_PAGES_BATCH];
+    int    status[GGML_NUMA_MOVE_PAGES_BATCH];
+
+    for (uintptr_t p = begin; p < end; ) {
+        int n = 0;
+        for (; n < GGML_NUMA_MOVE_PAGES_BATCH && p < end; ++n, p += page_size) {
+            // node of the slab of the first row in the page
+            const int64_t ir = (p - data) / tensor->nb[1];
+
+            int node = 0;
+            for (int k = 0; k < (int) g_state.numa.n_nodes; ++k) {
+                int64_t ir0;
+                int64_t ir1;
+                ggml_numa_node_rows(k, nr, &ir0, &ir1);
+                if (ir >= ir0 && ir < ir1) {
+                    node = k;
+                }
+            }
+
+            pages[n] = (void *) p;
+            nodes[n] = node;
+        }
+
+        // pages that are not in memory yet have a negative status and are placed on the first touch instead
+        // this is the case for memory mapped files, that are then read first by the threads of the node
+        if (syscall(SYS_move_pages, 0, (unsigned long) n, pages, nodes, status, GGML_NUMA_MPOL_MF_MOVE) < 0) {
+            GGML_LOG_WARN("%s: move_pages() failed for tensor %s: %s\n", __func__, tensor->name, strerror(errno));
+            return;
+        }
+    }
+}
+#else
+void ggml_numa_partition_tensor(const struct ggml_tensor * tensor) {
+    UNUSED(tensor);
+}
+#endif
+
 #if defined(__ARM_ARCH)
 
 #if defined(__linux__) && defined(__aarch64__)
@@ -1207,6 +1322,184 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     }
 }
 
+// the src1 of a mul_mat that is also used by other nodes is converted to vec_dot_type in the src1 cache, at the end of
+// the work buffer after the params->wsize bytes given to the ops, so that the next mul_mats with the same src1 (e.g. the Q, K and V
+// projections) use it without converting it again
+// returns the size needed in the cache, 0 if the node does not use it
+static size_t ggml_mul_mat_src1_cache_size(const struct ggml_cgraph * cgraph, const struct ggml_tensor * node) {
+    const struct ggml_tensor * src1 = node->src[1];
+
+    if (node->op != GGML_OP_MUL_MAT || src1->type == type_traits_cpu[node->src[0]->type].vec_dot_type) {
+        return 0;
+    }
+
+    const struct ggml_hash_set * hash_set = &cgraph->visited_hash_set;
+
+    const size_t pos = ggml_hash_find(hash_set, src1);
+    if (pos == GGML_HASHSET_FULL || !ggml_bitset_get(hash_set->used, pos) || hash_set->keys[pos] != src1 ||
+        cgraph->use_counts[pos] < 2) {
+        return 0;
+    }
+
+    return ggml_row_size(type_traits_cpu[node->src[0]->type].vec_dot_type, ggml_nelements(src1));
+}
+
+static size_t ggml_graph_src1_cache_size(const struct ggml_cgraph * cgraph, int n_threads) {
+    size_t size = 0;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        size_t cur = 0;
+        if (node->op == GGML_OP_MUL_MAT && !ggml_cpu_extra_work_size(n_threads, node, &cur)) {
+            size = MAX(size, ggml_mul_mat_src1_cache_size(cgraph, node));
+        }
+    }
+
+    return size;
+}
+
+// chunk size of the rows of the result of a mul_mat, 0 for one chunk per thread
+static int ggml_mul_mat_default_chunk_size(int64_t nr0, int64_t nr1, int nth) {
+    // Now select a reasonable chunk size.
+    int chunk_size = 16;
+
+    // We need to step up the size if it's small
+    if (nr0 == 1 || nr1 == 1) {
+        chunk_size = 64;
+    }
+
+    // distribute the work across the inner or outer loop based on which one is larger
+    // The number of chunks in the 0/1 dim.
+    // CEIL(nr0/chunk_size)
+    const int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+    const int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+
+    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
+    //   Also, chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggml-org/llama.cpp/pull/6915
+    //   In theory, chunking should be just as useful on NUMA and non NUMA systems, but testing disagreed with that.
+    if (nchunk0 * nchunk1 < nth * 4 || ggml_is_numa()) {
+        return 0;
+    }
+
+    return chunk_size;
+}
+
+static void ggml_compute_forward_mul_mat_chunks(
+        const struct ggml_compute_params * params,
+              struct ggml_tensor * dst,
+        int chunk_size) {
+
+    const struct ggml_tensor * src0 = dst->src[0];
+    const struct ggml_tensor * src1 = dst->src[1];
+
+    GGML_TENSOR_BINARY_OP_LOCALS
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
+
+    const int64_t nr0 = ne0;
+    const int64_t nr1 = ne1 * ne2 * ne3;
+
+    int64_t nchunk0;
+    int64_t nchunk1;
+
+    if (chunk_size == 0) {
+        // distribute the thread work across the inner or outer loop based on which one is larger
+        nchunk0 = nr0 > nr1 ? nth : 1; // parallelize by src0 rows
+        nchunk1 = nr0 > nr1 ? 1 : nth; // parallelize by src1 rows
+    } else {
+        nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+        nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+    }
+
+    // The number of elements in each chunk
+    const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
+    const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
+
+    // with the NUMA partition strategy, each thread computes rows of src0 that are in the memory of its node
+    const bool numa_rows = nchunk0 == nth && nchunk1 == 1 && ggml_numa_is_partition() && nth >= (int) g_state.numa.n_nodes;
+
+    // The first chunk comes from our thread_id, the rest will get auto-assigned.
+    int current_chunk = ith;
+
+    while (current_chunk < nchunk0 * nchunk1) {
+        const int64_t ith0 = current_chunk % nchunk0;
+        const int64_t ith1 = current_chunk / nchunk0;
+
+        int64_t ir0_start = dr0 * ith0;
+        int64_t ir0_end = MIN(ir0_start + dr0, nr0);
+
+        if (numa_rows) {
+            ggml_numa_thread_rows(ith, nth, nr0, &ir0_start, &ir0_end);
+        }
+
+        const int64_t ir1_start = dr1 * ith1;
+        const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+
+        // dot kernels can handle 1 row and col at a time, but mmla kernels can process 2 rows and cols
+        int64_t num_rows_per_vec_dot = vec_dot_num_rows;
+
+        // these checks are needed to avoid crossing dim1 boundaries
+        // can be optimized, but the logic would become more complicated, so keeping it like this for simplicity
+        if ((nr0 % 2 != 0) || (ne11 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || ((ir1_end - ir1_start) % 2 != 0)) {
+            num_rows_per_vec_dot = 1;
+        }
+        ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, ir1_start, ir1_end);
+
+        if (nth >= nchunk0 * nchunk1) {
+            break;
+        }
+
+        current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
+    }
+}
+
+// benchmark the chunk sizes of a mul_mat and keep the fastest one
+// each run computes the whole result, so the last one leaves it in dst
+static void ggml_compute_forward_mul_mat_tune(
+        const struct ggml_compute_params * params,
+              struct ggml_tensor * dst,
+        int64_t nr0,
+        int64_t nr1) {
+
+    static const int chunk_sizes[] = GGML_CPU_AUTOTUNE_MUL_MAT_CHUNK_SIZES;
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    int64_t t_best = INT64_MAX;
+    int     best   = 0;
+
+    for (size_t i = 0; i < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); ++i) {
+        for (int run = 0; run < GGML_CPU_AUTOTUNE_N_RUNS; ++run) {
+            if (ith == 0) {
+                atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
+            }
+
+            ggml_barrier(params->threadpool);
+
+            const int64_t t_start = ggml_time_us();
+
+            ggml_compute_forward_mul_mat_chunks(params, dst, chunk_sizes[i]);
+
+            ggml_barrier(params->threadpool);
+
+            const int64_t t = ggml_time_us() - t_start;
+            if (t < t_best) {
+                t_best = t;
+                best   = chunk_sizes[i];
+            }
+        }
+    }
+
+    if (ith == 0) {
+        ggml_cpu_autotune_mul_mat_set(dst->src[0]->type, dst->src[0]->ne[0], nr0, nr1, nth, best);
+    }
+}
+
 void ggml_compute_forward_mul_mat(
         const struct ggml_compute_params * params,
               struct ggml_tensor * dst) {
@@ -1221,7 +1514,6 @@ void ggml_compute_forward_mul_mat(
 
     enum ggml_type           const vec_dot_type         = type_traits_cpu[src0->type].vec_dot_type;
     ggml_from_float_t        const from_float           = type_traits_cpu[vec_dot_type].from_float;
-    int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
 
     GGML_ASSERT(ne0 == ne01);
     GGML_ASSERT(ne1 == ne11);
@@ -1269,7 +1561,25 @@ void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
+    bool convert_src1 = src1->type != vec_dot_type;
+
+    // use the src1 cache, and skip the conversion if src1 is already in it
+    struct ggml_compute_params params_cache;
+
+    const size_t src1_cache_size = ggml_mul_mat_src1_cache_size(params->threadpool->cgraph, dst);
+    const bool   src1_cache      = src1_cache_size > 0 && src1_cache_size <= params->threadpool->src1_cache_size;
+
+    if (src1_cache) {
+        params_cache       = *params;
+        params_cache.wdata = (char *) params->wdata + params->wsize;
+        params_cache.wsize = params->threadpool->src1_cache_size;
+
+        convert_src1 = params->threadpool->src1_cached != src1 || params->threadpool->src1_cached_type != vec_dot_type;
+
+        params = &params_cache;
+    }
+
+    if (convert_src1) {
         char * wdata = params->wdata;
 
         const size_t nbw0 = ggml_type_size(vec_dot_type);
@@ -1309,10 +1619,25 @@ UseGgmlGemm1:;
     if (ith == 0) {
         // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
         atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
+
+        // the chunking is decided once for all the threads
+        const int64_t nr0 = ne0;
+        const int64_t nr1 = ne1 * ne2 * ne3;
+
+        // the NUMA partition strategy needs the chunking by thread to compute the node-local rows
+        params->threadpool->mul_mat_chunk_size = ggml_cpu_autotune_enabled() && !ggml_numa_is_partition() ?
+            ggml_cpu_autotune_mul_mat_get(src0->type, ne00, nr0, nr1, nth) :
+            ggml_mul_mat_default_chunk_size(nr0, nr1, nth);
     }
 
     ggml_barrier(params->threadpool);
 
+    // all the threads have checked the cache before the barrier
+    if (ith == 0 && src1_cache) {
+        params->threadpool->src1_cached      = src1;
+        params->threadpool->src1_cached_type = vec_dot_type;
+    }
+
 #if GGML_USE_LLAMAFILE
     if (src1->type != vec_dot_type) {
         const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
@@ -1343,62 +1668,14 @@ UseGgmlGemm2:;
     // This is the size of the rest of the dimensions of the result
     const int64_t nr1 = ne1 * ne2 * ne3;
 
-    // Now select a reasonable chunk size.
-    int chunk_size = 16;
+    const int chunk_size = params->threadpool->mul_mat_chunk_size;
 
-    // We need to step up the size if it's small
-    if (nr0 == 1 || nr1 == 1) {
-        chunk_size = 64;
-    }
-
-    // distribute the work across the inner or outer loop based on which one is larger
-    // The number of chunks in the 0/1 dim.
-    // CEIL(nr0/chunk_size)
-    int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-    int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
-
-    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
-    //   Also, chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggml-org/llama.cpp/pull/6915
-    //   In theory, chunking should be just as useful on NUMA and non NUMA systems, but testing disagreed with that.
-    if (nchunk0 * nchunk1 < nth * 4 || ggml_is_numa()) {
-        // distribute the thread work across the inner or outer loop based on which one is larger
-        nchunk0 = nr0 > nr1 ? nth : 1; // parallelize by src0 rows
-        nchunk1 = nr0 > nr1 ? 1 : nth; // parallelize by src1 rows
+    if (chunk_size == GGML_CPU_AUTOTUNE_PENDING) {
+        ggml_compute_forward_mul_mat_tune(params, dst, nr0, nr1);
+        return;
     }
 
-    // The number of elements in each chunk
-    const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
-    const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
-
-    // The first chunk comes from our thread_id, the rest will get auto-assigned.
-    int current_chunk = ith;
-
-    while (current_chunk < nchunk0 * nchunk1) {
-        const int64_t ith0 = current_chunk % nchunk0;
-        const int64_t ith1 = current_chunk / nchunk0;
-
-        const int64_t ir0_start = dr0 * ith0;
-        const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
-
-        const int64_t ir1_start = dr1 * ith1;
-        const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
-
-        // dot kernels can handle 1 row and col at a time, but mmla kernels can process 2 rows and cols
-        int64_t num_rows_per_vec_dot = vec_dot_num_rows;
-
-        // these checks are needed to avoid crossing dim1 boundaries
-        // can be optimized, but the logic would become more complicated, so keeping it like this for simplicity
-        if ((nr0 % 2 != 0) || (ne11 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || ((ir1_end - ir1_start) % 2 != 0)) {
-            num_rows_per_vec_dot = 1;
-        }
-        ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, ir1_start, ir1_end);
-
-        if (nth >= nchunk0 * nchunk1) {
-            break;
-        }
-
-        current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
-    }
+    ggml_compute_forward_mul_mat_chunks(params, dst, chunk_size);
 }
 
 // ggml_compute_forward_mul_mat_id
@@ -1473,6 +1750,96 @@ static void ggml_compute_forward_mul_mat_id_one_chunk(
     }
 }
 
+// number of src1 rows of an expert in a tile of the grouped dispatch
+#define MMID_TILE_NR1 64
+
+// grouped dispatch of mul_mat_id: the (expert, src0 rows, src1 rows) tiles of all the used experts are taken from
+// a single queue, instead of splitting each expert between all the threads one after another, which makes thin
+// tiles and leaves threads idle at the end of each expert when the experts have few rows
+static void ggml_compute_forward_mul_mat_id_grouped(
+        const struct ggml_compute_params * params,
+              struct ggml_tensor * dst,
+        const int64_t * matrix_row_counts,
+        const struct mmid_row_mapping * matrix_rows,
+        const bool src1_cont) {
+
+    const struct ggml_tensor * src0 = dst->src[0];
+    const struct ggml_tensor * src1 = dst->src[1];
+    const struct ggml_tensor * ids  = dst->src[2];
+
+    GGML_TENSOR_BINARY_OP_LOCALS
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int n_as = ne02;
+
+    enum ggml_type const vec_dot_type = type_traits_cpu[src0->type].vec_dot_type;
+
+    // the src1 rows are converted to vec_dot_type once and shared by all the experts
+    const void * wdata    = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+    const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+
+    const int64_t nr0 = ne01;
+    const int64_t dr1 = MMID_TILE_NR1;
+
+    int64_t ntiles1 = 0;
+    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+        ntiles1 += (matrix_row_counts[cur_a] + dr1 - 1)/dr1;
+    }
+
+    if (ntiles1 == 0) {
+        return;
+    }
+
+    // split the src0 rows so that there are at least 4 tiles per thread
+    const int64_t nchunk0_min = (4*nth + ntiles1 - 1)/ntiles1;
+    const int64_t dr0         = GGML_PAD((nr0 + nchunk0_min - 1)/nchunk0_min, 16);
+    const int64_t nchunk0     = (nr0 + dr0 - 1)/dr0;
+
+    // each thread takes the tiles in increasing order, so the expert of a tile is found by moving forward
+    int     cur_a  = 0;
+    int64_t tile_a = 0; // first tile of cur_a
+
+    int current_tile = ith;
+
+    while (true) {
+        int64_t nchunk1 = 0;
+
+        while (cur_a < n_as) {
+            nchunk1 = (matrix_row_counts[cur_a] + dr1 - 1)/dr1;
+            if (current_tile < tile_a + nchunk0*nchunk1) {
+                break;
+            }
+            tile_a += nchunk0*nchunk1;
+            cur_a++;
+        }
+
+        if (cur_a == n_as) {
+            break;
+        }
+
+        const int64_t ith0 = (current_tile - tile_a) / nchunk1;
+        const int64_t ith1 = (current_tile - tile_a) % nchunk1;
+
+        const int64_t ir0_start = dr0 * ith0;
+        const int64_t ir0_end   = MIN(ir0_start + dr0, nr0);
+
+        const int64_t ir1_start = dr1 * ith1;
+        const int64_t ir1_end   = MIN(ir1_start + dr1, matrix_row_counts[cur_a]);
+
+        const char * src0_cur = (const char *) src0->data + cur_a * nb02;
+
+        ggml_compute_forward_mul_mat_id_one_chunk(
+            dst, src0, src1, ids, cur_a,
+            ir0_start, ir0_end, ir1_start, ir1_end,
+            src0_cur, matrix_rows, row_size, src1_cont, wdata
+        );
+
+        current_tile = ggml_threadpool_chunk_add(params->threadpool, 1);
+    }
+}
+
 static void * incr_ptr_aligned(void ** p, size_t size, size_t align) {
 
     void * ptr = *p;
@@ -1570,6 +1937,9 @@ static void ggml_compute_forward_mul_mat_id(
     }
 
     if (ith == 0) {
+        // Every thread starts at ith, so the first unprocessed tile of the grouped dispatch is nth.
+        ggml_threadpool_chunk_set(params->threadpool, nth);
+
         // initialize matrix_row_counts
         memset(matrix_row_counts, 0, n_as*sizeof(int64_t));
 
@@ -1594,6 +1964,19 @@ static void ggml_compute_forward_mul_mat_id(
 
     ggml_barrier(params->threadpool);
 
+#if defined(__aarch64__)
+    // disable for ARM
+    const bool disable_chunking = true;
+#else
+    // disable for NUMA
+    const bool disable_chunking = ggml_is_numa();
+#endif // defined(__aarch64__)
+
+    if (!disable_chunking) {
+        ggml_compute_forward_mul_mat_id_grouped(params, dst, matrix_row_counts, matrix_rows, src1_cont);
+        return;
+    }
+
     for (int cur_a = 0; cur_a < n_as; ++cur_a) {
         const int64_t cne1 = matrix_row_counts[cur_a];
 
@@ -1613,14 +1996,6 @@ static void ggml_compute_forward_mul_mat_id(
             chunk_size = 64;
         }
 
-#if defined(__aarch64__)
-        // disable for ARM
-        const bool disable_chunking = true;
-#else
-        // disable for NUMA
-        const bool disable_chunking = ggml_is_numa();
-#endif // defined(__aarch64__)
-
         int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
         int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
 
@@ -2056,7 +2431,7 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
 
 // Android's libc implementation "bionic" does not support setting affinity
 #if defined(__gnu_linux__)
-static void set_numa_thread_affinity(int thread_n) {
+static void set_numa_thread_affinity(int thread_n, int n_threads) {
     if (!ggml_is_numa()) {
         return;
     }
@@ -2074,6 +2449,10 @@ static void set_numa_thread_affinity(int thread_n) {
             // run thread on current_node
             node_num = g_state.numa.current_node;
             break;
+        case GGML_NUMA_STRATEGY_PARTITION:
+            // run the threads in contiguous groups, one per node
+            node_num = ggml_numa_thread_node(thread_n, n_threads);
+            break;
         case GGML_NUMA_STRATEGY_NUMACTL:
             // use the cpuset that numactl gave us
             rv = pthread_setaffinity_np(pthread_self(), setsize, &g_state.numa.cpuset);
@@ -2124,7 +2503,7 @@ static void clear_numa_thread_affinity(void) {
 #else
 // TODO: Windows etc.
 // (the linux implementation may also work on BSD, someone should test)
-static void set_numa_thread_affinity(int thread_n) { UNUSED(thread_n);  }
+static void set_numa_thread_affinity(int thread_n, int n_threads) { UNUSED(thread_n); UNUSED(n_threads); }
 static void clear_numa_thread_affinity(void) {}
 #endif
 
@@ -2823,6 +3202,13 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        // partial results of the chunks of the KV sequence: max, sum and head size V
+                        const int64_t n_rows  = ggml_nrows(node->src[0]);
+                        const int64_t n_chunk = ggml_flash_attn_ext_n_kv_chunks(n_rows, node->src[1]->ne[1], n_tasks);
+                        if (n_chunk > 1) {
+                            cur += sizeof(float)*(ne20 + 2)*n_rows*n_chunk;
+                        }
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2861,6 +3247,9 @@ struct ggml_cplan ggml_graph_plan(
         work_size += CACHE_LINE_SIZE*(n_threads);
     }
 
+    // the src1 cache of the mul_mats is after the work buffer of the ops
+    work_size += ggml_graph_src1_cache_size(cgraph, n_threads);
+
     cplan.threadpool = threadpool;
     cplan.n_threads  = MIN(max_tasks, n_threads);
     cplan.work_size  = work_size;
@@ -2869,6 +3258,171 @@ struct ggml_cplan ggml_graph_plan(
     return cplan;
 }
 
+// fusion of chains of nodes into a single pass over the data
+// the intermediate results are not written to memory and the threads synchronize once per chain
+// only RMS_NORM + MUL is fused, see docs/build.md (disabled with GGML_CPU_DISABLE_FUSION)
+
+static bool ggml_cpu_use_fusion = true;
+
+static bool ggml_cpu_can_fuse_rms_norm_mul(const struct ggml_cgraph * cgraph, int node_n) {
+    static const enum ggml_op ops[] = { GGML_OP_RMS_NORM, GGML_OP_MUL };
+
+    if (!ggml_can_fuse(cgraph, node_n, ops, 2)) {
+        return false;
+    }
+
+    const struct ggml_tensor * norm = cgraph->nodes[node_n];
+    const struct ggml_tensor * mul  = cgraph->nodes[node_n + 1];
+
+    // the normalized rows are broadcast by the mul, not the weights
+    return mul->src[0] == norm &&
+        norm->src[0]->type == GGML_TYPE_F32 && mul->src[1]->type == GGML_TYPE_F32 && mul->type == GGML_TYPE_F32 &&
+        norm->src[0]->nb[0] == sizeof(float) && mul->src[1]->nb[0] == sizeof(float) &&
+        !ggml_is_empty(mul);
+}
+
+// number of nodes of the chain starting at node_n that are computed together, 1 if there is nothing to fuse
+static int ggml_cpu_n_fused(const struct ggml_cplan * cplan, const struct ggml_cgraph * cgraph, int node_n) {
+    if (!ggml_cpu_use_fusion || cplan->disable_fusion) {
+        return 1;
+    }
+
+    switch (cgraph->nodes[node_n]->op) {
+        case GGML_OP_RMS_NORM:
+            return ggml_cpu_can_fuse_rms_norm_mul(cgraph, node_n) ? 2 : 1;
+        default:
+            return 1;
+    }
+}
+
+static void ggml_compute_forward_fused(struct ggml_compute_params * params, const struct ggml_cgraph * cgraph, int node_n, int n_fused) {
+    struct ggml_tensor * node = cgraph->nodes[node_n];
+
+    if (n_fused == 1) {
+        ggml_compute_forward(params, node);
+        return;
+    }
+
+    switch (node->op) {
+        case GGML_OP_RMS_NORM:
+            {
+                ggml_compute_forward_rms_norm_mul(params, cgraph->nodes[node_n + 1]);
+            } break;
+        default:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+}
+
+// barrier elision
+// a node can start while the other threads are still computing the nodes since the last barrier
+// if it does not use the shared work buffer or the chunk counters, and if its memory does not overlap
+// with the memory written by these nodes, nor its output with their inputs
+
+#define GGML_CPU_MAX_PENDING_NODES 16
+
+static bool ggml_cpu_node_can_run_unsynced(const struct ggml_tensor * node) {
+    if (ggml_op_is_empty(node->op)) {
+        return true;
+    }
+
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        // the tensors of the extra buffer types are computed by their own kernels
+        if (node->src[i] && node->src[i]->extra) {
+            return false;
+        }
+    }
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+            // the quantized variants dequantize through the work buffer
+            return !ggml_is_quantized(node->src[0]->type);
+        case GGML_OP_DUP:
+        case GGML_OP_CPY:
+        case GGML_OP_CONT:
+            return !ggml_is_quantized(node->type);
+        case GGML_OP_SCALE:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_SET_ROWS:
+        case GGML_OP_UNARY:
+        case GGML_OP_GLU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// ops that can write outside of their destination
+static bool ggml_cpu_node_writes_srcs(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_MAP_CUSTOM1:
+        case GGML_OP_MAP_CUSTOM2:
+        case GGML_OP_MAP_CUSTOM3:
+        case GGML_OP_CUSTOM:
+        case GGML_OP_OPT_STEP_ADAMW:
+        case GGML_OP_OPT_STEP_SGD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool ggml_cpu_tensors_overlap(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    if (a == NULL || b == NULL || a->data == NULL || b->data == NULL) {
+        return false;
+    }
+
+    const char * a0 = (const char *) a->data;
+    const char * b0 = (const char *) b->data;
+
+    return a0 < b0 + ggml_nbytes(b) && b0 < a0 + ggml_nbytes(a);
+}
+
+static bool ggml_cpu_node_depends_on(const struct ggml_tensor * node, const struct ggml_tensor * prev) {
+    if (ggml_cpu_tensors_overlap(node, prev)) {
+        return true;
+    }
+
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        if (ggml_cpu_tensors_overlap(node->src[i], prev) || ggml_cpu_tensors_overlap(node, prev->src[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// check if the chain of n nodes starting at node_n can skip the barrier
+static bool ggml_cpu_can_skip_barrier(
+        const struct ggml_cgraph * cgraph, int node_n, int n,
+        const struct ggml_tensor ** pending, int n_pending) {
+    for (int i = node_n; i < node_n + n; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        if (ggml_op_is_empty(node->op) || ggml_is_empty(node)) {
+            continue;
+        }
+
+        if (!ggml_cpu_node_can_run_unsynced(node)) {
+            return false;
+        }
+
+        for (int j = 0; j < n_pending; j++) {
+            if (ggml_cpu_node_writes_srcs(pending[j]) || ggml_cpu_node_depends_on(node, pending[j])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool    * tp    = state->threadpool;
@@ -2876,20 +3430,36 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     const struct ggml_cgraph * cgraph = tp->cgraph;
     const struct ggml_cplan  * cplan  = tp->cplan;
 
-    set_numa_thread_affinity(state->ith);
+    set_numa_thread_affinity(state->ith, atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed));
 
     struct ggml_compute_params params = {
         /*.ith       =*/ state->ith,
         /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
-        /*.wsize     =*/ cplan->work_size,
+        /*.wsize     =*/ cplan->work_size - tp->src1_cache_size, // the src1 cache is only used by mul_mat
         /*.wdata     =*/ cplan->work_data,
         /*.threadpool=*/ tp,
     };
 
+    // nodes computed since the last barrier
+    // the threads only stop at the same node on abort if they all synchronize after each node
+    const bool elide_barriers = cplan->abort_callback == NULL && params.nth > 1;
+
+    const struct ggml_tensor * pending[GGML_CPU_MAX_PENDING_NODES];
+    int n_pending = 0;
+
+    // all threads take the same decisions, so they fuse the same nodes and skip the same barriers
+    int n_fused = ggml_cpu_n_fused(cplan, cgraph, 0);
+
     for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
-        struct ggml_tensor * node = cgraph->nodes[node_n];
+        ggml_compute_forward_fused(&params, cgraph, node_n, n_fused);
+
+        for (int i = node_n; i < node_n + n_fused; i++) {
+            if (elide_barriers && !ggml_op_is_empty(cgraph->nodes[i]->op) && n_pending < GGML_CPU_MAX_PENDING_NODES) {
+                pending[n_pending++] = cgraph->nodes[i];
+            }
+        }
 
-        ggml_compute_forward(&params, node);
+        node_n += n_fused - 1;
 
         if (state->ith == 0 && cplan->abort_callback &&
                 cplan->abort_callback(cplan->abort_callback_data)) {
@@ -2898,7 +3468,13 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
         }
 
         if (node_n + 1 < cgraph->n_nodes) {
-            ggml_barrier(state->threadpool);
+            n_fused = ggml_cpu_n_fused(cplan, cgraph, node_n + 1);
+
+            if (!elide_barriers || n_pending == GGML_CPU_MAX_PENDING_NODES ||
+                !ggml_cpu_can_skip_barrier(cgraph, node_n + 1, n_fused, pending, n_pending)) {
+                ggml_barrier(state->threadpool);
+                n_pending = 0;
+            }
         }
     }
 
@@ -3160,6 +3736,15 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
 
+    // the content of the src1 cache is not valid after the previous graph
+    threadpool->src1_cache_size  = ggml_graph_src1_cache_size(cgraph, n_threads);
+    threadpool->src1_cached      = NULL;
+    threadpool->src1_cached_type = GGML_TYPE_COUNT;
+
+    if (cplan->work_size < threadpool->src1_cache_size) {
+        threadpool->src1_cache_size = 0;
+    }
+
 #ifdef GGML_USE_OPENMP
     if (n_threads > 1) {
         #pragma omp parallel num_threads(n_threads)
@@ -3586,6 +4171,10 @@ void ggml_cpu_init(void) {
         ggml_init_arm_arch_features();
 #endif
 
+        ggml_cpu_use_fusion = getenv("GGML_CPU_DISABLE_FUSION") == NULL;
+
+        ggml_cpu_autotune_init();
+
         is_first_call = false;
     }
 
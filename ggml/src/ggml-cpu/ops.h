@@ -23,6 +23,24 @@ static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 // Work buffer size for im2col operations in CONV2D
 #define GGML_IM2COL_WORK_SIZE (16 * 1024 * 1024)
 
+// Min number of KV rows per thread when flash attention splits the KV sequence between the threads
+#define GGML_FA_KV_CHUNK_MIN 256
+
+// Number of chunks of the KV sequence of each q row in flash attention
+// The KV sequence is split only when there are fewer q rows than threads (e.g. decode)
+static inline int64_t ggml_flash_attn_ext_n_kv_chunks(int64_t n_rows, int64_t n_kv, int n_threads) {
+    if (n_rows >= n_threads) {
+        return 1;
+    }
+
+    int64_t n_chunk = (n_threads + n_rows - 1)/n_rows;
+    if (n_chunk > n_kv/GGML_FA_KV_CHUNK_MIN) {
+        n_chunk = n_kv/GGML_FA_KV_CHUNK_MIN;
+    }
+
+    return n_chunk > 1 ? n_chunk : 1;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -44,6 +62,7 @@ void ggml_compute_forward_silu_back(const struct ggml_compute_params * params, s
 void ggml_compute_forward_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_rms_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_rms_norm_back(const struct ggml_compute_params * params, struct ggml_tensor * dst);
+void ggml_compute_forward_rms_norm_mul(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_group_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_l2_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_out_prod(const struct ggml_compute_params * params, struct ggml_tensor * dst);
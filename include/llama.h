@@ -263,6 +263,13 @@ extern "C" {
         ggml_backend_buffer_type_t buft;
     };
 
+    // data types of the KV cache of a layer, overriding the type_k and type_v of the context
+    struct llama_kv_type_override {
+        int32_t        il;     // layer index, a negative value terminates the list
+        enum ggml_type type_k; // GGML_TYPE_COUNT = type_k of the context
+        enum ggml_type type_v; // GGML_TYPE_COUNT = type_v of the context
+    };
+
     struct llama_model_params {
         // NULL-terminated list of devices to use for offloading (if NULL, all available devices are used)
         ggml_backend_dev_t * devices;
@@ -323,6 +330,12 @@ extern "C" {
         float    yarn_beta_slow;   // YaRN high correction dim
         uint32_t yarn_orig_ctx;    // YaRN original context size
         float    defrag_thold;     // [DEPRECATED] defragment the KV cache if holes/size > thold, <= 0 disabled (default)
+        uint32_t n_moe_hot;        // number of most used experts of each MoE layer kept locked in RAM, the unused ones are
+                                   // released first when memory is needed (0 = disabled, not used with use_mlock)
+        uint32_t n_kv_sink;        // when a sequence exceeds its context, evict its oldest KV cells but keep this number of
+                                   // attention sink tokens at its start, instead of failing or shifting the context (0 = disabled)
+        uint32_t n_kv_budget;      // max number of KV cells of a sequence, beyond which the cells that received the least
+                                   // attention are evicted, requires the attention scores (no flash_attn) (0 = disabled)
 
         ggml_backend_sched_eval_callback cb_eval;
         void * cb_eval_user_data;
@@ -330,6 +343,9 @@ extern "C" {
         enum ggml_type type_k; // data type for K cache [EXPERIMENTAL]
         enum ggml_type type_v; // data type for V cache [EXPERIMENTAL]
 
+        // list of per-layer data types of the KV cache, terminated by an entry with il < 0 (NULL = none) [EXPERIMENTAL]
+        const struct llama_kv_type_override * kv_type_overrides;
+
         // Abort callback
         // if it returns true, execution of llama_decode() will be aborted
         // currently works only with CPU execution
@@ -347,6 +363,8 @@ extern "C" {
         bool kv_unified;  // use a unified buffer across the input sequences when computing the attention
                           // try to disable when n_seq_max > 1 for improved performance when the sequences do not share a large prefix
                           // ref: https://github.com/ggml-org/llama.cpp/pull/14363
+        bool kv_paged;    // allocate the KV cells of each sequence in blocks taken from a shared pool on demand, instead of
+                          // splitting the context between the sequences - requires (and enables) kv_unified
     };
 
     // model quantization parameters
@@ -697,6 +715,9 @@ extern "C" {
     // Check if the memory supports shifting
     LLAMA_API bool llama_memory_can_shift(llama_memory_t mem);
 
+    // Check if the memory evicts the tokens of the sequences that exceed their context (see n_kv_sink and n_kv_budget)
+    LLAMA_API bool llama_memory_can_evict(llama_memory_t mem);
+
     //
     // State / sessions
     //
@@ -6,6 +6,7 @@
 #include "llama-memory.h"
 #include "llama-mmap.h"
 #include "llama-model.h"
+#include "llama-moe-placement.h"
 
 #include <cinttypes>
 #include <cstring>
@@ -35,6 +36,9 @@ llama_context::llama_context(
 
     cparams.n_threads        = params.n_threads;
     cparams.n_threads_batch  = params.n_threads_batch;
+    cparams.n_moe_hot        = hparams.n_expert > 0 ? params.n_moe_hot : 0;
+    cparams.n_kv_sink        = params.n_kv_sink;
+    cparams.n_kv_budget      = params.n_kv_budget;
     cparams.yarn_ext_factor  = params.yarn_ext_factor  >= 0.0f ? params.yarn_ext_factor  : hparams.yarn_ext_factor;
     cparams.yarn_attn_factor = params.yarn_attn_factor >= 0.0f ? params.yarn_attn_factor : hparams.yarn_attn_factor;
     cparams.yarn_beta_fast   = params.yarn_beta_fast   >= 0.0f ? params.yarn_beta_fast   : hparams.yarn_beta_fast;
@@ -102,6 +106,22 @@ llama_context::llama_context(
 
     cparams.op_offload = params.op_offload;
     cparams.kv_unified = params.kv_unified;
+    cparams.kv_paged   = params.kv_paged;
+
+    if (cparams.kv_paged && !cparams.kv_unified) {
+        LLAMA_LOG_WARN("%s: kv_paged requires a unified KV cache - enabling kv_unified\n", __func__);
+        cparams.kv_unified = true;
+    }
+
+    // with mlock, all the weights are already locked and unlocking the cold experts would undo it
+    if (cparams.n_moe_hot > 0 && model.params.use_mlock) {
+        LLAMA_LOG_WARN("%s: n_moe_hot is not used with mlock - disabling\n", __func__);
+        cparams.n_moe_hot = 0;
+    }
+
+    if (cparams.n_moe_hot > 0) {
+        moe_placement = std::make_unique<llama_moe_placement>(cparams.n_moe_hot);
+    }
 
     {
         const char * LLAMA_GRAPH_REUSE_DISABLE = getenv("LLAMA_GRAPH_REUSE_DISABLE");
@@ -122,6 +142,18 @@ llama_context::llama_context(
     LLAMA_LOG_INFO("%s: causal_attn   = %d\n",   __func__, cparams.causal_attn);
     LLAMA_LOG_INFO("%s: flash_attn    = %s\n",   __func__, llama_flash_attn_type_name(params.flash_attn_type));
     LLAMA_LOG_INFO("%s: kv_unified    = %s\n",   __func__, cparams.kv_unified ? "true" : "false");
+    if (cparams.kv_paged) {
+        LLAMA_LOG_INFO("%s: kv_paged      = true\n", __func__);
+    }
+    if (cparams.n_kv_sink > 0) {
+        LLAMA_LOG_INFO("%s: n_kv_sink     = %u\n",   __func__, cparams.n_kv_sink);
+    }
+    if (cparams.n_kv_budget > 0) {
+        LLAMA_LOG_INFO("%s: n_kv_budget   = %u\n",   __func__, cparams.n_kv_budget);
+    }
+    if (cparams.n_moe_hot > 0) {
+        LLAMA_LOG_INFO("%s: n_moe_hot     = %u\n",   __func__, cparams.n_moe_hot);
+    }
     LLAMA_LOG_INFO("%s: freq_base     = %.1f\n", __func__, cparams.rope_freq_base);
     LLAMA_LOG_INFO("%s: freq_scale    = %g\n",   __func__, cparams.rope_freq_scale);
 
@@ -194,12 +226,28 @@ llama_context::llama_context(
     // init the memory module
     if (!hparams.vocab_only) {
         llama_memory_params params_mem = {
-            /*.type_k   =*/ params.type_k,
-            /*.type_v   =*/ params.type_v,
-            /*.swa_full =*/ params.swa_full,
+            /*.type_k        =*/ params.type_k,
+            /*.type_v        =*/ params.type_v,
+            /*.swa_full      =*/ params.swa_full,
+            /*.type_kv_layer =*/ {},
         };
 
+        for (const auto * o = params.kv_type_overrides; o && o->il >= 0; ++o) {
+            params_mem.type_kv_layer[o->il] = {
+                o->type_k == GGML_TYPE_COUNT ? params.type_k : o->type_k,
+                o->type_v == GGML_TYPE_COUNT ? params.type_v : o->type_v,
+            };
+        }
+
         memory.reset(model.create_memory(params_mem, cparams));
+
+        // e.g. recurrent and hybrid models
+        if ((cparams.n_kv_sink > 0 || cparams.n_kv_budget > 0) && (!memory || !memory->get_can_evict())) {
+            LLAMA_LOG_WARN("%s: the memory of this model does not evict tokens - ignoring n_kv_sink and n_kv_budget\n", __func__);
+
+            cparams.n_kv_sink   = 0;
+            cparams.n_kv_budget = 0;
+        }
     }
 
     // init backends
@@ -326,6 +374,11 @@ llama_context::llama_context(
                 if (ggml_is_quantized(params.type_v)) {
                     throw std::runtime_error("quantized V cache was requested, but this requires Flash Attention");
                 }
+                for (const auto * o = params.kv_type_overrides; o && o->il >= 0; ++o) {
+                    if (o->type_v != GGML_TYPE_COUNT && ggml_is_quantized(o->type_v)) {
+                        throw std::runtime_error("quantized V cache was requested for layer " + std::to_string(o->il) + ", but this requires Flash Attention");
+                    }
+                }
             } else {
                 cparams.flash_attn = true;
                 LLAMA_LOG_INFO("%s: Flash Attention was auto, set to enabled\n", __func__);
@@ -1009,6 +1062,9 @@ int llama_context::decode(const llama_batch & batch_inp) {
 
     bool did_optimize = false;
 
+    // make room for the batch in the sequences that evict their old cells, the shifts of the sinks are applied below
+    memory->evict(*balloc);
+
     // handle any pending shifts/copies
     memory_update(false);
 
@@ -1123,6 +1179,22 @@ int llama_context::decode(const llama_batch & batch_inp) {
         //    ggml_graph_dump_dot(gf, NULL, "llama.dot");
         //}
 
+        if (moe_placement && !res->t_moe_sel.empty()) {
+            ggml_backend_sched_synchronize(sched.get());
+
+            std::vector<uint8_t> ids;
+            for (const auto & sel : res->t_moe_sel) {
+                ids.resize(ggml_nbytes(sel.ids));
+                ggml_backend_tensor_get(sel.ids, ids.data(), 0, ids.size());
+
+                moe_placement->add(sel, ids.data());
+            }
+
+            moe_placement->apply();
+        }
+
+        res->get_outputs(sched.get());
+
         auto * t_logits = res->get_logits();
         auto * t_embd   = cparams.embeddings ? res->get_embd() : nullptr;
 
@@ -2283,10 +2355,14 @@ llama_context_params llama_context_default_params() {
         /*.yarn_beta_slow              =*/ -1.0f,
         /*.yarn_orig_ctx               =*/ 0,
         /*.defrag_thold                =*/ -1.0f,
+        /*.n_moe_hot                   =*/ 0,
+        /*.n_kv_sink                   =*/ 0,
+        /*.n_kv_budget                 =*/ 0,
         /*.cb_eval                     =*/ nullptr,
         /*.cb_eval_user_data           =*/ nullptr,
         /*.type_k                      =*/ GGML_TYPE_F16,
         /*.type_v                      =*/ GGML_TYPE_F16,
+        /*.kv_type_overrides           =*/ nullptr,
         /*.abort_callback              =*/ nullptr,
         /*.abort_callback_data         =*/ nullptr,
         /*.embeddings                  =*/ false,
@@ -2295,6 +2371,7 @@ llama_context_params llama_context_default_params() {
         /*.op_offload                  =*/ true,
         /*.swa_full                    =*/ true,
         /*.kv_unified                  =*/ false,
+        /*.kv_paged                    =*/ false,
     };
 
     return result;
@@ -2323,6 +2400,24 @@ llama_context * llama_init_from_model(
         params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_DISABLED;
     }
 
+    bool quantized_v = ggml_is_quantized(params.type_v);
+    for (const auto * o = params.kv_type_overrides; o && o->il >= 0; ++o) {
+        quantized_v = quantized_v || (o->type_v != GGML_TYPE_COUNT && ggml_is_quantized(o->type_v));
+    }
+
+    // only the KV cache of the models without SWA and without recurrent layers evicts by the attention scores
+    const bool kv_score = params.n_kv_budget > 0 && model->hparams.swa_type == LLAMA_SWA_TYPE_NONE &&
+        !llama_model_is_recurrent(model) && !llama_model_is_hybrid(model);
+
+    if (kv_score && params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_AUTO && !quantized_v) {
+        LLAMA_LOG_INFO("%s: the KV budget uses the attention scores - forcing flash_attn off\n", __func__);
+        params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_DISABLED;
+    }
+
+    if (kv_score && params.flash_attn_type != LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+        LLAMA_LOG_WARN("%s: the attention scores are not available with flash_attn - the oldest KV cells will be evicted first\n", __func__);
+    }
+
     if (params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_AUTO && ggml_is_quantized(params.type_k)) {
         const uint32_t blck_size = ggml_blck_size(params.type_k);
         if (model->hparams.n_embd_head_k % blck_size != 0) {
@@ -2346,6 +2441,30 @@ llama_context * llama_init_from_model(
         return nullptr;
     }
 
+    for (const auto * o = params.kv_type_overrides; o && o->il >= 0; ++o) {
+        if (o->il >= (int32_t) model->hparams.n_layer) {
+            LLAMA_LOG_ERROR("%s: KV cache type override for layer %d, but the model has %u layers\n", __func__, o->il, model->hparams.n_layer);
+            return nullptr;
+        }
+
+        if (o->type_k != GGML_TYPE_COUNT && model->hparams.n_embd_head_k % ggml_blck_size(o->type_k) != 0) {
+            LLAMA_LOG_ERROR("%s: K cache type %s of layer %d with block size %u does not divide n_embd_head_k=%u\n",
+                __func__, ggml_type_name(o->type_k), o->il, (uint32_t) ggml_blck_size(o->type_k), model->hparams.n_embd_head_k);
+            return nullptr;
+        }
+
+        if (o->type_v != GGML_TYPE_COUNT && model->hparams.n_embd_head_v % ggml_blck_size(o->type_v) != 0) {
+            LLAMA_LOG_ERROR("%s: V cache type %s of layer %d with block size %u does not divide n_embd_head_v=%u\n",
+                __func__, ggml_type_name(o->type_v), o->il, (uint32_t) ggml_blck_size(o->type_v), model->hparams.n_embd_head_v);
+            return nullptr;
+        }
+
+        if (o->type_v != GGML_TYPE_COUNT && ggml_is_quantized(o->type_v) && params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+            LLAMA_LOG_ERROR("%s: V cache quantization of layer %d requires flash_attn\n", __func__, o->il);
+            return nullptr;
+        }
+    }
+
     if (params.pooling_type != LLAMA_POOLING_TYPE_UNSPECIFIED &&
         params.pooling_type != model->hparams.pooling_type) {
         //user-specified pooling-type is different from the model default
@@ -2611,6 +2730,14 @@ bool llama_memory_can_shift(llama_memory_t mem) {
     return mem->get_can_shift();
 }
 
+bool llama_memory_can_evict(llama_memory_t mem) {
+    if (!mem) {
+        return false;
+    }
+
+    return mem->get_can_evict();
+}
+
 // llama state API
 
 // deprecated
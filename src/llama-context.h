@@ -17,6 +17,8 @@ class llama_batch_allocr;
 class llama_io_read_i;
 class llama_io_write_i;
 
+class llama_moe_placement;
+
 // "memory" as in abstract memory for the context
 struct llama_memory_i;
 struct llama_memory_context_i;
@@ -238,6 +240,9 @@ private:
 
     std::unique_ptr<llama_memory_i> memory;
 
+    // placement of the expert weights, only with n_moe_hot > 0
+    std::unique_ptr<llama_moe_placement> moe_placement;
+
     // decode output (2-dimensional array: [n_outputs][n_vocab])
     size_t  logits_size = 0; // capacity (of floats) for logits
     float * logits      = nullptr;
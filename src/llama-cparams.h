@@ -13,6 +13,9 @@ struct llama_cparams {
     uint32_t n_seq_max;
     int32_t  n_threads;       // number of threads to use for generation
     int32_t  n_threads_batch; // number of threads to use for batch processing
+    uint32_t n_moe_hot;       // number of most used experts of each MoE layer kept locked in memory
+    uint32_t n_kv_sink;       // number of attention sink tokens kept when the old KV cells of a sequence are evicted
+    uint32_t n_kv_budget;     // max number of KV cells of a sequence, the least attended ones are evicted beyond it
 
     float rope_freq_base;
     float rope_freq_scale;
@@ -33,6 +36,7 @@ struct llama_cparams {
     bool warmup;
     bool op_offload;
     bool kv_unified;
+    bool kv_paged;
 
     enum llama_pooling_type pooling_type;
 
@@ -369,6 +369,26 @@ void llm_graph_input_attn_kv::set_input(const llama_ubatch * ubatch) {
     mctx->set_input_v_idxs(self_v_idxs, ubatch);
 
     mctx->set_input_kq_mask(self_kq_mask, ubatch, cparams.causal_attn);
+
+    if (self_kq_ones) {
+        GGML_ASSERT(ggml_backend_buffer_is_host(self_kq_ones->buffer));
+
+        float * data = (float *) self_kq_ones->data;
+        std::fill(data, data + ggml_nelements(self_kq_ones), 1.0f);
+    }
+}
+
+void llm_graph_input_attn_kv::get_output(ggml_backend_sched_t sched) {
+    if (!self_kq_score) {
+        return;
+    }
+
+    ggml_backend_sched_synchronize(sched);
+
+    std::vector<float> score(ggml_nelements(self_kq_score));
+    ggml_backend_tensor_get(self_kq_score, score.data(), 0, ggml_nbytes(self_kq_score));
+
+    mctx->score_add(score.data());
 }
 
 bool llm_graph_input_attn_kv::can_reuse(const llm_graph_params & params) {
@@ -483,6 +503,8 @@ void llm_graph_result::reset() {
     t_embd        = nullptr;
     t_embd_pooled = nullptr;
 
+    t_moe_sel.clear();
+
     params = {};
 
     inputs.clear();
@@ -506,6 +528,12 @@ void llm_graph_result::set_inputs(const llama_ubatch * ubatch) {
     }
 }
 
+void llm_graph_result::get_outputs(ggml_backend_sched_t sched) const {
+    for (auto & input : inputs) {
+        input->get_output(sched);
+    }
+}
+
 bool llm_graph_result::can_reuse(const llm_graph_params & params) {
     if (!this->params.allow_reuse(params)) {
         if (debug > 1) {
@@ -995,6 +1023,13 @@ ggml_tensor * llm_graph_context::build_moe_ffn(
     ggml_tensor * weights = ggml_get_rows(ctx0, probs, selected_experts); // [1, n_expert_used, n_tokens]
     cb(weights, "ffn_moe_weights", il);
 
+    // keep the selected experts for the placement of the expert weights
+    if (cparams.n_moe_hot > 0 && !cparams.warmup) {
+        // note: top_k is a view of the argsort result, the data must be kept in the source
+        ggml_set_output(selected_experts->view_src ? selected_experts->view_src : selected_experts);
+        res->t_moe_sel.push_back({ selected_experts, { up_exps, gate_exps, down_exps } });
+    }
+
 
     if (gating_op == LLAMA_EXPERT_GATING_FUNC_TYPE_SOFTMAX_WEIGHT) {
         weights = ggml_reshape_2d(ctx0, weights, n_expert_used, n_tokens);
@@ -1344,7 +1379,8 @@ ggml_tensor * llm_graph_context::build_attn_mha(
          ggml_tensor * sinks,
          ggml_tensor * v_mla,
                float   kq_scale,
-                 int   il) const {
+                 int   il,
+         ggml_tensor ** kq_soft_max) const {
     const bool v_trans = v->nb[1] > v->nb[2];
 
     // split the batch into streams if needed
@@ -1438,6 +1474,10 @@ ggml_tensor * llm_graph_context::build_attn_mha(
         ggml_soft_max_add_sinks(kq, sinks);
         cb(kq, "kq_soft_max", il);
 
+        if (kq_soft_max) {
+            *kq_soft_max = kq;
+        }
+
         if (!v_trans) {
             // note: avoid this branch
             v = ggml_cont(ctx0, ggml_transpose(ctx0, v));
@@ -1565,6 +1605,17 @@ static std::unique_ptr<llm_graph_input_attn_kv> build_attn_inp_kv_impl(
         ggml_set_input(inp->self_kq_mask);
 
         inp->self_kq_mask_cnv = cparams.flash_attn ? ggml_cast(ctx0, inp->self_kq_mask, GGML_TYPE_F16) : inp->self_kq_mask;
+
+        // the attention weights are summed over the tokens by an outer product with ones
+        if (mctx_cur->get_has_score() && !cparams.flash_attn) {
+            uint32_t n_head_max = 0;
+            for (uint32_t il = 0; il < hparams.n_layer; ++il) {
+                n_head_max = std::max(n_head_max, hparams.n_head(il));
+            }
+
+            inp->self_kq_ones = ggml_new_tensor_4d(ctx0, GGML_TYPE_F32, 1, n_tokens/n_stream, n_head_max, n_stream);
+            ggml_set_input(inp->self_kq_ones);
+        }
     }
 
     return inp;
@@ -1613,9 +1664,30 @@ ggml_tensor * llm_graph_context::build_attn(
     ggml_tensor * k = mctx_cur->get_k(ctx0, il);
     ggml_tensor * v = mctx_cur->get_v(ctx0, il);
 
-    ggml_tensor * cur = build_attn_mha(q, k, v, kq_b, kq_mask, sinks, v_mla, kq_scale, il);
+    ggml_tensor * kq = nullptr;
+
+    ggml_tensor * cur = build_attn_mha(q, k, v, kq_b, kq_mask, sinks, v_mla, kq_scale, il,
+            inp->self_kq_ones ? &kq : nullptr);
     cb(cur, "kqv_out", il);
 
+    // accumulate the attention received by the KV cells over the layers, to evict the least attended ones
+    if (kq) {
+        ggml_tensor * ones = inp->self_kq_ones;
+
+        // [n_kv, n_tokens, n_head, n_stream] -> [n_kv, 1, n_head, n_stream]
+        ggml_tensor * kq_score = ggml_out_prod(ctx0, kq,
+                ggml_view_4d(ctx0, ones, 1, kq->ne[1], kq->ne[2], kq->ne[3], ones->nb[1], ones->nb[2], ones->nb[3], 0));
+
+        // [n_kv, 1, n_head, n_stream] -> [n_head, n_kv, n_stream] -> [1, n_kv, n_stream]
+        kq_score = ggml_reshape_3d(ctx0, kq_score, kq_score->ne[0], kq_score->ne[2], kq_score->ne[3]);
+        kq_score = ggml_sum_rows(ctx0, ggml_cont(ctx0, ggml_transpose(ctx0, kq_score)));
+        cb(kq_score, "kq_score", il);
+
+        inp->self_kq_score = inp->self_kq_score ? ggml_add(ctx0, inp->self_kq_score, kq_score) : kq_score;
+        ggml_set_output(inp->self_kq_score);
+        ggml_build_forward_expand(gf, inp->self_kq_score);
+    }
+
     if (wo) {
         cur = build_lora_mm(wo, cur);
         if (arch == LLM_ARCH_GLM4 || arch == LLM_ARCH_GLM4_MOE) {
@@ -87,6 +87,11 @@ public:
 
     virtual void set_input(const llama_ubatch * ubatch) = 0;
 
+    // read back the outputs of the graph that are needed by the input after the computation
+    virtual void get_output(ggml_backend_sched_t sched) {
+        GGML_UNUSED(sched);
+    }
+
     // return true if the resulting input tensors using the provided graph parameters would be
     //   the same as the previous input tensors that we have currently stored in the object
     virtual bool can_reuse(const llm_graph_params & params) {
@@ -283,6 +288,7 @@ public:
     ~llm_graph_input_attn_kv() = default;
 
     void set_input(const llama_ubatch * ubatch) override;
+    void get_output(ggml_backend_sched_t sched) override;
 
     bool can_reuse(const llm_graph_params & params) override;
 
@@ -297,6 +303,11 @@ public:
     ggml_tensor * self_kq_mask     = nullptr; // F32 [n_kv, n_batch/n_stream, 1, n_stream]
     ggml_tensor * self_kq_mask_cnv = nullptr; //     [n_kv, n_batch/n_stream, 1, n_stream]
 
+    // only with a KV budget and without flash attention
+    // the attention received by the cells, summed over the tokens, the heads and the layers
+    ggml_tensor * self_kq_score = nullptr; // F32 [1, n_kv, n_stream]
+    ggml_tensor * self_kq_ones  = nullptr; // F32 [1, n_batch/n_stream, n_head, n_stream]
+
     // note: these have to be copies because in order to be able to reuse a graph, its inputs
     //       need to carry these parameters with them. otherwise, they can point to freed
     //       llm_graph_params from a previous batch, causing stack-use-after-return
@@ -467,6 +478,12 @@ struct llm_graph_params {
     }
 };
 
+// experts selected by the router of a MoE layer and the expert weights they index
+struct llm_graph_moe_sel {
+    ggml_tensor * ids;     // I32 [n_expert_used, n_tokens]
+    ggml_tensor * exps[3]; // up, gate and down experts, can be null
+};
+
 class llm_graph_result {
 public:
     llm_graph_result(int64_t max_nodes);
@@ -487,6 +504,9 @@ public:
 
     void set_inputs(const llama_ubatch * ubatch);
 
+    // to call after the graph is computed
+    void get_outputs(ggml_backend_sched_t sched) const;
+
     // try to update the existing graph result using the new graph parameters in order to reuse it
     // this can only be done if we determine that the resulting graph using the new graph parameters
     //   would be identical to the existing graph. in that case, we simply have to update the memory
@@ -504,6 +524,9 @@ public:
     ggml_tensor * t_embd        = nullptr;
     ggml_tensor * t_embd_pooled = nullptr;
 
+    // only with n_moe_hot > 0
+    std::vector<llm_graph_moe_sel> t_moe_sel;
+
     std::vector<llm_graph_input_ptr> inputs;
 
     ggml_context_ptr ctx_compute;
@@ -701,7 +724,8 @@ struct llm_graph_context {
             ggml_tensor * sinks,   // [n_head_q]
             ggml_tensor * v_mla,   // [n_embd_head_v_mla, n_embd_head_v, n_head_v]
                   float   kq_scale,
-                    int   il) const;
+                    int   il,
+            ggml_tensor ** kq_soft_max = nullptr) const; // [n_kv, n_tokens, n_head, n_stream], not computed with flash attention
 
     llm_graph_input_attn_no_cache * build_attn_inp_no_cache() const;
 
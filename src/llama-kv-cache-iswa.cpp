@@ -19,12 +19,15 @@ llama_kv_cache_iswa::llama_kv_cache_iswa(
                      bool   offload,
                      bool   swa_full,
                      bool   unified,
+                     bool   paged,
+                 uint32_t   n_sink,
                  uint32_t   kv_size,
                  uint32_t   n_seq_max,
                  uint32_t   n_ubatch,
                  uint32_t   n_pad,
     const layer_filter_cb & filter,
-    const  layer_reuse_cb & reuse) : hparams(model.hparams), unified(unified) {
+    const  layer_reuse_cb & reuse,
+    const   layer_type_cb & types) : hparams(model.hparams), unified(unified) {
 
     // chain filters
     const layer_filter_cb filter_base = [&](int32_t il) {
@@ -59,15 +62,15 @@ llama_kv_cache_iswa::llama_kv_cache_iswa(
 
     kv_base = std::make_unique<llama_kv_cache>(
             model, type_k, type_v,
-            v_trans, offload, unified, size_base, n_seq_max, n_pad,
-            0, LLAMA_SWA_TYPE_NONE, filter_base, reuse);
+            v_trans, offload, unified, paged, n_sink, 0, size_base, n_seq_max, n_pad,
+            0, LLAMA_SWA_TYPE_NONE, filter_base, reuse, types);
 
     LLAMA_LOG_INFO("%s: creating     SWA KV cache, size = %u cells\n", __func__, size_swa);
 
     kv_swa = std::make_unique<llama_kv_cache>(
             model, type_k, type_v,
-            v_trans, offload, unified, size_swa, n_seq_max, n_pad,
-            hparams.n_swa, hparams.swa_type, filter_swa, reuse);
+            v_trans, offload, unified, false, 0, 0, size_swa, n_seq_max, n_pad,
+            hparams.n_swa, hparams.swa_type, filter_swa, reuse, types);
 }
 
 void llama_kv_cache_iswa::clear(bool data) {
@@ -215,10 +218,19 @@ llama_memory_context_ptr llama_kv_cache_iswa::init_update(llama_context * lctx,
     return std::make_unique<llama_kv_cache_iswa_context>(this, lctx, optimize);
 }
 
+void llama_kv_cache_iswa::evict(const llama_batch_allocr & balloc) {
+    kv_base->evict(balloc);
+    kv_swa ->evict(balloc);
+}
+
 bool llama_kv_cache_iswa::get_can_shift() const {
     return kv_base->get_size() == kv_swa->get_size();
 }
 
+bool llama_kv_cache_iswa::get_can_evict() const {
+    return kv_base->get_can_evict();
+}
+
 void llama_kv_cache_iswa::state_write(llama_io_write_i & io, llama_seq_id seq_id, llama_state_seq_flags flags) const {
     if ((flags & LLAMA_STATE_SEQ_FLAGS_PARTIAL_ONLY) == 0) {
         kv_base->state_write(io, seq_id, flags);
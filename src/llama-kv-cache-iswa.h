@@ -21,12 +21,15 @@ public:
                          bool   offload,
                          bool   swa_full,
                          bool   unified,
+                         bool   paged,
+                     uint32_t   n_sink,
                      uint32_t   kv_size,
                      uint32_t   n_seq_max,
                      uint32_t   n_ubatch,
                      uint32_t   n_pad,
         const layer_filter_cb & filter,
-        const  layer_reuse_cb & reuse);
+        const  layer_reuse_cb & reuse,
+        const   layer_type_cb & types);
 
     ~llama_kv_cache_iswa() = default;
 
@@ -43,7 +46,10 @@ public:
 
     llama_memory_context_ptr init_update(llama_context * lctx, bool optimize) override;
 
+    void evict(const llama_batch_allocr & balloc) override;
+
     bool get_can_shift() const override;
+    bool get_can_evict() const override;
 
     void clear(bool data) override;
 
@@ -2,9 +2,12 @@
 
 #include "llama-impl.h"
 #include "llama-io.h"
+#include "llama-mmap.h"
 #include "llama-model.h"
 #include "llama-context.h"
 
+#include "ggml-alloc.h"
+
 #include <algorithm>
 #include <cassert>
 #include <cmath>
@@ -23,17 +26,23 @@ llama_kv_cache::llama_kv_cache(
                      bool   v_trans,
                      bool   offload,
                      bool   unified,
+                     bool   paged,
+                 uint32_t   n_sink,
+                 uint32_t   n_budget,
                  uint32_t   kv_size,
                  uint32_t   n_seq_max,
                  uint32_t   n_pad,
                  uint32_t   n_swa,
            llama_swa_type   swa_type,
     const layer_filter_cb & filter,
-    const  layer_reuse_cb & reuse) :
+    const  layer_reuse_cb & reuse,
+    const   layer_type_cb & types) :
     model(model), hparams(model.hparams), v_trans(v_trans),
-    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), swa_type(swa_type) {
+    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), swa_type(swa_type),
+    paged(paged), n_sink(n_sink), n_budget(n_budget) {
 
     GGML_ASSERT(kv_size % n_pad == 0);
+    GGML_ASSERT(!paged || (n_stream == 1 && swa_type == LLAMA_SWA_TYPE_NONE));
 
     const uint32_t n_layer_kv = hparams.n_layer_kv();
 
@@ -74,6 +83,27 @@ llama_kv_cache::llama_kv_cache(
         v_cells[s].resize(kv_size);
     }
 
+    if (n_sink > 0 || n_budget > 0) {
+        n_ctx_seq = n_stream > 1 ? kv_size : kv_size/n_seq_max;
+    }
+
+    if (n_sink > 0) {
+        if (2*n_sink > n_ctx_seq) {
+            throw std::runtime_error("the number of attention sinks must not exceed half of the context of a sequence");
+        }
+
+        LLAMA_LOG_INFO("%s: attention sinks = %u, the cells of a sequence are evicted beyond %u cells\n", __func__, n_sink, n_ctx_seq);
+    }
+
+    if (n_budget > 0) {
+        if (n_sink >= n_budget/2) {
+            throw std::runtime_error("the number of attention sinks must not exceed half of the KV budget of a sequence");
+        }
+
+        LLAMA_LOG_INFO("%s: KV budget = %u, the least attended cells of a sequence are evicted beyond %u cells\n", __func__,
+                n_budget, std::min(n_budget, n_ctx_seq));
+    }
+
     // by default, all sequence ids are mapped to the 0th stream
     seq_to_stream.resize(LLAMA_MAX_SEQ, 0);
 
@@ -116,15 +146,25 @@ llama_kv_cache::llama_kv_cache(
             dev_name = ggml_backend_dev_name(dev);
         }
 
-        LLAMA_LOG_DEBUG("%s: layer %3d: dev = %s\n", __func__, il, dev_name);
+        ggml_type type_k_l = type_k;
+        ggml_type type_v_l = type_v;
+
+        if (types) {
+            const auto t = types(il);
+
+            type_k_l = t.first;
+            type_v_l = t.second;
+        }
+
+        LLAMA_LOG_DEBUG("%s: layer %3d: dev = %s, K = %s, V = %s\n", __func__, il, dev_name, ggml_type_name(type_k_l), ggml_type_name(type_v_l));
 
         ggml_context * ctx = ctx_for_buft(buft);
         if (!ctx) {
             throw std::runtime_error("failed to create ggml context for kv cache");
         }
 
-        ggml_tensor * k = ggml_new_tensor_3d(ctx, type_k, n_embd_k_gqa, kv_size, n_stream);
-        ggml_tensor * v = ggml_new_tensor_3d(ctx, type_v, n_embd_v_gqa, kv_size, n_stream);
+        ggml_tensor * k = ggml_new_tensor_3d(ctx, type_k_l, n_embd_k_gqa, kv_size, n_stream);
+        ggml_tensor * v = ggml_new_tensor_3d(ctx, type_v_l, n_embd_v_gqa, kv_size, n_stream);
 
         ggml_format_name(k, "cache_k_l%d", il);
         ggml_format_name(v, "cache_v_l%d", il);
@@ -166,36 +206,126 @@ llama_kv_cache::llama_kv_cache(
         }
     }
 
+    if (paged) {
+        paged_seq_next.resize(LLAMA_MAX_SEQ, kv_size);
+        paged_dirty.resize((kv_size + paged_block_size - 1)/paged_block_size, false);
+    }
+
     // allocate tensors and initialize the buffers to avoid NaNs in the padding
     for (auto it : ctx_map) {
         auto * buft = it.first;
         auto * ctx  = it.second;
 
-        ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
-        if (!buf) {
-            throw std::runtime_error("failed to allocate buffer for kv cache");
+        ggml_backend_buffer_t buf = nullptr;
+
+        // paged mode: the host buffers are mapped on demand, the pages are committed when the cells are first written
+        if (paged && buft == ggml_backend_cpu_buffer_type()) {
+            const size_t alignment = ggml_backend_buft_get_alignment(buft);
+
+            size_t size = 0;
+            for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+                if (t->view_src == nullptr) {
+                    size += GGML_PAD(ggml_backend_buft_get_alloc_size(buft, t), alignment);
+                }
+            }
+
+            // note: the pool is accounted for by the OS as a whole by default, so that it fails here if it can not be backed
+            //       LLAMA_KV_PAGED_NORESERVE=1 allows overcommitting it, at the risk of being killed when the cells are written
+            const char * LLAMA_KV_PAGED_NORESERVE = getenv("LLAMA_KV_PAGED_NORESERVE");
+            const bool noreserve = LLAMA_KV_PAGED_NORESERVE && atoi(LLAMA_KV_PAGED_NORESERVE) != 0;
+
+            void * addr = llama_mem_map(size, noreserve);
+            if (addr) {
+                buf = ggml_backend_cpu_buffer_from_ptr(addr, size);
+                if (!buf) {
+                    llama_mem_unmap(addr, size);
+                    throw std::runtime_error("failed to create buffer for kv cache");
+                }
+
+                paged_maps[addr] = size;
+
+                ggml_tallocr talloc = ggml_tallocr_new(buf);
+
+                for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+                    if (t->view_src == nullptr && ggml_tallocr_alloc(&talloc, t) != GGML_STATUS_SUCCESS) {
+                        throw std::runtime_error("failed to allocate tensor for kv cache");
+                    }
+                }
+
+                for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+                    if (t->view_src != nullptr && ggml_backend_view_init(t) != GGML_STATUS_SUCCESS) {
+                        throw std::runtime_error("failed to initialize view for kv cache");
+                    }
+                }
+
+                for (const auto & layer : layers) {
+                    if (layer.k->buffer == buf) {
+                        paged_tensors.push_back(layer.k);
+                    }
+                    // note: the cells of the transposed V cache are not contiguous, the memory of its free blocks is kept
+                    if (layer.v->buffer == buf && !v_trans) {
+                        paged_tensors.push_back(layer.v);
+                    }
+                }
+
+                LLAMA_LOG_INFO("%s: %10s KV buffer size = %8.2f MiB (mapped on demand)\n", __func__, ggml_backend_buffer_name(buf), size/1024.0/1024.0);
+            }
         }
 
-        LLAMA_LOG_INFO("%s: %10s KV buffer size = %8.2f MiB\n", __func__, ggml_backend_buffer_name(buf), ggml_backend_buffer_get_size(buf)/1024.0/1024.0);
+        if (!buf) {
+            buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
+            if (!buf) {
+                throw std::runtime_error("failed to allocate buffer for kv cache");
+            }
+
+            LLAMA_LOG_INFO("%s: %10s KV buffer size = %8.2f MiB\n", __func__, ggml_backend_buffer_name(buf), ggml_backend_buffer_get_size(buf)/1024.0/1024.0);
+
+            ggml_backend_buffer_clear(buf, 0);
+        }
 
-        ggml_backend_buffer_clear(buf, 0);
         bufs.emplace_back(buf);
     }
 
+    if (paged) {
+        LLAMA_LOG_INFO("%s: paged, %zu blocks of %u cells\n", __func__, paged_dirty.size(), paged_block_size);
+    }
+
     {
         const size_t memory_size_k = size_k_bytes();
         const size_t memory_size_v = size_v_bytes();
 
+        // the layers can have different types
+        std::string name_k = layers.empty() ? ggml_type_name(type_k) : ggml_type_name(layers[0].k->type);
+        std::string name_v = layers.empty() ? ggml_type_name(type_v) : ggml_type_name(layers[0].v->type);
+
+        for (const auto & layer : layers) {
+            if (layer.k->type != layers[0].k->type) {
+                name_k = "mixed";
+            }
+            if (layer.v->type != layers[0].v->type) {
+                name_v = "mixed";
+            }
+        }
+
         LLAMA_LOG_INFO("%s: size = %7.2f MiB (%6u cells, %3d layers, %2u/%u seqs), K (%s): %7.2f MiB, V (%s): %7.2f MiB\n", __func__,
                 (float)(memory_size_k + memory_size_v) / (1024.0f * 1024.0f), kv_size, (int) layers.size(), n_seq_max, n_stream,
-                ggml_type_name(type_k), (float)memory_size_k / (1024.0f * 1024.0f),
-                ggml_type_name(type_v), (float)memory_size_v / (1024.0f * 1024.0f));
+                name_k.c_str(), (float)memory_size_k / (1024.0f * 1024.0f),
+                name_v.c_str(), (float)memory_size_v / (1024.0f * 1024.0f));
     }
 
     const char * LLAMA_KV_CACHE_DEBUG = getenv("LLAMA_KV_CACHE_DEBUG");
     debug = LLAMA_KV_CACHE_DEBUG ? atoi(LLAMA_KV_CACHE_DEBUG) : 0;
 }
 
+llama_kv_cache::~llama_kv_cache() {
+    // the buffers must be freed before their memory is unmapped
+    bufs.clear();
+
+    for (const auto & it : paged_maps) {
+        llama_mem_unmap(it.first, it.second);
+    }
+}
+
 void llama_kv_cache::clear(bool data) {
     for (uint32_t s = 0; s < n_stream; ++s) {
         v_cells[s].reset();
@@ -204,9 +334,19 @@ void llama_kv_cache::clear(bool data) {
 
     if (data) {
         for (auto & buf : bufs) {
-            ggml_backend_buffer_clear(buf.get(), 0);
+            // the mapped memory reads as zeros once it is returned to the OS
+            auto it = paged_maps.find(ggml_backend_buffer_get_base(buf.get()));
+            if (it != paged_maps.end()) {
+                llama_mem_discard(it->first, it->second);
+            } else {
+                ggml_backend_buffer_clear(buf.get(), 0);
+            }
         }
+
+        std::fill(paged_dirty.begin(), paged_dirty.end(), false);
     }
+
+    paged_release();
 }
 
 bool llama_kv_cache::seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
@@ -269,6 +409,8 @@ bool llama_kv_cache::seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
         }
     }
 
+    paged_release();
+
     return true;
 }
 
@@ -375,6 +517,8 @@ void llama_kv_cache::seq_keep(llama_seq_id seq_id) {
     if (new_head != cells.size() && new_head < head) {
         head = new_head;
     }
+
+    paged_release();
 }
 
 void llama_kv_cache::seq_add(llama_seq_id seq_id, llama_pos p0, llama_pos p1, llama_pos shift) {
@@ -536,6 +680,8 @@ llama_kv_cache::slot_info_vec_t llama_kv_cache::prepare(const std::vector<llama_
         std::vector<uint32_t> v_heads_old; // old positions of the heads, before placing the ubatch
 
         std::vector<llama_kv_cells> v_cells; // copy of the old cells, before placing the ubatch
+
+        std::vector<uint32_t> paged_seq_next_old; // old paged cursors of the sequences, before placing the ubatch
     };
 
     // remember the old state of the cells so we can restore it in the end
@@ -556,7 +702,7 @@ llama_kv_cache::slot_info_vec_t llama_kv_cache::prepare(const std::vector<llama_
 
         // store the old state of the cells in the recovery stack
         {
-            state_t state = { sinfo_new, v_heads, {} };
+            state_t state = { sinfo_new, v_heads, {}, paged_seq_next };
 
             for (uint32_t s = 0; s < sinfo_new.n_stream(); ++s) {
                 auto & cells = v_cells[sinfo_new.strm[s]];
@@ -584,6 +730,8 @@ llama_kv_cache::slot_info_vec_t llama_kv_cache::prepare(const std::vector<llama_
             cells.set(sinfo.idxs[s], it->v_cells[s]);
             head = it->v_heads_old[s];
         }
+
+        paged_seq_next = it->paged_seq_next_old;
     }
 
     if (!success) {
@@ -734,6 +882,10 @@ llama_kv_cache::slot_info llama_kv_cache::find_slot(const llama_ubatch & ubatch,
         }
     }
 
+    if (paged && !cont) {
+        return find_slot_paged(ubatch);
+    }
+
     uint32_t n_tokens = ubatch.n_tokens;
     uint32_t n_seqs   = 1;
 
@@ -865,6 +1017,278 @@ llama_kv_cache::slot_info llama_kv_cache::find_slot(const llama_ubatch & ubatch,
     return res;
 }
 
+llama_kv_cache::slot_info llama_kv_cache::find_slot_paged(const llama_ubatch & ubatch) const {
+    const auto & cells = v_cells[0];
+
+    const uint32_t n_tokens = ubatch.n_tokens;
+    const uint32_t n_blocks = paged_dirty.size();
+
+    if (n_tokens > cells.size()) {
+        LLAMA_LOG_ERROR("%s: n_tokens = %d > size = %u\n", __func__, n_tokens, cells.size());
+        return { };
+    }
+
+    slot_info res = {
+        /*.s0   =*/ 0,
+        /*.s1   =*/ 0,
+        /*.strm =*/ { 0 },
+        /*.idxs =*/ { { } },
+    };
+
+    res.idxs[0].reserve(n_tokens);
+
+    // the cells given to the previous tokens of the ubatch
+    std::vector<bool> taken(cells.size(), false);
+
+    auto is_free = [&](uint32_t idx) {
+        return cells.is_empty(idx) && !taken[idx];
+    };
+
+    // the cursors of the sequences, updated as the tokens of the ubatch are placed
+    std::map<llama_seq_id, uint32_t> seq_next;
+
+    // the first block that can be free, and the first cell that can be free when no block is free
+    uint32_t b_free   = 0;
+    uint32_t idx_free = 0;
+
+    for (uint32_t i = 0; i < n_tokens; ++i) {
+        const llama_seq_id seq_id = ubatch.seq_id[i][0];
+
+        auto it = seq_next.find(seq_id);
+
+        uint32_t idx = it != seq_next.end() ? it->second : paged_seq_next[seq_id];
+
+        // continue in the block of the sequence
+        if (idx < cells.size()) {
+            const uint32_t idx_end = std::min(cells.size(), (idx/paged_block_size + 1)*paged_block_size);
+
+            while (idx < idx_end && !is_free(idx)) {
+                idx++;
+            }
+
+            if (idx == idx_end) {
+                idx = cells.size();
+            }
+        }
+
+        // take the first free block
+        for (; idx == cells.size() && b_free < n_blocks; ++b_free) {
+            const uint32_t i0 = b_free*paged_block_size;
+            const uint32_t i1 = std::min(cells.size(), i0 + paged_block_size);
+
+            bool free = true;
+            for (uint32_t j = i0; j < i1 && free; ++j) {
+                free = is_free(j);
+            }
+
+            if (free) {
+                idx = i0;
+            }
+        }
+
+        // no free block left - use any free cell
+        for (; idx == cells.size() && idx_free < cells.size(); ++idx_free) {
+            if (is_free(idx_free)) {
+                idx = idx_free;
+            }
+        }
+
+        if (idx == cells.size()) {
+            return { };
+        }
+
+        taken[idx] = true;
+        res.idxs[0].push_back(idx);
+
+        seq_next[seq_id] = idx + 1;
+    }
+
+    return res;
+}
+
+void llama_kv_cache::evict(const llama_batch_allocr & balloc) {
+    if (n_sink == 0 && n_budget == 0) {
+        return;
+    }
+
+    const llama_batch & batch = balloc.get_batch();
+
+    // the number of tokens of each sequence in the batch
+    std::vector<uint32_t> n_new_seq(LLAMA_MAX_SEQ, 0);
+    for (int32_t i = 0; i < batch.n_tokens; ++i) {
+        for (int32_t j = 0; j < batch.n_seq_id[i]; ++j) {
+            n_new_seq[batch.seq_id[i][j]]++;
+        }
+    }
+
+    for (llama_seq_id seq_id = 0; seq_id < LLAMA_MAX_SEQ; ++seq_id) {
+        const uint32_t n_new = n_new_seq[seq_id];
+        if (n_new == 0) {
+            continue;
+        }
+
+        const auto & cells = v_cells[seq_to_stream[seq_id]];
+
+        // the last position of the sequence in the batch
+        const llama_pos p1_new = balloc.seq_pos_max(seq_id);
+
+        if (n_budget > 0) {
+            evict_budget(seq_id, n_new);
+        }
+
+        if (n_sink == 0) {
+            continue;
+        }
+
+        const llama_pos p0 = cells.seq_pos_min(seq_id);
+        if (p0 < 0) {
+            continue;
+        }
+
+        // the last position of the sequence after the ubatch
+        const llama_pos p1 = std::max(cells.seq_pos_max(seq_id), p1_new);
+
+        if (p1 - p0 + 1 <= (llama_pos) n_ctx_seq) {
+            continue;
+        }
+
+        const uint32_t n_win = n_ctx_seq - n_sink;
+
+        // evict a few more cells than needed, so that the sinks are not moved for every token
+        const llama_pos p_sink = p0 + n_sink;
+        const llama_pos p_win  = std::min(p1 + 1 - (llama_pos) n_win + (llama_pos) std::min(64u, n_win/4), cells.seq_pos_max(seq_id) + 1);
+
+        if (p_win <= p_sink) {
+            continue;
+        }
+
+        LLAMA_LOG_DEBUG("%s: evicting positions [%d, %d) of sequence %d\n", __func__, p_sink, p_win, seq_id);
+
+        seq_rm(seq_id, p_sink, p_win);
+
+        // the cells of the sinks that are shared with other sequences cannot be moved
+        bool shared = false;
+        for (uint32_t i = 0; i < cells.size() && !shared; ++i) {
+            shared = cells.pos_in(i, p0, p_sink) && cells.seq_has(i, seq_id) && cells.seq_count(i) > 1;
+        }
+
+        // the K-shift of the sinks is applied by the update of the memory that follows, before the batch
+        if (!shared) {
+            seq_add(seq_id, p0, p_sink, p_win - p_sink);
+        }
+    }
+}
+
+void llama_kv_cache::evict_budget(llama_seq_id seq_id, uint32_t n_new) {
+    auto & cells = v_cells[seq_to_stream[seq_id]];
+    auto & head  = v_heads[seq_to_stream[seq_id]];
+
+    const uint32_t n_max = std::min(n_budget, n_ctx_seq);
+
+    const llama_pos p0 = cells.seq_pos_min(seq_id);
+    const llama_pos p1 = cells.seq_pos_max(seq_id);
+    if (p0 < 0) {
+        return;
+    }
+
+    // the cells of the sequence that can be evicted:
+    //  - the attention sinks at the start of the sequence are kept
+    //  - the most recent cells are kept, they have not been attended by enough tokens yet for their scores to be meaningful
+    const llama_pos p_sink   = p0 + n_sink;
+    const llama_pos p_recent = p1 + 1 - (llama_pos) (n_max/2);
+
+    uint32_t n_cells = 0;
+
+    std::vector<uint32_t> idxs;
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        if (cells.is_empty(i) || !cells.seq_has(i, seq_id)) {
+            continue;
+        }
+
+        n_cells++;
+
+        if (cells.pos_in(i, p_sink, p_recent)) {
+            idxs.push_back(i);
+        }
+    }
+
+    if (n_cells + n_new <= n_max) {
+        return;
+    }
+
+    // evict a few more cells than needed, so that the cells are not sorted for every token
+    const uint32_t n_evict = std::min<uint32_t>(idxs.size(), n_cells + n_new - n_max + std::min(16u, n_max/16));
+    if (n_evict == 0) {
+        return;
+    }
+
+    // the least attended cells first, and the oldest ones first for equal scores (e.g. with flash attention)
+    std::nth_element(idxs.begin(), idxs.begin() + (n_evict - 1), idxs.end(), [&](uint32_t a, uint32_t b) {
+        const float sa = cells.score_get(a);
+        const float sb = cells.score_get(b);
+
+        return sa < sb || (sa == sb && cells.pos_get(a) < cells.pos_get(b));
+    });
+
+    LLAMA_LOG_DEBUG("%s: evicting %u of the %u cells of sequence %d\n", __func__, n_evict, n_cells, seq_id);
+
+    uint32_t new_head = cells.size();
+
+    for (uint32_t k = 0; k < n_evict; ++k) {
+        const uint32_t i = idxs[k];
+
+        if (cells.seq_rm(i, seq_id)) {
+            new_head = std::min(new_head, i);
+        }
+    }
+
+    if (new_head != cells.size() && new_head < head) {
+        head = new_head;
+    }
+
+    paged_release();
+}
+
+void llama_kv_cache::paged_release() {
+    if (paged_tensors.empty()) {
+        return;
+    }
+
+    const auto & cells = v_cells[0];
+
+    uint32_t n_released = 0;
+
+    for (uint32_t b = 0; b < paged_dirty.size(); ++b) {
+        if (!paged_dirty[b]) {
+            continue;
+        }
+
+        const uint32_t i0 = b*paged_block_size;
+        const uint32_t i1 = std::min(cells.size(), i0 + paged_block_size);
+
+        bool free = true;
+        for (uint32_t i = i0; i < i1 && free; ++i) {
+            free = cells.is_empty(i);
+        }
+
+        if (!free) {
+            continue;
+        }
+
+        for (ggml_tensor * t : paged_tensors) {
+            llama_mem_discard((char *) t->data + i0*t->nb[1], (i1 - i0)*t->nb[1]);
+        }
+
+        paged_dirty[b] = false;
+
+        n_released++;
+    }
+
+    if (n_released > 0) {
+        LLAMA_LOG_DEBUG("%s: released the memory of %u blocks\n", __func__, n_released);
+    }
+}
+
 void llama_kv_cache::apply_ubatch(const slot_info & sinfo, const llama_ubatch & ubatch) {
     // keep track of the max sequence position that we would overwrite with this ubatch
     // for non-SWA cache, this would be always empty
@@ -899,6 +1323,11 @@ void llama_kv_cache::apply_ubatch(const slot_info & sinfo, const llama_ubatch &
             for (int32_t s = 0; s < ubatch.n_seq_id[i]; s++) {
                 cells.seq_add(idx, ubatch.seq_id[i][s]);
             }
+
+            if (paged) {
+                paged_seq_next[ubatch.seq_id[i][0]] = idx + 1;
+                paged_dirty[idx/paged_block_size] = true;
+            }
         }
     }
 
@@ -930,6 +1359,10 @@ void llama_kv_cache::apply_ubatch(const slot_info & sinfo, const llama_ubatch &
     }
 }
 
+bool llama_kv_cache::get_can_evict() const {
+    return n_sink > 0 || n_budget > 0;
+}
+
 bool llama_kv_cache::get_can_shift() const {
     return true;
 }
@@ -1184,16 +1617,46 @@ void llama_kv_cache::set_input_v_idxs(ggml_tensor * dst, const llama_ubatch * ub
     }
 }
 
+std::pair<uint32_t, uint32_t> llama_kv_cache::get_shift_range() const {
+    uint32_t i0 = get_size()*n_stream;
+    uint32_t i1 = 0;
+
+    for (uint32_t s = 0; s < n_stream; ++s) {
+        const auto & cells = v_cells[s];
+
+        for (uint32_t i = 0; i < cells.size(); ++i) {
+            if (!cells.is_empty(i) && cells.get_shift(i) != 0) {
+                i0 = std::min(i0, s*cells.size() + i);
+                i1 = std::max(i1, s*cells.size() + i + 1);
+            }
+        }
+    }
+
+    if (i1 <= i0) {
+        return { 0, 1 };
+    }
+
+    return { i0, i1 };
+}
+
 void llama_kv_cache::set_input_k_shift(ggml_tensor * dst) const {
     GGML_ASSERT(ggml_backend_buffer_is_host(dst->buffer));
 
     int32_t * data = (int32_t *) dst->data;
 
+    const auto range = get_shift_range();
+
+    GGML_ASSERT(dst->ne[0] == range.second - range.first);
+
     for (uint32_t s = 0; s < n_stream; ++s) {
         const auto & cells = v_cells[s];
 
         for (uint32_t i = 0; i < cells.size(); ++i) {
-            data[s*cells.size() + i] = cells.is_empty(i) ? 0 : cells.get_shift(i);
+            const uint32_t j = s*cells.size() + i;
+
+            if (j >= range.first && j < range.second) {
+                data[j - range.first] = cells.is_empty(i) ? 0 : cells.get_shift(i);
+            }
         }
     }
 }
@@ -1295,6 +1758,24 @@ void llama_kv_cache::set_input_pos_bucket(ggml_tensor * dst, const llama_ubatch
     }
 }
 
+bool llama_kv_cache::get_has_score() const {
+    return n_budget > 0;
+}
+
+void llama_kv_cache::score_add(const float * score, uint32_t n_kv, const slot_info & sinfo) {
+    for (uint32_t s = sinfo.s0; s <= sinfo.s1; ++s) {
+        auto & cells = v_cells[s];
+
+        const float * row = score + (s - sinfo.s0)*n_kv;
+
+        for (uint32_t j = 0; j < n_kv; ++j) {
+            if (!cells.is_empty(j)) {
+                cells.score_add(j, row[j]);
+            }
+        }
+    }
+}
+
 size_t llama_kv_cache::total_size() const {
     size_t size = 0;
 
@@ -1404,7 +1885,10 @@ ggml_cgraph * llama_kv_cache::build_graph_shift(llm_graph_result * res, llama_co
 
     auto inp = std::make_unique<llm_graph_input_k_shift>(this);
 
-    inp->k_shift = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, (int64_t) get_size()*n_stream);
+    // only the cells with a pending shift are rotated, e.g. the attention sinks after an eviction
+    const auto range = get_shift_range();
+
+    inp->k_shift = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, (int64_t) (range.second - range.first));
     ggml_set_input(inp->k_shift);
 
     const auto & cparams = lctx->get_cparams();
@@ -1422,10 +1906,10 @@ ggml_cgraph * llama_kv_cache::build_graph_shift(llm_graph_result * res, llama_co
 
         ggml_tensor * k =
             ggml_view_3d(ctx, layer.k,
-                n_embd_head_k, n_head_kv, get_size()*n_stream,
+                n_embd_head_k, n_head_kv, range.second - range.first,
                 ggml_row_size(layer.k->type, n_embd_head_k),
                 ggml_row_size(layer.k->type, n_embd_k_gqa),
-                0);
+                ggml_row_size(layer.k->type, n_embd_k_gqa)*range.first);
 
         ggml_tensor * cur = build_rope_shift(cparams, ctx, k, inp->k_shift, rope_factors, freq_base_l, freq_scale_l);
 
@@ -1722,6 +2206,11 @@ bool llama_kv_cache::state_read_meta(llama_io_read_i & io, uint32_t strm, uint32
 
         clear(true);
 
+        // the data of the cells is read in state_read_data()
+        if (paged) {
+            std::fill(paged_dirty.begin(), paged_dirty.begin() + (cell_count + paged_block_size - 1)/paged_block_size, true);
+        }
+
         for (uint32_t i = 0; i < cell_count; ++i) {
             llama_pos pos;
             uint32_t  n_seq_id;
@@ -2011,6 +2500,14 @@ void llama_kv_cache_context::set_input_pos_bucket(ggml_tensor * dst, const llama
     kv->set_input_pos_bucket(dst, ubatch);
 }
 
+bool llama_kv_cache_context::get_has_score() const {
+    return kv->get_has_score();
+}
+
+void llama_kv_cache_context::score_add(const float * score) const {
+    kv->score_add(score, n_kv, sinfos[i_cur]);
+}
+
 uint32_t llama_kv_cache::get_padding(const llama_cparams & cparams) {
     // the FA kernels require padding to avoid extra runtime boundary checks
     return cparams.flash_attn ? 256u : 32u;
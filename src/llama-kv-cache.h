@@ -5,6 +5,7 @@
 #include "llama-kv-cells.h"
 #include "llama-memory.h"
 
+#include <map>
 #include <unordered_map>
 #include <vector>
 
@@ -85,15 +86,19 @@ public:
                          bool   v_trans,
                          bool   offload,
                          bool   unified,
+                         bool   paged,
+                     uint32_t   n_sink,
+                     uint32_t   n_budget,
                      uint32_t   kv_size,
                      uint32_t   n_seq_max,
                      uint32_t   n_pad,
                      uint32_t   n_swa,
                llama_swa_type   swa_type,
         const layer_filter_cb & filter,
-        const  layer_reuse_cb & reuse);
+        const  layer_reuse_cb & reuse,
+        const   layer_type_cb & types);
 
-    ~llama_kv_cache() = default;
+    ~llama_kv_cache();
 
     //
     // llama_memory_i
@@ -108,7 +113,10 @@ public:
 
     llama_memory_context_ptr init_update(llama_context * lctx, bool optimize) override;
 
+    void evict(const llama_batch_allocr & balloc) override;
+
     bool get_can_shift() const override;
+    bool get_can_evict() const override;
 
     void clear(bool data) override;
 
@@ -166,6 +174,11 @@ public:
     // return empty slot_info on failure
     slot_info find_slot(const llama_ubatch & ubatch, bool cont) const;
 
+    // paged mode: the tokens of each sequence go to the block of cells that the sequence is filling,
+    // and a sequence takes the first free block of the cache when its block is full
+    // return empty slot_info on failure
+    slot_info find_slot_paged(const llama_ubatch & ubatch) const;
+
     // emplace the ubatch context into slot: [sinfo.idxs[0...ubatch.n_tokens - 1]]
     void apply_ubatch(const slot_info & sinfo, const llama_ubatch & ubatch);
 
@@ -184,6 +197,17 @@ public:
     void set_input_kq_mask   (ggml_tensor * dst, const llama_ubatch * ubatch, bool causal_attn) const;
     void set_input_pos_bucket(ggml_tensor * dst, const llama_ubatch * ubatch) const;
 
+    //
+    // output API
+    //
+
+    // true if the graph should compute the attention received by the cells (see llm_graph_result::t_kv_score)
+    bool get_has_score() const;
+
+    // accumulate the attention received by the cells of the views of the ubatch
+    //   - score [n_kv, ns] with ns = sinfo.s1 - sinfo.s0 + 1
+    void score_add(const float * score, uint32_t n_kv, const slot_info & sinfo);
+
 private:
     const llama_model & model;
     const llama_hparams & hparams;
@@ -226,6 +250,45 @@ private:
 
     std::vector<llama_kv_cells> v_cells;
 
+    // paged mode: the cells are split in blocks of paged_block_size cells that are owned by the sequences
+    // a single stream is used, and the cells of a block are not shared with the other sequences unless the cache is full
+    // note: the attention still runs over [0, n_kv), allocating the blocks from the start of the cache keeps n_kv small
+    static constexpr uint32_t paged_block_size = 256;
+
+    const bool paged = false;
+
+    // the cell after the last one placed for each sequence (see find_slot_paged())
+    std::vector<uint32_t> paged_seq_next;
+
+    // the tensors in host memory that is mapped on demand - the rows of the free blocks are returned to the OS
+    std::vector<ggml_tensor *> paged_tensors;
+
+    // the blocks that were written since their rows were last returned to the OS
+    std::vector<bool> paged_dirty;
+
+    // address -> size of the memory mappings of the buffers
+    std::map<void *, size_t> paged_maps;
+
+    // return the rows of the free dirty blocks to the OS
+    void paged_release();
+
+    // attention sinks: when a sequence exceeds n_ctx_seq cells, its oldest cells are evicted except for the first n_sink ones,
+    // which are moved next to the remaining cells so that the distance between the tokens and the sinks stays bounded
+    const uint32_t n_sink = 0;
+
+    // heavy hitters: when a sequence has more than n_budget cells, the cells that received the least attention are evicted,
+    // except for the most recent ones. the positions of the remaining cells are not changed
+    const uint32_t n_budget = 0;
+
+    // the number of cells that a sequence can use before its cells are evicted
+    uint32_t n_ctx_seq = 0;
+
+    // evict the least attended cells of a sequence so that n_new more cells fit in its budget
+    void evict_budget(llama_seq_id seq_id, uint32_t n_new);
+
+    // the range [first, second) of the cells of all streams that have a pending shift
+    std::pair<uint32_t, uint32_t> get_shift_range() const;
+
     // maps from a sequence id to a stream id
     std::vector<uint32_t> seq_to_stream;
 
@@ -340,6 +403,11 @@ public:
     void set_input_kq_mask   (ggml_tensor * dst, const llama_ubatch * ubatch, bool causal_attn) const;
     void set_input_pos_bucket(ggml_tensor * dst, const llama_ubatch * ubatch) const;
 
+    bool get_has_score() const;
+
+    // score [n_kv, ns] - the attention received by the cells of the current ubatch, summed over the heads and the layers
+    void score_add(const float * score) const;
+
 private:
     llama_memory_status status;
 
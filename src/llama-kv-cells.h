@@ -17,6 +17,7 @@ public:
         for (uint32_t i = 0; i < pos.size(); ++i) {
             pos[i]   = -1;
             shift[i] =  0;
+            score[i] =  0.0f;
             seq[i].reset();
         }
 
@@ -44,6 +45,7 @@ public:
     void resize(uint32_t n) {
         pos.resize(n);
         shift.resize(n);
+        score.resize(n);
         seq.resize(n);
 
         reset();
@@ -107,8 +109,9 @@ public:
         for (uint32_t j = 0; j < n; ++j) {
             const auto idx = i + j;
 
-            res.pos[j] = pos[idx];
-            res.seq[j] = seq[idx];
+            res.pos  [j] = pos  [idx];
+            res.seq  [j] = seq  [idx];
+            res.score[j] = score[idx];
 
             assert(shift[idx] == 0);
         }
@@ -125,8 +128,9 @@ public:
         for (uint32_t j = 0; j < idxs.size(); ++j) {
             const auto idx = idxs[j];
 
-            res.pos[j] = pos[idx];
-            res.seq[j] = seq[idx];
+            res.pos  [j] = pos  [idx];
+            res.seq  [j] = seq  [idx];
+            res.score[j] = score[idx];
 
             assert(shift[idx] == 0);
         }
@@ -153,8 +157,9 @@ public:
                 seq_pos_rm(i + j);
             }
 
-            pos[idx] = other.pos[j];
-            seq[idx] = other.seq[j];
+            pos  [idx] = other.pos  [j];
+            seq  [idx] = other.seq  [j];
+            score[idx] = other.score[j];
 
             if (pos[idx] != -1) {
                 seq_pos_add(i + j);
@@ -183,8 +188,9 @@ public:
                 seq_pos_rm(idx);
             }
 
-            pos[idx] = other.pos[j];
-            seq[idx] = other.seq[j];
+            pos  [idx] = other.pos  [j];
+            seq  [idx] = other.seq  [j];
+            score[idx] = other.score[j];
 
             if (pos[idx] != -1) {
                 seq_pos_add(idx);
@@ -348,6 +354,21 @@ public:
         return shift[i];
     }
 
+    // the attention received by the cell since it was set (see llama_kv_cache::score_add())
+    // note: call only if the cell is not empty
+    float score_get(uint32_t i) const {
+        assert(i < pos.size());
+        assert(pos[i] != -1);
+
+        return score[i];
+    }
+
+    void score_add(uint32_t i, float v) {
+        assert(i < pos.size());
+
+        score[i] += v;
+    }
+
     // check if a cell is not empty and its position is within [p0, p1)
     bool pos_in(uint32_t i, llama_pos p0, llama_pos p1) const {
         assert(i < pos.size());
@@ -363,7 +384,8 @@ public:
         assert(pos[i] == -1);
         assert(seq[i].none());
 
-        pos[i] = p;
+        pos[i]   = p;
+        score[i] = 0.0f;
 
         used.insert(i);
     }
@@ -441,6 +463,10 @@ private:
     //
     std::vector<llama_pos> shift;
 
+    // the accumulated attention probabilities of the cell over all heads, layers and tokens that attended it
+    // this is used to evict the least attended cells first when a sequence exceeds its budget of cells
+    std::vector<float> score;
+
     using seq_set_t = std::bitset<LLAMA_MAX_SEQ>;
 
     // the bitset seq[i] tells us which sequences are currently occupying the i-th cell
@@ -28,7 +28,9 @@ llama_memory_hybrid::llama_memory_hybrid(
                      bool   unified,
                             /* layer filters */
     const layer_filter_cb & filter_attn,
-    const layer_filter_cb & filter_recr) :
+    const layer_filter_cb & filter_recr,
+                            /* attn types */
+    const   layer_type_cb & types_attn) :
     hparams(model.hparams),
     mem_attn(new llama_kv_cache(
         model,
@@ -37,6 +39,9 @@ llama_memory_hybrid::llama_memory_hybrid(
         v_trans,
         offload,
         unified,
+        false,
+        0,
+        0,
         kv_size,
         n_seq_max,
         n_pad,
@@ -45,7 +50,8 @@ llama_memory_hybrid::llama_memory_hybrid(
         filter_attn == nullptr ?
             [&](int32_t il) { return !hparams.is_recurrent(il); }
             : filter_attn,
-        nullptr
+        nullptr,
+        types_attn
     )),
     mem_recr(new llama_memory_recurrent(
         model,
@@ -119,11 +125,19 @@ llama_memory_context_ptr llama_memory_hybrid::init_update(llama_context * lctx,
     return std::make_unique<llama_memory_hybrid_context>(this, lctx, optimize);
 }
 
+void llama_memory_hybrid::evict(const llama_batch_allocr & balloc) {
+    mem_attn->evict(balloc);
+}
+
 bool llama_memory_hybrid::get_can_shift() const {
     // Shifting is trivially supported for recurrent
     return mem_attn->get_can_shift();
 }
 
+bool llama_memory_hybrid::get_can_evict() const {
+    return mem_attn->get_can_evict();
+}
+
 void llama_memory_hybrid::clear(bool data) {
     mem_attn->clear(data);
     mem_recr->clear(data);
@@ -38,7 +38,9 @@ public:
                      bool   unified,
                             /* layer filters */
     const layer_filter_cb & filter_attn = nullptr,
-    const layer_filter_cb & filter_recr = nullptr);
+    const layer_filter_cb & filter_recr = nullptr,
+                            /* attn types */
+    const   layer_type_cb & types_attn  = nullptr);
 
     ~llama_memory_hybrid() = default;
 
@@ -55,7 +57,10 @@ public:
 
     llama_memory_context_ptr init_update(llama_context * lctx, bool optimize) override;
 
+    void evict(const llama_batch_allocr & balloc) override;
+
     bool get_can_shift() const override;
+    bool get_can_evict() const override;
 
     void clear(bool data) override;
 
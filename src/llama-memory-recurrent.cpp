@@ -420,6 +420,10 @@ llama_memory_context_ptr llama_memory_recurrent::init_update(llama_context * lct
     return std::make_unique<llama_memory_recurrent_context>(LLAMA_MEMORY_STATUS_NO_UPDATE);
 }
 
+void llama_memory_recurrent::evict(const llama_batch_allocr & balloc) {
+    GGML_UNUSED(balloc);
+}
+
 bool llama_memory_recurrent::prepare(const std::vector<llama_ubatch> & ubatches) {
     // simply remember the full state because it is very small for this type of cache
     // TODO: optimize
@@ -660,6 +664,10 @@ bool llama_memory_recurrent::get_can_shift() const {
     return true;
 }
 
+bool llama_memory_recurrent::get_can_evict() const {
+    return false;
+}
+
 size_t llama_memory_recurrent::total_size() const {
     size_t size = 0;
     for (const auto & buf : bufs) {
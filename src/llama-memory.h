@@ -20,6 +20,9 @@ struct llama_memory_params {
 
     // use full-size SWA cache
     bool swa_full;
+
+    // per-layer kv cache types (K, V), override type_k and type_v
+    std::map<int32_t, std::pair<ggml_type, ggml_type>> type_kv_layer;
 };
 
 enum llama_memory_status {
@@ -73,6 +76,9 @@ struct llama_memory_i {
     // return negative value to indicate that the layer il should not reuse memory
     using layer_reuse_cb = std::function<int32_t(int32_t il)>;
 
+    // this callback is used to specify the data types of the K and V cache of each layer
+    using layer_type_cb = std::function<std::pair<ggml_type, ggml_type>(int32_t il)>;
+
     virtual ~llama_memory_i() = default;
 
     // split the input batch into a set of ubatches and verify that they can fit into the cache
@@ -90,8 +96,13 @@ struct llama_memory_i {
     // status == LLAMA_MEMORY_STATUS_NO_UPDATE if there is nothing to update
     virtual llama_memory_context_ptr init_update(llama_context * lctx, bool optimize) = 0;
 
+    // make room for the tokens of the batch by evicting the old or least attended cells of its sequences, if the memory
+    // is configured to do so. called before the pending updates, so that the shifts it adds are applied before the batch
+    virtual void evict(const llama_batch_allocr & balloc) = 0;
+
     // getters
     virtual bool get_can_shift() const = 0;
+    virtual bool get_can_evict() const = 0;
 
     //
     // ops
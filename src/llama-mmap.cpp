@@ -595,6 +595,139 @@ const bool llama_mlock::SUPPORTED = true;
 const bool llama_mlock::SUPPORTED = false;
 #endif
 
+// memory range hints
+
+#if defined(_POSIX_MAPPED_FILES)
+static bool llama_mem_page_range(void *& addr, size_t & size) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    const uintptr_t first = ((uintptr_t) addr + page_size - 1) & ~(uintptr_t) (page_size - 1);
+    const uintptr_t last  = ((uintptr_t) addr + size)          & ~(uintptr_t) (page_size - 1);
+
+    if (last <= first) {
+        return false;
+    }
+
+    addr = (void *) first;
+    size = last - first;
+
+    return true;
+}
+#endif
+
+bool llama_mem_lock(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES) && defined(_POSIX_MEMLOCK_RANGE)
+    if (!llama_mem_page_range(addr, size)) {
+        return true;
+    }
+    if (mlock(addr, size)) {
+        LLAMA_LOG_WARN("warning: failed to mlock %zu-byte range: %s\n", size, strerror(errno));
+        return false;
+    }
+    return true;
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+    return false;
+#endif
+}
+
+void llama_mem_unlock(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES) && defined(_POSIX_MEMLOCK_RANGE)
+    if (!llama_mem_page_range(addr, size)) {
+        return;
+    }
+    if (munlock(addr, size)) {
+        LLAMA_LOG_WARN("warning: failed to munlock %zu-byte range: %s\n", size, strerror(errno));
+    }
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+#endif
+}
+
+void llama_mem_prefetch(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES)
+    if (!llama_mem_page_range(addr, size)) {
+        return;
+    }
+    if (int err = posix_madvise(addr, size, POSIX_MADV_WILLNEED)) {
+        LLAMA_LOG_DEBUG("%s: posix_madvise(.., POSIX_MADV_WILLNEED) failed: %s\n", __func__, strerror(err));
+    }
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+#endif
+}
+
+void llama_mem_release(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES)
+    if (!llama_mem_page_range(addr, size)) {
+        return;
+    }
+#if defined(MADV_COLD)
+    // note: unlike MADV_DONTNEED, this keeps the content of the anonymous pages (e.g. repacked weights)
+    if (madvise(addr, size, MADV_COLD)) {
+        LLAMA_LOG_DEBUG("%s: madvise(.., MADV_COLD) failed: %s\n", __func__, strerror(errno));
+    }
+#else
+    if (int err = posix_madvise(addr, size, POSIX_MADV_DONTNEED)) {
+        LLAMA_LOG_DEBUG("%s: posix_madvise(.., POSIX_MADV_DONTNEED) failed: %s\n", __func__, strerror(err));
+    }
+#endif
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+#endif
+}
+
+// anonymous memory
+
+void * llama_mem_map(size_t size, bool noreserve) {
+#if defined(_POSIX_MAPPED_FILES) && defined(__linux__)
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (noreserve) {
+        flags |= MAP_NORESERVE;
+    }
+    void * addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+        LLAMA_LOG_WARN("warning: failed to map %zu bytes of anonymous memory: %s\n", size, strerror(errno));
+        return nullptr;
+    }
+    return addr;
+#else
+    GGML_UNUSED(size);
+    GGML_UNUSED(noreserve);
+    return nullptr;
+#endif
+}
+
+void llama_mem_unmap(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES) && defined(__linux__)
+    if (munmap(addr, size)) {
+        LLAMA_LOG_WARN("warning: munmap failed: %s\n", strerror(errno));
+    }
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+#endif
+}
+
+void llama_mem_discard(void * addr, size_t size) {
+#if defined(_POSIX_MAPPED_FILES) && defined(__linux__)
+    if (!llama_mem_page_range(addr, size)) {
+        return;
+    }
+    // note: on Linux, the pages of private anonymous mappings are zero-filled on the next access
+    if (madvise(addr, size, MADV_DONTNEED)) {
+        LLAMA_LOG_DEBUG("%s: madvise(.., MADV_DONTNEED) failed: %s\n", __func__, strerror(errno));
+    }
+#else
+    GGML_UNUSED(addr);
+    GGML_UNUSED(size);
+#endif
+}
+
 size_t llama_path_max() {
     return PATH_MAX;
 }
@@ -65,4 +65,19 @@ private:
     std::unique_ptr<impl> pimpl;
 };
 
+// hints for a range of memory, the range is reduced to the pages it fully covers
+// these are no-ops on the platforms that do not support them
+bool llama_mem_lock    (void * addr, size_t size); // returns false if the pages could not be locked
+void llama_mem_unlock  (void * addr, size_t size);
+void llama_mem_prefetch(void * addr, size_t size); // start reading the pages in the background
+void llama_mem_release (void * addr, size_t size); // the pages are reclaimed first when memory is needed
+
+// anonymous memory that is committed page by page when first written, and reads as zeros before that
+// llama_mem_map returns nullptr if this is not supported
+// with noreserve, the size is not accounted for by the OS when mapped: the mapping can exceed the available memory,
+// but running out of memory is then only detected when a page is first written, and the process is killed
+void * llama_mem_map    (size_t size, bool noreserve);
+void   llama_mem_unmap  (void * addr, size_t size);
+void   llama_mem_discard(void * addr, size_t size); // return the pages of a mapped range to the OS, they read as zeros again
+
 size_t llama_path_max();
@@ -6269,6 +6269,19 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
         }
     }
 
+    // with the NUMA partition strategy, move the rows of the weights to the nodes of the threads that multiply them
+    if (auto * cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU)) {
+        auto * reg = ggml_backend_dev_backend_reg(cpu_dev);
+        auto * numa_partition_fn = (decltype(ggml_numa_partition_tensor) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_numa_partition_tensor");
+        if (numa_partition_fn) {
+            for (auto & [name, cur] : tensors_by_name) {
+                if (cur->buffer && ggml_backend_buffer_is_host(cur->buffer)) {
+                    numa_partition_fn(cur);
+                }
+            }
+        }
+    }
+
     if (use_mmap_buffer) {
         for (auto & mapping : ml.mappings) {
             pimpl->mappings.emplace_back(std::move(mapping));
@@ -19644,6 +19657,19 @@ struct llm_build_apertus : public llm_graph_context {
 llama_memory_i * llama_model::create_memory(const llama_memory_params & params, llama_cparams & cparams) const {
     llama_memory_i * res;
 
+    llama_memory_i::layer_type_cb types = nullptr;
+
+    if (!params.type_kv_layer.empty()) {
+        types = [&](int32_t il) {
+            const auto it = params.type_kv_layer.find(il);
+            if (it == params.type_kv_layer.end()) {
+                return std::make_pair(params.type_k, params.type_v);
+            }
+
+            return it->second;
+        };
+    }
+
     switch (arch) {
         // Models that need specific instantiation should be handled in the
         // switch statement
@@ -19712,7 +19738,8 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                         /* offload           */ cparams.offload_kqv,
                         /* unified           */ cparams.kv_unified,
                         /* filter_attn       */ std::move(filter_attn),
-                        /* filter_recr       */ std::move(filter_recr));
+                        /* filter_recr       */ std::move(filter_recr),
+                        /* types_attn        */ types);
                 } else {
                     const auto padding = llama_kv_cache::get_padding(cparams);
 
@@ -19754,12 +19781,15 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 cparams.offload_kqv,
                                 params.swa_full,
                                 cparams.kv_unified,
+                                cparams.kv_paged,
+                                cparams.n_kv_sink,
                                 n_ctx_per_stream,
                                 cparams.n_seq_max,
                                 cparams.n_ubatch,
                                 padding,
                                 nullptr,
-                                reuse);
+                                reuse,
+                                types);
                     } else {
                         GGML_ASSERT(!hparams.is_swa_any());
 
@@ -19770,13 +19800,17 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 !cparams.flash_attn,
                                 cparams.offload_kqv,
                                 cparams.kv_unified,
+                                cparams.kv_paged,
+                                cparams.n_kv_sink,
+                                cparams.n_kv_budget,
                                 n_ctx_per_stream,
                                 cparams.n_seq_max,
                                 padding,
                                 hparams.n_swa,
                                 hparams.swa_type,
                                 nullptr,
-                                nullptr);
+                                nullptr,
+                                types);
                     }
                 }
             }
@@ -0,0 +1,223 @@
+#include "llama-moe-placement.h"
+
+#include "llama-impl.h"
+#include "llama-graph.h"
+#include "llama-mmap.h"
+
+#include "ggml-backend.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <numeric>
+
+// the locks are not nested, so the experts that are hot in several contexts of the same model are counted
+// and only unlocked by the last one
+static std::mutex                  g_lock_mutex;
+static std::map<const void *, int> g_lock_count;
+
+static bool llama_moe_lock_range(void * addr, size_t size) {
+    std::lock_guard<std::mutex> lock(g_lock_mutex);
+
+    int & n = g_lock_count[addr];
+    if (n == 0 && !llama_mem_lock(addr, size)) {
+        g_lock_count.erase(addr);
+        return false;
+    }
+    n++;
+
+    return true;
+}
+
+static void llama_moe_unlock_range(void * addr, size_t size) {
+    std::lock_guard<std::mutex> lock(g_lock_mutex);
+
+    auto it = g_lock_count.find(addr);
+    if (it == g_lock_count.end()) {
+        return;
+    }
+
+    if (--it->second == 0) {
+        llama_mem_unlock(addr, size);
+        g_lock_count.erase(it);
+    }
+}
+
+llama_moe_placement::llama_moe_placement(uint32_t n_hot) : n_hot(n_hot) {
+}
+
+llama_moe_placement::~llama_moe_placement() {
+    for (auto & it : layers) {
+        auto & l = it.second;
+        for (int32_t e = 0; e < (int32_t) l.state.size(); ++e) {
+            if (l.state[e] == EXPERT_STATE_HOT) {
+                unlock(l, e);
+            }
+        }
+    }
+}
+
+void llama_moe_placement::add(const llm_graph_moe_sel & sel, const void * data) {
+    const ggml_tensor * key = nullptr;
+    for (const ggml_tensor * t : sel.exps) {
+        if (t) {
+            key = t;
+            break;
+        }
+    }
+
+    if (key == nullptr) {
+        return;
+    }
+
+    auto it = layers.find(key);
+    if (it == layers.end()) {
+        layer l;
+
+        // the expert weights offloaded to a device are not managed
+        for (ggml_tensor * t : sel.exps) {
+            if (t && t->buffer && t->data && ggml_backend_buffer_is_host(t->buffer)) {
+                l.exps.push_back(t);
+            }
+        }
+
+        const int64_t n_expert = key->ne[2];
+
+        l.usage .resize(n_expert, 0.0f);
+        l.used  .resize(n_expert, false);
+        l.recent.resize(n_expert, false);
+        l.state .resize(n_expert, EXPERT_STATE_NONE);
+
+        it = layers.emplace(key, std::move(l)).first;
+    }
+
+    auto & l = it->second;
+    if (l.exps.empty()) {
+        return;
+    }
+
+    const ggml_tensor * ids = sel.ids;
+
+    for (int64_t i1 = 0; i1 < ids->ne[1]; ++i1) {
+        const int32_t * row = (const int32_t *) ((const char *) data + i1*ids->nb[1]);
+
+        for (int64_t i0 = 0; i0 < ids->ne[0]; ++i0) {
+            const int32_t e = row[i0];
+            if (e < 0 || e >= (int32_t) l.usage.size()) {
+                continue;
+            }
+
+            l.usage[e] += 1.0f;
+            l.used [e]  = true;
+
+            if (l.state[e] == EXPERT_STATE_RELEASED) {
+                l.state[e] = EXPERT_STATE_NONE;
+            }
+        }
+    }
+}
+
+void llama_moe_placement::apply() {
+    for (auto & it : layers) {
+        auto & l = it.second;
+        for (int32_t e = 0; e < (int32_t) l.used.size(); ++e) {
+            if (!l.used[e]) {
+                continue;
+            }
+
+            // the hot experts are already in memory
+            if (l.state[e] != EXPERT_STATE_HOT) {
+                prefetch(l, e);
+            }
+
+            l.used  [e] = false;
+            l.recent[e] = true;
+        }
+    }
+
+    if (++n_apply % n_update == 0) {
+        update();
+    }
+}
+
+bool llama_moe_placement::lock(layer & l, int32_t e) {
+    for (size_t i = 0; i < l.exps.size(); ++i) {
+        ggml_tensor * t = l.exps[i];
+        if (!llama_moe_lock_range((char *) t->data + e*t->nb[2], t->nb[2])) {
+            for (size_t j = 0; j < i; ++j) {
+                llama_moe_unlock_range((char *) l.exps[j]->data + e*l.exps[j]->nb[2], l.exps[j]->nb[2]);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void llama_moe_placement::unlock(layer & l, int32_t e) {
+    for (ggml_tensor * t : l.exps) {
+        llama_moe_unlock_range((char *) t->data + e*t->nb[2], t->nb[2]);
+    }
+}
+
+void llama_moe_placement::prefetch(layer & l, int32_t e) {
+    for (ggml_tensor * t : l.exps) {
+        llama_mem_prefetch((char *) t->data + e*t->nb[2], t->nb[2]);
+    }
+}
+
+void llama_moe_placement::release(layer & l, int32_t e) {
+    for (ggml_tensor * t : l.exps) {
+        llama_mem_release((char *) t->data + e*t->nb[2], t->nb[2]);
+    }
+}
+
+void llama_moe_placement::update() {
+    int n_locked   = 0;
+    int n_released = 0;
+
+    for (auto & it : layers) {
+        auto & l = it.second;
+
+        const int32_t n_expert = l.usage.size();
+
+        std::vector<int32_t> order(n_expert);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int32_t a, int32_t b) { return l.usage[a] > l.usage[b]; });
+
+        for (int32_t i = 0; i < n_expert; ++i) {
+            const int32_t e = order[i];
+
+            const bool hot = i < (int32_t) n_hot && l.usage[e] > 0.0f;
+
+            if (hot && l.state[e] != EXPERT_STATE_HOT && !lock_failed) {
+                if (lock(l, e)) {
+                    l.state[e] = EXPERT_STATE_HOT;
+                    n_locked++;
+                } else {
+                    LLAMA_LOG_WARN("%s: failed to lock the hot experts, they will only be prefetched\n", __func__);
+                    lock_failed = true;
+                }
+            }
+
+            if (!hot && l.state[e] == EXPERT_STATE_HOT) {
+                unlock(l, e);
+                l.state[e] = EXPERT_STATE_NONE;
+            }
+
+            if (!hot && !l.recent[e] && l.state[e] == EXPERT_STATE_NONE) {
+                release(l, e);
+                l.state[e] = EXPERT_STATE_RELEASED;
+                n_released++;
+            }
+
+            // halve the weight of the past selections at each update
+            l.usage [e] *= 0.5f;
+            l.recent[e]  = false;
+        }
+    }
+
+    if (n_locked > 0 || n_released > 0) {
+        LLAMA_LOG_DEBUG("%s: locked %d and released %d experts\n", __func__, n_locked, n_released);
+    }
+}
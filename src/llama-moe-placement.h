@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct ggml_tensor;
+struct llm_graph_moe_sel;
+
+// placement in memory of the expert weights of MoE models, for models that are larger than the RAM
+// the experts selected by the routers are counted after each ubatch:
+//  - the experts used by the ubatch are prefetched in the background, the next tokens are likely to use them again
+//  - periodically, the n_hot most used experts of each layer are locked in memory, and the experts that were not used
+//    recently are released, so that the pages of the cold experts are evicted before the pages of the hot ones
+class llama_moe_placement {
+public:
+    llama_moe_placement(uint32_t n_hot);
+    ~llama_moe_placement();
+
+    // count the experts selected by a router, data is the content of sel.ids
+    void add(const llm_graph_moe_sel & sel, const void * data);
+
+    // to call after each ubatch
+    void apply();
+
+private:
+    enum expert_state {
+        EXPERT_STATE_NONE,
+        EXPERT_STATE_HOT,      // locked in memory
+        EXPERT_STATE_RELEASED, // advised for eviction
+    };
+
+    struct layer {
+        std::vector<ggml_tensor *> exps; // the tensors in host memory
+
+        std::vector<float>        usage;  // decayed number of selections
+        std::vector<bool>         used;   // selected in the last ubatch
+        std::vector<bool>         recent; // selected since the last update
+        std::vector<expert_state> state;
+    };
+
+    bool lock   (layer & l, int32_t e);
+    void unlock (layer & l, int32_t e);
+    void prefetch(layer & l, int32_t e);
+    void release(layer & l, int32_t e);
+
+    void update();
+
+    const uint32_t n_hot;
+
+    // number of ubatches between the updates of the hot experts
+    const uint32_t n_update = 16;
+
+    uint32_t n_apply = 0;
+
+    bool lock_failed = false;
+
+    // indexed by the first expert tensor of the layer
+    std::map<const ggml_tensor *, layer> layers;
+};
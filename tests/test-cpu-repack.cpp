@@ -0,0 +1,212 @@
+// Unit tests for the repacked weight layouts of the CPU backend - the gemv and gemm kernels of the CPU_REPACK buffer
+// type are checked against the reference vec_dot of the type
+// the layouts are selected from the features of the host CPU, so the ones that it does not use are skipped
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244 4267) // possible loss of data
+#endif
+
+constexpr float MAX_REPACK_NMSE = 1e-5f;
+
+static const char * RESULT_STR[] = {"ok", "FAILED"};
+
+// Generate synthetic data
+static void generate_data(float offset, size_t n, float * dst) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = 0.1 + 2*cosf(i + offset);
+    }
+}
+
+// Normalized mean squared error of the result with respect to the reference
+static double nmse(const float * a, const float * ref, size_t n) {
+    double err = 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        err += (a[i] - ref[i]) * (a[i] - ref[i]);
+        sum += ref[i] * ref[i];
+    }
+    return err / (sum > 0.0 ? sum : 1.0);
+}
+
+static ggml_backend_buffer_type_t get_repack_buft() {
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+
+    auto get_extra_bufts = (ggml_backend_dev_get_extra_bufts_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_dev_get_extra_bufts");
+    if (get_extra_bufts == nullptr) {
+        return nullptr;
+    }
+
+    for (ggml_backend_buffer_type_t * buft = get_extra_bufts(dev); buft && *buft; ++buft) {
+        if (strcmp(ggml_backend_buft_name(*buft), "CPU_REPACK") == 0) {
+            return *buft;
+        }
+    }
+
+    return nullptr;
+}
+
+// dst[i1][i0] = dot(w row i0, x row i1), with the activations converted to the vec_dot_type of the weights
+static void mul_mat_ref(ggml_type type, const void * w, const float * x, float * dst, int64_t k, int64_t m, int64_t n) {
+    const auto * traits_cpu = ggml_get_type_traits_cpu(type);
+
+    const ggml_type vec_dot_type = traits_cpu->vec_dot_type;
+
+    const size_t row_size_w = ggml_row_size(type, k);
+    const size_t row_size_x = ggml_row_size(vec_dot_type, k);
+
+    std::vector<uint8_t> xq(n*row_size_x);
+    for (int64_t i1 = 0; i1 < n; i1++) {
+        if (vec_dot_type == GGML_TYPE_F32) {
+            memcpy(xq.data() + i1*row_size_x, x + i1*k, row_size_x);
+        } else {
+            ggml_get_type_traits_cpu(vec_dot_type)->from_float(x + i1*k, xq.data() + i1*row_size_x, k);
+        }
+    }
+
+    for (int64_t i1 = 0; i1 < n; i1++) {
+        for (int64_t i0 = 0; i0 < m; i0++) {
+            traits_cpu->vec_dot(k, &dst[i1*m + i0], 0, (const uint8_t *) w + i0*row_size_w, 0, xq.data() + i1*row_size_x, 0, 1);
+        }
+    }
+}
+
+// returns 1 on failure, 0 on success, -1 if the host does not repack the type
+static int test_repack(ggml_backend_t backend, ggml_backend_buffer_type_t buft, ggml_type type, int64_t k, int64_t m, int64_t n, bool verbose) {
+    ggml_init_params params = {
+        /* .mem_size   = */ 4*ggml_tensor_overhead() + ggml_graph_overhead(),
+        /* .mem_buffer = */ nullptr,
+        /* .no_alloc   = */ true,
+    };
+
+    ggml_context * ctx_w = ggml_init(params);
+    ggml_context * ctx   = ggml_init(params);
+
+    ggml_tensor * w   = ggml_new_tensor_2d(ctx_w, type, k, m);
+    ggml_tensor * x   = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+    ggml_tensor * out = ggml_mul_mat(ctx, w, x);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    ggml_backend_buffer_t buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, buft);
+    ggml_backend_buffer_t buf   = ggml_backend_alloc_ctx_tensors(ctx, backend);
+
+    int res = -1;
+
+    if (ggml_backend_supports_op(backend, out)) {
+        std::vector<float> w_f32(k*m);
+        std::vector<float> x_f32(k*n);
+        generate_data(0.0, w_f32.size(), w_f32.data());
+        generate_data(1.0, x_f32.size(), x_f32.data());
+
+        std::vector<uint8_t> w_data(ggml_nbytes(w));
+        ggml_quantize_chunk(type, w_f32.data(), w_data.data(), 0, m, k, nullptr);
+
+        // the weights are repacked when they are set
+        ggml_backend_tensor_set(w, w_data.data(), 0, w_data.size());
+        ggml_backend_tensor_set(x, x_f32.data(), 0, x_f32.size()*sizeof(float));
+
+        ggml_backend_graph_compute(backend, gf);
+
+        std::vector<float> out_data(m*n);
+        ggml_backend_tensor_get(out, out_data.data(), 0, out_data.size()*sizeof(float));
+
+        std::vector<float> out_ref(m*n);
+        mul_mat_ref(type, w_data.data(), x_f32.data(), out_ref.data(), k, m, n);
+
+        const double err = nmse(out_data.data(), out_ref.data(), out_ref.size());
+
+        res = err > MAX_REPACK_NMSE;
+
+        if (res || verbose) {
+            printf("%5s repacked mul_mat, k = %4d, m = %3d, n = %2d: %s (nmse = %e)\n",
+                    ggml_type_name(type), (int) k, (int) m, (int) n, RESULT_STR[res], err);
+        }
+    }
+
+    ggml_backend_buffer_free(buf);
+    ggml_backend_buffer_free(buf_w);
+
+    ggml_free(ctx);
+    ggml_free(ctx_w);
+
+    return res;
+}
+
+int main(int argc, char * argv[]) {
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "-v") {
+            verbose = true;
+        } else {
+            fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    ggml_cpu_init();
+
+    ggml_backend_buffer_type_t buft = get_repack_buft();
+    if (buft == nullptr) {
+        printf("the CPU backend has no repack buffer type, skipping\n");
+        return 0;
+    }
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, 2);
+
+    const ggml_type types[] = {
+        GGML_TYPE_Q4_0, GGML_TYPE_Q4_K, GGML_TYPE_Q2_K, GGML_TYPE_Q6_K, GGML_TYPE_IQ4_NL, GGML_TYPE_Q8_0,
+        GGML_TYPE_F16,  GGML_TYPE_BF16,
+    };
+
+    // n = 1 uses the gemv kernels, the larger batches the gemm kernels and the gemv kernels for their remainder
+    const int64_t k = 512;
+    const int64_t m = 32;
+    const int64_t ns[] = { 1, 4, 7, 16 };
+
+    int num_failed = 0;
+
+    for (ggml_type type : types) {
+        bool repacked = false;
+
+        for (int64_t n : ns) {
+            const int res = test_repack(backend, buft, type, k, m, n, verbose);
+            if (res < 0) {
+                break;
+            }
+
+            repacked = true;
+            num_failed += res;
+        }
+
+        if (!repacked) {
+            printf("%5s is not repacked on this CPU, skipping\n", ggml_type_name(type));
+        }
+    }
+
+    ggml_backend_free(backend);
+
+    if (num_failed || verbose) {
+        printf("%d tests failed\n", num_failed);
+    }
+
+    return num_failed > 0;
+}
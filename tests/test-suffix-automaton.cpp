@@ -0,0 +1,132 @@
+//  Tests common_suffix_automaton against a brute-force search of the longest earlier match.
+
+#include "suffix-automaton.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// longest suffix of text that also ends at an earlier position, and the end of its last earlier occurrence
+static int32_t match_naive(const std::vector<llama_token> & text, int32_t & pos) {
+    const int32_t n = text.size();
+
+    pos = -1;
+
+    int32_t best = 0;
+    for (int32_t e = 0; e < n - 1; ++e) {
+        int32_t len = 0;
+        while (len <= e && text[e - len] == text[n - 1 - len]) {
+            len++;
+        }
+
+        if (len > 0 && len >= best) {
+            best = len;
+            pos  = e;
+        }
+    }
+
+    return best;
+}
+
+// longest suffix of text that is a substring of corpus
+static int32_t match_corpus_naive(const std::vector<llama_token> & corpus, const std::vector<llama_token> & text) {
+    const int32_t n = text.size();
+
+    int32_t best = 0;
+    for (int32_t e = 0; e < (int32_t) corpus.size(); ++e) {
+        int32_t len = 0;
+        while (len <= e && len < n && corpus[e - len] == text[n - 1 - len]) {
+            len++;
+        }
+
+        best = std::max(best, len);
+    }
+
+    return best;
+}
+
+static void check(bool cond, const std::string & msg) {
+    if (!cond) {
+        throw std::runtime_error("Test failed: " + msg);
+    }
+}
+
+int main() {
+    std::mt19937 rng(42);
+
+    for (int n_vocab : { 2, 3, 8 }) {
+        common_suffix_automaton sam;
+        common_suffix_automaton_clear(sam);
+
+        std::vector<llama_token> text;
+
+        for (int i = 0; i < 500; ++i) {
+            const llama_token id = rng() % n_vocab;
+
+            text.push_back(id);
+            common_suffix_automaton_add(sam, &id, 1);
+
+            int32_t pos_naive = -1;
+            int32_t pos       = -1;
+
+            const int32_t len_naive = match_naive(text, pos_naive);
+            const int32_t len       = common_suffix_automaton_match(sam, pos);
+
+            check(len == len_naive, "match length, n_vocab = " + std::to_string(n_vocab) + ", i = " + std::to_string(i));
+
+            if (len > 0) {
+                check(pos == pos_naive, "match position, n_vocab = " + std::to_string(n_vocab) + ", i = " + std::to_string(i));
+            }
+        }
+
+        // match another text against the automaton
+        common_suffix_automaton_cursor cur;
+
+        std::vector<llama_token> other;
+        for (int i = 0; i < 200; ++i) {
+            const llama_token id = rng() % (n_vocab + 1);
+
+            other.push_back(id);
+            common_suffix_automaton_step(sam, cur, id);
+
+            check(cur.len == match_corpus_naive(text, other), "cursor length, n_vocab = " + std::to_string(n_vocab) + ", i = " + std::to_string(i));
+        }
+    }
+
+    // drafts do not continue past a separator
+    {
+        common_suffix_automaton sam;
+
+        const std::vector<llama_token> text = { 1, 2, 3, 4, LLAMA_TOKEN_NULL, 5, 6, 1, 2 };
+        common_suffix_automaton_add(sam, text.data(), text.size());
+
+        int32_t pos = -1;
+        check(common_suffix_automaton_match(sam, pos) == 2 && pos == 1, "separator match");
+
+        std::vector<llama_token> draft;
+        common_suffix_automaton_draft(sam, pos, 16, draft);
+        check(draft == std::vector<llama_token>({ 3, 4 }), "separator draft");
+    }
+
+    // drafts follow the last occurrence, and repeat a pattern past the end of the text
+    {
+        common_suffix_automaton sam;
+
+        const std::vector<llama_token> text = { 7, 1, 2, 8, 1, 2, 3, 1, 2, 3, 1, 2 };
+        common_suffix_automaton_add(sam, text.data(), text.size());
+
+        int32_t pos = -1;
+        check(common_suffix_automaton_match(sam, pos) == 5 && pos == 8, "last occurrence match");
+
+        std::vector<llama_token> draft;
+        common_suffix_automaton_draft(sam, pos, 7, draft);
+        check(draft == std::vector<llama_token>({ 3, 1, 2, 3, 1, 2, 3 }), "repeated draft");
+    }
+
+    printf("test-suffix-automaton: OK\n");
+
+    return 0;
+}
@@ -23,13 +23,25 @@
 #include <cstddef>
 #include <cinttypes>
 #include <deque>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <signal.h>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using json = nlohmann::ordered_json;
 
 constexpr int HTTP_POLLING_SECONDS = 1;
@@ -48,6 +60,7 @@ enum slot_state {
     SLOT_STATE_PROCESSING_PROMPT,
     SLOT_STATE_DONE_PROMPT,
     SLOT_STATE_GENERATING,
+    SLOT_STATE_RESUMING, // recomputing the KV cache of a suspended task that is no longer in the prompt cache
 };
 
 enum server_state {
@@ -123,6 +136,9 @@ struct slot_params {
     int64_t t_max_prompt_ms  = -1; // TODO: implement
     int64_t t_max_predict_ms = -1; // if positive, limit the generation phase to this time limit
 
+    int32_t priority   =  0; // waiting tasks are served by descending priority, a higher priority may preempt a slot
+    int64_t t_deadline = -1; // if positive, the task fails if it has not started by this time (us)
+
     std::vector<common_adapter_lora_info> lora;
 
     std::vector<std::string> antiprompt;
@@ -195,6 +211,7 @@ struct slot_params {
                 {"speculative.n_max",         speculative.n_max},
                 {"speculative.n_min",         speculative.n_min},
                 {"speculative.p_min",         speculative.p_min},
+                {"speculative.adaptive",      speculative.adaptive},
                 {"timings_per_token",         timings_per_token},
                 {"post_sampling_probs",       post_sampling_probs},
                 {"lora",                      lora},
@@ -253,6 +270,7 @@ struct slot_params {
             {"speculative.n_max",         speculative.n_max},
             {"speculative.n_min",         speculative.n_min},
             {"speculative.p_min",         speculative.p_min},
+            {"speculative.adaptive",      speculative.adaptive},
             {"timings_per_token",         timings_per_token},
             {"post_sampling_probs",       post_sampling_probs},
             {"lora",                      lora},
@@ -260,6 +278,8 @@ struct slot_params {
     }
 };
 
+struct server_task_resume;
+
 struct server_task {
     int id    = -1; // to be filled by server_queue
     int index = -1; // used when there are multiple prompts (batch request)
@@ -288,6 +308,9 @@ struct server_task {
     // used by SERVER_TASK_TYPE_SET_LORA
     std::vector<common_adapter_lora_info> set_lora;
 
+    // generation state of a preempted task, used to resume it in a new slot
+    std::shared_ptr<server_task_resume> resume;
+
     server_task() = default;
 
     server_task(server_task_type type) : type(type) {}
@@ -325,8 +348,16 @@ struct server_task {
         params.n_discard        = json_value(data,       "n_discard",          defaults.n_discard);
       //params.t_max_prompt_ms  = json_value(data,       "t_max_prompt_ms",    defaults.t_max_prompt_ms); // TODO: implement
         params.t_max_predict_ms = json_value(data,       "t_max_predict_ms",   defaults.t_max_predict_ms);
+        params.priority         = json_value(data,       "priority",           defaults.priority);
         params.response_fields  = json_value(data,       "response_fields",    std::vector<std::string>());
 
+        {
+            const int64_t deadline_ms = json_value(data, "deadline_ms", (int64_t) -1);
+            if (deadline_ms >= 0) {
+                params.t_deadline = ggml_time_us() + 1000*deadline_ms;
+            }
+        }
+
         params.sampling.top_k              = json_value(data, "top_k",               defaults.sampling.top_k);
         params.sampling.top_p              = json_value(data, "top_p",               defaults.sampling.top_p);
         params.sampling.min_p              = json_value(data, "min_p",               defaults.sampling.min_p);
@@ -357,6 +388,8 @@ struct server_task {
         params.speculative.n_max = json_value(data, "speculative.n_max", defaults.speculative.n_max);
         params.speculative.p_min = json_value(data, "speculative.p_min", defaults.speculative.p_min);
 
+        params.speculative.adaptive = json_value(data, "speculative.adaptive", defaults.speculative.adaptive);
+
         params.speculative.n_min = std::min(params.speculative.n_max, params.speculative.n_min);
         params.speculative.n_min = std::max(params.speculative.n_min, 0);
         params.speculative.n_max = std::max(params.speculative.n_max, 0);
@@ -612,6 +645,21 @@ struct server_task {
         }
         return ids;
     }
+
+    // order of the waiting tasks: higher priority first, then earlier deadline, then older task
+    static bool is_before(const server_task & a, const server_task & b) {
+        if (a.params.priority != b.params.priority) {
+            return a.params.priority > b.params.priority;
+        }
+
+        const int64_t t_a = a.params.t_deadline >= 0 ? a.params.t_deadline : INT64_MAX;
+        const int64_t t_b = b.params.t_deadline >= 0 ? b.params.t_deadline : INT64_MAX;
+        if (t_a != t_b) {
+            return t_a < t_b;
+        }
+
+        return a.id < b.id;
+    }
 };
 
 struct result_timings {
@@ -1319,6 +1367,19 @@ struct server_task_result_metrics : server_task_result {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    uint64_t n_prompt_tokens_cached_total = 0;
+
+    uint64_t n_slot_select_total  = 0;
+    uint64_t n_slot_select_prefix = 0;
+    uint64_t n_slot_select_cache  = 0;
+    uint64_t n_prompt_cache_restored = 0;
+    uint64_t n_preempted = 0;
+    uint64_t n_offloaded = 0;
+
+    // speculative decoding histograms, summed over the slots
+    std::vector<uint64_t> hist_n_draft;
+    std::vector<uint64_t> hist_n_accept;
+
     // while we can also use std::vector<server_slot> this requires copying the slot object which can be quite messy
     // therefore, we use json to temporarily store the slot.to_json() result
     json slots_data = json::array();
@@ -1345,6 +1406,17 @@ struct server_task_result_metrics : server_task_result {
             { "n_decode_total",                  n_decode_total },
             { "n_busy_slots_total",              n_busy_slots_total },
 
+            { "n_prompt_tokens_cached_total",    n_prompt_tokens_cached_total },
+
+            { "n_slot_select_total",             n_slot_select_total },
+            { "n_slot_select_prefix",            n_slot_select_prefix },
+            { "n_slot_select_cache",             n_slot_select_cache },
+            { "n_prompt_cache_restored",         n_prompt_cache_restored },
+            { "n_preempted",                     n_preempted },
+            { "n_offloaded",                     n_offloaded },
+            { "hist_n_draft",                    hist_n_draft },
+            { "hist_n_accept",                   hist_n_accept },
+
             { "slots",                           slots_data },
         };
     }
@@ -1418,6 +1490,10 @@ struct server_prompt {
 
     std::list<server_prompt_checkpoint> checkpoints;
 
+    // state file of a prompt in the disk tier of the cache
+    std::string file;
+    size_t file_size = 0;
+
     size_t size() const {
         size_t res = data.size();
 
@@ -1433,294 +1509,1216 @@ struct server_prompt {
     }
 };
 
-struct server_prompt_cache {
-    server_prompt_cache(int32_t limit_size_mib, size_t limit_tokens) {
-        this->limit_size   = 1024ull*1024ull*(limit_size_mib < 0 ? 0 : limit_size_mib);
-        this->limit_tokens = limit_tokens;
-    }
+// node of the token-level radix tree that indexes the cached prompts
+struct server_prompt_cache_node {
+    using iterator = std::list<server_prompt>::iterator;
 
-    std::list<server_prompt> states;
+    // tokens on the edge from the parent to this node
+    llama_tokens edge;
 
-    // in bytes, 0 = no limit
-    size_t limit_size = 0;
+    // number of tokens from the root to the end of this node's edge
+    size_t depth = 0;
 
-    // in tokens, 0 = no limit
-    size_t limit_tokens = 0;
+    server_prompt_cache_node * parent = nullptr;
 
-    size_t size() const {
-        size_t res = 0;
+    std::map<llama_token, std::unique_ptr<server_prompt_cache_node>> children;
 
-        for (const auto & state : states) {
-            res += state.size();
-        }
+    // cached prompts that end exactly at this node
+    std::vector<iterator> prompts;
 
-        return res;
-    }
+    // the cached prompt with the least tokens in the subtree of this node
+    std::optional<iterator> shortest;
+};
 
-    size_t n_tokens() const {
-        size_t res = 0;
+struct server_prompt_cache_match {
+    server_prompt_cache_node * node;
 
-        for (const auto & state : states) {
-            res += state.n_tokens();
+    // number of tokens matched from the root, including a possibly partial match of the node's edge
+    size_t n_match;
+};
+
+// lookups cost O(prompt length), independent of the number of cached prompts
+struct server_prompt_cache_tree {
+    using iterator = server_prompt_cache_node::iterator;
+
+    server_prompt_cache_node root;
+
+    // visit the nodes along the tokens - the last visited node can be matched only partially
+    std::vector<server_prompt_cache_match> walk(const llama_tokens & tokens) {
+        std::vector<server_prompt_cache_match> res;
+
+        server_prompt_cache_node * cur = &root;
+
+        size_t i = 0;
+        while (i < tokens.size()) {
+            auto it = cur->children.find(tokens[i]);
+            if (it == cur->children.end()) {
+                break;
+            }
+
+            server_prompt_cache_node * child = it->second.get();
+
+            size_t n = 0;
+            while (n < child->edge.size() && i + n < tokens.size() && child->edge[n] == tokens[i + n]) {
+                n++;
+            }
+
+            i += n;
+
+            res.push_back({ child, i });
+
+            if (n < child->edge.size()) {
+                break;
+            }
+
+            cur = child;
         }
 
         return res;
     }
 
-    server_prompt * alloc(const server_prompt & prompt, size_t state_size) {
-        // first check if the current state is contained fully in the cache
-        for (auto it = states.begin(); it != states.end(); ++it) {
-            const int cur_lcp_len = it->tokens.get_common_prefix(prompt.tokens);
+    void insert(const llama_tokens & tokens, iterator prompt) {
+        server_prompt_cache_node * cur = &root;
 
-            if (cur_lcp_len == (int) prompt.tokens.size()) {
-                SRV_WRN("%s", " - prompt is already in the cache, skipping\n");
-                return nullptr;
-            }
-        }
+        size_t i = 0;
+        while (i < tokens.size()) {
+            auto it = cur->children.find(tokens[i]);
+            if (it == cur->children.end()) {
+                auto node = std::make_unique<server_prompt_cache_node>();
 
-        // next, remove any cached prompts that are fully contained in the current prompt
-        for (auto it = states.begin(); it != states.end();) {
-            const int len = it->tokens.get_common_prefix(prompt.tokens);
+                node->edge.assign(tokens.begin() + i, tokens.end());
+                node->depth  = tokens.size();
+                node->parent = cur;
 
-            if (len == (int) it->tokens.size()) {
-                SRV_WRN(" - removing obsolete cached prompt with length %d\n", len);
+                cur = cur->children.emplace(tokens[i], std::move(node)).first->second.get();
+                break;
+            }
 
-                it = states.erase(it);
-            } else {
-                ++it;
+            server_prompt_cache_node * child = it->second.get();
+
+            size_t n = 0;
+            while (n < child->edge.size() && i + n < tokens.size() && child->edge[n] == tokens[i + n]) {
+                n++;
             }
-        }
 
-        std::vector<uint8_t> state_data;
+            if (n < child->edge.size()) {
+                // split the edge at the first mismatch
+                auto mid = std::make_unique<server_prompt_cache_node>();
 
-        // check if we can allocate enough memory for the new state
-        try {
-            state_data.resize(state_size);
-        } catch (const std::bad_alloc & e) {
-            SRV_ERR("failed to allocate memory for prompt cache state: %s\n", e.what());
+                mid->edge.assign(child->edge.begin(), child->edge.begin() + n);
+                mid->depth    = child->depth - child->edge.size() + n;
+                mid->parent   = cur;
+                mid->shortest = child->shortest;
 
-            limit_size = std::max<size_t>(1, 0.4*size());
+                std::unique_ptr<server_prompt_cache_node> old = std::move(it->second);
 
-            SRV_WRN(" - cache size limit reduced to %.3f MiB\n", limit_size / (1024.0 * 1024.0));
+                old->edge.erase(old->edge.begin(), old->edge.begin() + n);
+                old->parent = mid.get();
 
-            update();
+                const llama_token key = old->edge[0];
+                mid->children.emplace(key, std::move(old));
 
-            return nullptr;
+                it->second = std::move(mid);
+                child = it->second.get();
+            }
+
+            i += n;
+            cur = child;
         }
 
-        // TODO: for some reason we can't copy server_tokens, so we have to do this workaround
-        auto & cur = states.emplace_back();
-        cur = {
-            /*.tokens      =*/ server_tokens(prompt.tokens.get_text_tokens(), false),
-            /*.data        =*/ std::move(state_data),
-            /*.checkpoints =*/ prompt.checkpoints,
-        };
+        cur->prompts.push_back(prompt);
 
-        return &cur;
+        update_shortest(cur);
     }
 
-    bool load(server_prompt & prompt, const server_tokens & tokens_new, llama_context * ctx, int32_t id_slot) {
-        const int lcp_best = prompt.tokens.get_common_prefix(tokens_new);
-
-        float f_keep_best = float(lcp_best) / prompt.tokens.size();
-        float sim_best    = float(lcp_best) / tokens_new.size();
+    void erase(const llama_tokens & tokens, iterator prompt) {
+        server_prompt_cache_node * node = &root;
 
-        SRV_WRN(" - looking for better prompt, base f_keep = %.3f, sim = %.3f\n", f_keep_best, sim_best);
+        if (!tokens.empty()) {
+            const auto path = walk(tokens);
 
-        auto it_best = states.end();
+            GGML_ASSERT(!path.empty() && path.back().n_match == tokens.size() && path.back().node->depth == tokens.size());
 
-        // find the most similar cached prompt, that would also preserve the most context
-        for (auto it = states.begin(); it != states.end(); ++it) {
-            const int lcp_cur = it->tokens.get_common_prefix(tokens_new);
+            node = path.back().node;
+        }
 
-            const float f_keep_cur = float(lcp_cur) / it->tokens.size();
-            const float sim_cur    = float(lcp_cur) / tokens_new.size();
+        node->prompts.erase(std::remove(node->prompts.begin(), node->prompts.end(), prompt), node->prompts.end());
 
-            // don't trash large prompts
-            if (f_keep_cur < 0.25f) {
-                continue;
-            }
+        // prune the branch that no longer leads to any prompt
+        while (node != &root && node->prompts.empty() && node->children.empty()) {
+            server_prompt_cache_node * parent = node->parent;
 
-            if (f_keep_best < f_keep_cur && sim_best < sim_cur) {
-                f_keep_best = f_keep_cur;
-                sim_best    = sim_cur;
+            parent->children.erase(node->edge[0]);
 
-                it_best = it;
-            }
+            node = parent;
         }
 
-        if (it_best != states.end()) {
-            SRV_WRN(" - found better prompt with f_keep = %.3f, sim = %.3f\n", f_keep_best, sim_best);
-
-            const size_t size = it_best->data.size();
-            const size_t n = llama_state_seq_set_data_ext(ctx, it_best->data.data(), size, id_slot, 0);
-            if (n != size) {
-                SRV_WRN("failed to restore state with size %zu\n", size);
+        // merge a node that is left with a single child and no prompts into the child
+        if (node != &root && node->prompts.empty() && node->children.size() == 1) {
+            server_prompt_cache_node * parent = node->parent;
 
-                return false;
-            }
+            std::unique_ptr<server_prompt_cache_node> child = std::move(node->children.begin()->second);
 
-            it_best->data.clear();
-            it_best->data.shrink_to_fit();
+            child->edge.insert(child->edge.begin(), node->edge.begin(), node->edge.end());
+            child->parent = parent;
 
-            prompt = std::move(*it_best);
+            const llama_token key = child->edge[0];
+            parent->children[key] = std::move(child); // destroys node
 
-            states.erase(it_best);
+            node = parent;
         }
 
-        return true;
+        update_shortest(node);
     }
 
-    void update() {
-        if (limit_size > 0) {
-            // always keep at least one state, regardless of the limits
-            while (states.size() > 1 && size() > limit_size) {
-                if (states.empty()) {
-                    break;
-                }
+private:
+    static void update_shortest(server_prompt_cache_node * node) {
+        for (; node != nullptr; node = node->parent) {
+            node->shortest.reset();
 
-                SRV_WRN(" - cache size limit reached, removing oldest entry (size = %.3f MiB)\n", states.front().size() / (1024.0 * 1024.0));
+            // prompts that end at this node are shorter than all prompts in the children
+            if (!node->prompts.empty()) {
+                node->shortest = node->prompts.front();
+                continue;
+            }
 
-                states.pop_front();
+            for (const auto & [_, child] : node->children) {
+                if (child->shortest && (!node->shortest || (*child->shortest)->n_tokens() < (*node->shortest)->n_tokens())) {
+                    node->shortest = child->shortest;
+                }
             }
         }
+    }
+};
 
-        // average size per token
-        const float size_per_token = std::max<float>(1.0f, float(size()) / (std::max<size_t>(1, n_tokens())));
+// read-only view of a file, memory-mapped where supported
+struct server_file_view {
+    const uint8_t * data = nullptr;
+    size_t size = 0;
 
-        // dynamically increase the token limit if it can fit in the memory limit
-        const size_t limit_tokens_cur = limit_size > 0 ? std::max<size_t>(limit_tokens, limit_size/size_per_token) : limit_tokens;
+    explicit server_file_view(const std::string & path) {
+#if defined(_WIN32)
+        std::ifstream f(path, std::ios::binary | std::ios::ate);
+        if (!f) {
+            return;
+        }
 
-        if (limit_tokens > 0) {
-            while (states.size() > 1 && n_tokens() > limit_tokens_cur) {
-                if (states.empty()) {
-                    break;
-                }
+        buf.resize(f.tellg());
+        f.seekg(0);
+        if (!f.read((char *) buf.data(), buf.size())) {
+            buf.clear();
+            return;
+        }
 
-                SRV_WRN(" - cache token limit (%zu, est: %zu) reached, removing oldest entry (size = %.3f MiB)\n",
-                        limit_tokens, limit_tokens_cur, states.front().size() / (1024.0 * 1024.0));
+        data = buf.data();
+        size = buf.size();
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                // the state is consumed front to back exactly once
+                posix_madvise(addr, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+                mapped = addr;
 
-                states.pop_front();
+                data = (const uint8_t *) addr;
+                size = st.st_size;
             }
         }
 
-        SRV_WRN(" - cache state: %zu prompts, %.3f MiB (limits: %.3f MiB, %zu tokens, %zu est)\n",
-                states.size(), size() / (1024.0 * 1024.0), limit_size / (1024.0 * 1024.0), limit_tokens, limit_tokens_cur);
+        close(fd);
+#endif
+    }
 
-        for (const auto & state : states) {
-            SRV_WRN("   - prompt %p: %7d tokens, checkpoints: %2zu, %9.3f MiB\n",
-                    (const void *)&state, state.n_tokens(), state.checkpoints.size(), state.size() / (1024.0 * 1024.0));
+    ~server_file_view() {
+#if !defined(_WIN32)
+        if (mapped) {
+            munmap(mapped, size);
         }
+#endif
     }
+
+    server_file_view(const server_file_view &) = delete;
+    server_file_view & operator=(const server_file_view &) = delete;
+
+private:
+#if defined(_WIN32)
+    std::vector<uint8_t> buf;
+#else
+    void * mapped = nullptr;
+#endif
 };
 
-struct server_slot {
-    int id;
+// identity of the model for the disk tier of the prompt cache: a hash of the GGUF metadata, and the size and the
+// modification time of the model file, so that two fine-tunes with the same architecture, size and types differ
+static std::string server_model_identity(const llama_model * model, const std::string & path) {
+    std::map<std::string, std::string> kv;
 
-    llama_batch batch_spec = {};
+    std::vector<char> key(256);
+    std::vector<char> val(256);
+    for (int32_t i = 0; i < llama_model_meta_count(model); ++i) {
+        int32_t n = llama_model_meta_key_by_index(model, i, key.data(), key.size());
+        if (n >= (int32_t) key.size()) {
+            key.resize(n + 1);
+            llama_model_meta_key_by_index(model, i, key.data(), key.size());
+        }
 
-    // TODO: change to unique_ptrs for consistency:
-    llama_context * ctx = nullptr;
-    llama_context * ctx_dft = nullptr;
+        n = llama_model_meta_val_str_by_index(model, i, val.data(), val.size());
+        if (n >= (int32_t) val.size()) {
+            val.resize(n + 1);
+            llama_model_meta_val_str_by_index(model, i, val.data(), val.size());
+        }
 
-    // multimodal
-    mtmd_context * mctx = nullptr;
+        kv[key.data()] = val.data();
+    }
 
-    common_speculative * spec = nullptr;
+    std::string meta;
+    for (const auto & [k, v] : kv) {
+        meta += k + "=" + v + "\n";
+    }
 
-    std::unique_ptr<const server_task> task;
-    std::unique_ptr<const server_task> task_prev; // used for debugging
+    std::string res = "meta " + fnv_hash((const uint8_t *) meta.data(), meta.size());
 
-    // used to determine the slot that has been used the longest
-    int64_t t_last_used = -1;
+    std::error_code ec;
+    const auto size  = std::filesystem::file_size(path, ec);
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (!ec) {
+        res += string_format(", file %" PRIu64 " bytes, mtime %" PRId64, (uint64_t) size, (int64_t) mtime.time_since_epoch().count());
+    }
 
-    // generation props
-    int32_t n_ctx       = 0;  // context size per slot
-    int32_t n_past      = 0;
-    int32_t n_keep      = 0;
-    int32_t n_decoded   = 0;
-    int32_t n_remaining = -1;
-    int32_t i_batch     = -1;
+    return res;
+}
 
-    int32_t n_prompt_tokens_cache     = 0;
-    int32_t n_prompt_tokens_processed = 0;
+// second tier of the prompt cache, stored as one file per prompt in a directory
+// states evicted from RAM are written by a background thread and are mapped back into memory on a hit
+// each file starts with the tokens of its prompt, so the tier is indexed again from the directory after a restart
+struct server_prompt_cache_disk {
+    static constexpr uint32_t FILE_MAGIC   = 0x4c505343; // 'LPSC'
+    static constexpr uint32_t FILE_VERSION = 1;
 
-    int32_t n_prompt_tokens() const {
-        return task->tokens.size();
-    }
+    // sanity limit for the headers of the indexed files
+    static constexpr uint32_t FILE_MAX_TOKENS = 1u << 24;
 
-    size_t last_nl_pos = 0;
+    server_prompt_cache_disk(const std::string & path, int32_t limit_size_mib, const std::string & fingerprint) : path(path), fingerprint(fingerprint) {
+        this->limit_size = 1024ull*1024ull*(limit_size_mib < 0 ? 0 : limit_size_mib);
 
-    std::string  generated_text;
-    llama_tokens generated_tokens;
+        std::error_code ec;
+        if (!std::filesystem::create_directories(path, ec) && ec) {
+            SRV_ERR("failed to create prompt cache directory '%s': %s\n", path.c_str(), ec.message().c_str());
+        }
 
-    common_chat_msg chat_msg;
+        load_index();
 
-    std::vector<completion_token_output> generated_token_probs;
+        worker = std::thread([this]() { process_writes(); });
+    }
 
-    bool has_next_token = true;
-    bool has_new_line   = false;
-    bool truncated      = false;
+    ~server_prompt_cache_disk() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_all();
 
-    stop_type stop;
+        // flush the pending writes, so they are available after a restart
+        worker.join();
+    }
 
-    std::string stopping_word;
+    const std::string path;
 
-    // state
-    slot_state state = SLOT_STATE_IDLE;
+    // states of other models are ignored
+    const std::string fingerprint;
 
-    server_prompt prompt;
+    // in bytes, 0 = no limit
+    size_t limit_size = 0;
 
-    void prompt_save(server_prompt_cache & prompt_cache) const {
-        assert(prompt.data.size() == 0);
+    // ordered from the least to the most recently stored, the data of the states is always empty
+    std::list<server_prompt> states;
 
-        const size_t cur_size = llama_state_seq_get_size_ext(ctx, id, 0);
+    server_prompt_cache_tree tree;
 
-        SRV_WRN(" - saving prompt with length %d, total state size = %.3f MiB\n",
-                (int) prompt.tokens.size(), cur_size / (1024.0 * 1024.0));
+    size_t size() const {
+        size_t res = 0;
 
-        auto * cur = prompt_cache.alloc(prompt, cur_size);
-        if (cur == nullptr) {
-            return;
+        for (const auto & state : states) {
+            res += state.file_size;
         }
 
-        llama_state_seq_get_data_ext(ctx, cur->data.data(), cur_size, id, 0);
+        return res;
     }
 
-    void prompt_load(server_prompt_cache & prompt_cache, const server_tokens & tokens) {
-        bool res = prompt_cache.load(prompt, tokens, ctx, id);
-        if (!res) {
-            SLT_WRN(*this, "%s", "failed to load prompt from cache\n");
-        }
-    }
+    // queue the prompt for writing - it can be looked up immediately
+    void store(server_prompt && prompt) {
+        const llama_tokens & tokens = prompt.tokens.get_text_tokens();
 
-    std::vector<common_adapter_lora_info> lora;
-    int32_t alora_invocation_start = -1;
+        const std::string file = path + DIRECTORY_SEPARATOR + fnv_hash((const uint8_t *) tokens.data(), tokens.size()*sizeof(llama_token)) + ".bin";
 
-    // sampling
-    json json_schema;
+        // the same prompt could have been stored before it was restored from RAM
+        for (auto it = states.begin(); it != states.end(); ++it) {
+            if (it->file == file) {
+                erase(it);
+                break;
+            }
+        }
 
-    struct common_sampler * smpl = nullptr;
+        auto & cur = states.emplace_back();
+        cur.tokens    = server_tokens(tokens, false);
+        cur.file      = file;
+        cur.file_size = prompt.size() + tokens.size()*sizeof(llama_token);
 
-    llama_token sampled;
+        tree.insert(tokens, std::prev(states.end()));
 
-    common_chat_format chat_format = COMMON_CHAT_FORMAT_CONTENT_ONLY;
-    std::vector<std::string> generated_tool_call_ids;
+        prompt.file = cur.file;
 
-    // stats
-    size_t n_sent_text = 0; // number of sent text character
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue.push_back({ std::move(prompt), false });
+        }
+        cv.notify_one();
 
-    int64_t t_start_process_prompt;
-    int64_t t_start_generation;
+        while (states.size() > 1 && limit_size > 0 && size() > limit_size) {
+            SRV_WRN(" - disk cache size limit reached, removing oldest entry (size = %.3f MiB)\n", states.front().file_size / (1024.0 * 1024.0));
 
-    double t_prompt_processing; // ms
-    double t_token_generation;  // ms
+            erase(states.begin());
+        }
+    }
 
-    std::function<void(int)> callback_on_release;
+    // the file is removed by the background thread, after the pending writes of the same file
+    std::list<server_prompt>::iterator erase(std::list<server_prompt>::iterator it) {
+        {
+            server_prompt cur;
+            cur.file = it->file;
 
-    // Speculative decoding stats
-    int32_t n_draft_total = 0;      // Total draft tokens generated
-    int32_t n_draft_accepted = 0;   // Draft tokens actually accepted
+            std::unique_lock<std::mutex> lock(mutex);
+            queue.push_back({ std::move(cur), true });
+        }
+        cv.notify_one();
+
+        tree.erase(it->tokens.get_text_tokens(), it);
+
+        return states.erase(it);
+    }
+
+    // restore the state into the sequence and move the prompt out of the disk tier
+    bool load(std::list<server_prompt>::iterator it, server_prompt & prompt, llama_context * ctx, int32_t id_slot) {
+        wait(it->file);
+
+        bool ok    = false;
+        bool valid = false;
+
+        {
+            server_file_view view(it->file);
+
+            server_prompt res;
+
+            const uint8_t * state = nullptr;
+            size_t n_state = 0;
+
+            valid = view.data && parse(view.data, view.size, res, &state, &n_state);
+            if (valid) {
+                ok = llama_state_seq_set_data_ext(ctx, state, n_state, id_slot, 0) == n_state;
+            }
+
+            if (ok) {
+                prompt = std::move(res);
+            } else {
+                SRV_WRN("failed to restore state from '%s'%s\n", it->file.c_str(), valid ? "" : " - the file is invalid");
+            }
+        }
+
+        // the file is kept if it is valid but could not be restored into the sequence, e.g. for lack of space
+        if (ok || !valid) {
+            erase(it);
+        }
+
+        return ok;
+    }
+
+private:
+    std::thread worker;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    bool running = true;
+
+    // pending writes and removals of files, processed in order
+    struct file_op {
+        server_prompt prompt;
+        bool remove = false;
+    };
+
+    std::deque<file_op> queue;
+
+    // file that is currently being written or removed
+    std::string file_cur;
+
+    // block until the file is no longer queued for writing or removal
+    void wait(const std::string & file) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() {
+            return file_cur != file && std::none_of(queue.begin(), queue.end(), [&](const file_op & op) { return op.prompt.file == file; });
+        });
+    }
+
+    void process_writes() {
+        while (true) {
+            file_op op;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return !queue.empty() || !running; });
+
+                if (queue.empty()) {
+                    break;
+                }
+
+                op = std::move(queue.front());
+                queue.pop_front();
+
+                file_cur = op.prompt.file;
+            }
+
+            const server_prompt & cur = op.prompt;
+
+            const int64_t t_start = ggml_time_us();
+
+            if (op.remove) {
+                std::error_code ec;
+                std::filesystem::remove(cur.file, ec);
+            } else if (!write(cur)) {
+                SRV_ERR("failed to write prompt cache file '%s'\n", cur.file.c_str());
+            } else {
+                SRV_DBG("wrote prompt cache file '%s' (%.3f MiB) in %.2f ms\n",
+                        cur.file.c_str(), cur.size() / (1024.0 * 1024.0), (ggml_time_us() - t_start) / 1000.0);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                file_cur.clear();
+            }
+            cv.notify_all();
+        }
+    }
+
+    bool write(const server_prompt & prompt) const {
+        const std::string tmp = prompt.file + ".tmp";
+
+        {
+            std::ofstream f(tmp, std::ios::binary);
+
+            const auto write_u32 = [&](uint32_t v) { f.write((const char *) &v, sizeof(v)); };
+            const auto write_u64 = [&](uint64_t v) { f.write((const char *) &v, sizeof(v)); };
+
+            const llama_tokens & tokens = prompt.tokens.get_text_tokens();
+
+            write_u32(FILE_MAGIC);
+            write_u32(FILE_VERSION);
+
+            write_u32(fingerprint.size());
+            f.write(fingerprint.data(), fingerprint.size());
+
+            write_u32(tokens.size());
+            f.write((const char *) tokens.data(), tokens.size()*sizeof(llama_token));
+
+            write_u32(prompt.checkpoints.size());
+            for (const auto & checkpoint : prompt.checkpoints) {
+                write_u32(checkpoint.pos_min);
+                write_u32(checkpoint.pos_max);
+                write_u64(checkpoint.data.size());
+                f.write((const char *) checkpoint.data.data(), checkpoint.data.size());
+            }
+
+            write_u64(prompt.data.size());
+            f.write((const char *) prompt.data.data(), prompt.data.size());
+
+            if (!f) {
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, prompt.file, ec);
+
+        return !ec;
+    }
+
+    // parse a state file - the state itself is returned as a pointer into the buffer, the header is copied
+    bool parse(const uint8_t * buf, size_t n_buf, server_prompt & prompt, const uint8_t ** state, size_t * n_state) const {
+        size_t offs = 0;
+
+        const auto read = [&](void * dst, size_t n) {
+            if (offs + n > n_buf) {
+                return false;
+            }
+            if (dst) {
+                memcpy(dst, buf + offs, n);
+            }
+            offs += n;
+            return true;
+        };
+
+        uint32_t magic   = 0;
+        uint32_t version = 0;
+        uint32_t n       = 0;
+
+        if (!read(&magic, sizeof(magic)) || magic != FILE_MAGIC || !read(&version, sizeof(version)) || version != FILE_VERSION) {
+            return false;
+        }
+
+        if (!read(&n, sizeof(n)) || n != fingerprint.size() || offs + n > n_buf || memcmp(buf + offs, fingerprint.data(), n) != 0) {
+            return false;
+        }
+        offs += n;
+
+        // validate the sizes before allocating, the file could be corrupt
+        llama_tokens tokens;
+        if (!read(&n, sizeof(n)) || n > FILE_MAX_TOKENS || (size_t) n*sizeof(llama_token) > n_buf - offs) {
+            return false;
+        }
+        tokens.resize(n);
+        if (!read(tokens.data(), n*sizeof(llama_token))) {
+            return false;
+        }
+
+        prompt.tokens = server_tokens(tokens, false);
+        prompt.checkpoints.clear();
+
+        if (state == nullptr) {
+            // header only
+            return true;
+        }
+
+        if (!read(&n, sizeof(n))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            auto & checkpoint = prompt.checkpoints.emplace_back();
+
+            uint64_t n_data = 0;
+            if (!read(&checkpoint.pos_min, sizeof(checkpoint.pos_min)) || !read(&checkpoint.pos_max, sizeof(checkpoint.pos_max)) || !read(&n_data, sizeof(n_data)) ||
+                n_data > n_buf - offs) {
+                return false;
+            }
+
+            checkpoint.data.resize(n_data);
+            if (!read(checkpoint.data.data(), n_data)) {
+                return false;
+            }
+        }
+
+        uint64_t n_data = 0;
+        if (!read(&n_data, sizeof(n_data)) || n_data > n_buf - offs) {
+            return false;
+        }
+
+        *state   = buf + offs;
+        *n_state = n_data;
+
+        return true;
+    }
+
+    // index the state files that were left in the directory by a previous run
+    void load_index() {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+
+        std::error_code ec;
+        for (const auto & entry : std::filesystem::directory_iterator(path, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".bin") {
+                files.emplace_back(entry.last_write_time(), entry.path());
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+
+        for (const auto & [_, file] : files) {
+            std::ifstream f(file, std::ios::binary);
+
+            // only the header is needed - read up to the first checkpoint count
+            uint32_t hdr[3] = {};
+            if (!f.read((char *) hdr, sizeof(hdr)) || hdr[0] != FILE_MAGIC || hdr[1] != FILE_VERSION || hdr[2] != fingerprint.size()) {
+                continue;
+            }
+
+            std::vector<uint8_t> buf(sizeof(hdr) + hdr[2] + sizeof(uint32_t));
+            memcpy(buf.data(), hdr, sizeof(hdr));
+            if (!f.read((char *) buf.data() + sizeof(hdr), buf.size() - sizeof(hdr))) {
+                continue;
+            }
+
+            uint32_t n_tokens = 0;
+            memcpy(&n_tokens, buf.data() + buf.size() - sizeof(uint32_t), sizeof(n_tokens));
+
+            if (n_tokens == 0 || n_tokens > FILE_MAX_TOKENS) {
+                continue;
+            }
+
+            buf.resize(buf.size() + n_tokens*sizeof(llama_token));
+            if (!f.read((char *) buf.data() + buf.size() - n_tokens*sizeof(llama_token), n_tokens*sizeof(llama_token))) {
+                continue;
+            }
+
+            server_prompt cur;
+            if (!parse(buf.data(), buf.size(), cur, nullptr, nullptr) || cur.tokens.empty()) {
+                continue;
+            }
+
+            cur.file      = file.string();
+            cur.file_size = std::filesystem::file_size(file, ec);
+
+            states.push_back(std::move(cur));
+            tree.insert(states.back().tokens.get_text_tokens(), std::prev(states.end()));
+        }
+
+        if (!states.empty()) {
+            SRV_WRN(" - disk cache '%s': indexed %zu prompts, %.3f MiB\n", path.c_str(), states.size(), size() / (1024.0 * 1024.0));
+        }
+    }
+};
+
+struct server_prompt_cache {
+    server_prompt_cache(int32_t limit_size_mib, size_t limit_tokens) {
+        this->limit_size   = 1024ull*1024ull*(limit_size_mib < 0 ? 0 : limit_size_mib);
+        this->limit_tokens = limit_tokens;
+    }
+
+    ~server_prompt_cache() {
+        // spill the states to disk so that the cache stays warm across restarts
+        while (disk && !states.empty()) {
+            evict();
+        }
+    }
+
+    // ordered from the least to the most recently added
+    std::list<server_prompt> states;
+
+    // index of the states by their tokens
+    server_prompt_cache_tree tree;
+
+    // optional second tier that receives the states evicted from RAM
+    std::unique_ptr<server_prompt_cache_disk> disk;
+
+    // in bytes, 0 = no limit
+    size_t limit_size = 0;
+
+    // in tokens, 0 = no limit
+    size_t limit_tokens = 0;
+
+    // number of prompts restored from the cache
+    uint64_t n_restored = 0;
+
+    size_t size() const {
+        size_t res = 0;
+
+        for (const auto & state : states) {
+            res += state.size();
+        }
+
+        return res;
+    }
+
+    size_t n_tokens() const {
+        size_t res = 0;
+
+        for (const auto & state : states) {
+            res += state.n_tokens();
+        }
+
+        return res;
+    }
+
+    // length of the longest prefix of the tokens that is stored in the cache
+    size_t n_match(const server_tokens & tokens) {
+        size_t res = 0;
+
+        for (auto * cur : { &tree, disk ? &disk->tree : nullptr }) {
+            if (cur == nullptr) {
+                continue;
+            }
+
+            const auto path = cur->walk(tokens.get_text_tokens());
+
+            res = std::max(res, path.empty() ? 0 : path.back().n_match);
+        }
+
+        return res;
+    }
+
+    std::list<server_prompt>::iterator erase(std::list<server_prompt>::iterator it) {
+        tree.erase(it->tokens.get_text_tokens(), it);
+
+        return states.erase(it);
+    }
+
+    // remove the oldest state from RAM, moving it to the disk tier if there is one
+    void evict() {
+        auto it = states.begin();
+
+        tree.erase(it->tokens.get_text_tokens(), it);
+
+        if (disk) {
+            disk->store(std::move(*it));
+        }
+
+        states.erase(it);
+    }
+
+    server_prompt * alloc(const server_prompt & prompt, size_t state_size) {
+        const llama_tokens & tokens = prompt.tokens.get_text_tokens();
+
+        const auto path = tree.walk(tokens);
+
+        // first check if the current state is contained fully in the cache
+        if (n_match(prompt.tokens) == tokens.size()) {
+            SRV_WRN("%s", " - prompt is already in the cache, skipping\n");
+            return nullptr;
+        }
+
+        // next, remove any cached prompts that are fully contained in the current prompt
+        {
+            std::vector<std::list<server_prompt>::iterator> obsolete;
+
+            for (const auto & [node, n_match] : path) {
+                if (n_match == node->depth) {
+                    obsolete.insert(obsolete.end(), node->prompts.begin(), node->prompts.end());
+                }
+            }
+
+            for (auto it : obsolete) {
+                SRV_WRN(" - removing obsolete cached prompt with length %d\n", it->n_tokens());
+
+                erase(it);
+            }
+
+            if (disk) {
+                obsolete.clear();
+
+                for (const auto & [node, n_match] : disk->tree.walk(tokens)) {
+                    if (n_match == node->depth) {
+                        obsolete.insert(obsolete.end(), node->prompts.begin(), node->prompts.end());
+                    }
+                }
+
+                for (auto it : obsolete) {
+                    SRV_WRN(" - removing obsolete cached prompt from disk with length %d\n", it->n_tokens());
+
+                    disk->erase(it);
+                }
+            }
+        }
+
+        std::vector<uint8_t> state_data;
+
+        // check if we can allocate enough memory for the new state
+        try {
+            state_data.resize(state_size);
+        } catch (const std::bad_alloc & e) {
+            SRV_ERR("failed to allocate memory for prompt cache state: %s\n", e.what());
+
+            limit_size = std::max<size_t>(1, 0.4*size());
+
+            SRV_WRN(" - cache size limit reduced to %.3f MiB\n", limit_size / (1024.0 * 1024.0));
+
+            update();
+
+            return nullptr;
+        }
+
+        // TODO: for some reason we can't copy server_tokens, so we have to do this workaround
+        auto & cur = states.emplace_back();
+        cur = {
+            /*.tokens      =*/ server_tokens(tokens, false),
+            /*.data        =*/ std::move(state_data),
+            /*.checkpoints =*/ prompt.checkpoints,
+            /*.file        =*/ {},
+            /*.file_size   =*/ 0,
+        };
+
+        tree.insert(tokens, std::prev(states.end()));
+
+        return &cur;
+    }
+
+    bool load(server_prompt & prompt, const server_tokens & tokens_new, llama_context * ctx, int32_t id_slot) {
+        const int lcp_best = prompt.tokens.get_common_prefix(tokens_new);
+
+        float f_keep_best = prompt.tokens.empty() ? 0.0f : float(lcp_best) / prompt.tokens.size();
+        float sim_best    = float(lcp_best) / tokens_new.size();
+
+        SRV_WRN(" - looking for better prompt, base f_keep = %.3f, sim = %.3f\n", f_keep_best, sim_best);
+
+        std::optional<std::list<server_prompt>::iterator> it_best;
+
+        bool is_disk = false;
+
+        // find the most similar cached prompt, that would also preserve the most context
+        // all prompts below a visited node share at least n_match tokens with the new prompt, and the shortest of
+        // them keeps the largest fraction of its context
+        const auto find_best = [&](server_prompt_cache_tree & cur_tree, bool cur_is_disk) {
+            for (const auto & [node, n_match] : cur_tree.walk(tokens_new.get_text_tokens())) {
+                const auto it = *node->shortest;
+
+                const float f_keep_cur = float(n_match) / it->tokens.size();
+                const float sim_cur    = float(n_match) / tokens_new.size();
+
+                // don't trash large prompts
+                if (f_keep_cur < 0.25f) {
+                    continue;
+                }
+
+                if (f_keep_best < f_keep_cur && sim_best < sim_cur) {
+                    f_keep_best = f_keep_cur;
+                    sim_best    = sim_cur;
+
+                    it_best = it;
+                    is_disk = cur_is_disk;
+                }
+            }
+        };
+
+        find_best(tree, false);
+
+        if (disk) {
+            find_best(disk->tree, true);
+        }
+
+        if (it_best && is_disk) {
+            SRV_WRN(" - found better prompt on disk with f_keep = %.3f, sim = %.3f\n", f_keep_best, sim_best);
+
+            if (!disk->load(*it_best, prompt, ctx, id_slot)) {
+                return false;
+            }
+
+            n_restored++;
+        } else if (it_best) {
+            SRV_WRN(" - found better prompt with f_keep = %.3f, sim = %.3f\n", f_keep_best, sim_best);
+
+            const size_t size = (*it_best)->data.size();
+            const size_t n = llama_state_seq_set_data_ext(ctx, (*it_best)->data.data(), size, id_slot, 0);
+            if (n != size) {
+                SRV_WRN("failed to restore state with size %zu\n", size);
+
+                return false;
+            }
+
+            (*it_best)->data.clear();
+            (*it_best)->data.shrink_to_fit();
+
+            n_restored++;
+
+            tree.erase((*it_best)->tokens.get_text_tokens(), *it_best);
+
+            prompt = std::move(**it_best);
+
+            states.erase(*it_best);
+        }
+
+        return true;
+    }
+
+    void update() {
+        if (limit_size > 0) {
+            // always keep at least one state, regardless of the limits
+            while (states.size() > 1 && size() > limit_size) {
+                if (states.empty()) {
+                    break;
+                }
+
+                SRV_WRN(" - cache size limit reached, removing oldest entry (size = %.3f MiB)\n", states.front().size() / (1024.0 * 1024.0));
+
+                evict();
+            }
+        }
+
+        // average size per token
+        const float size_per_token = std::max<float>(1.0f, float(size()) / (std::max<size_t>(1, n_tokens())));
+
+        // dynamically increase the token limit if it can fit in the memory limit
+        const size_t limit_tokens_cur = limit_size > 0 ? std::max<size_t>(limit_tokens, limit_size/size_per_token) : limit_tokens;
+
+        if (limit_tokens > 0) {
+            while (states.size() > 1 && n_tokens() > limit_tokens_cur) {
+                if (states.empty()) {
+                    break;
+                }
+
+                SRV_WRN(" - cache token limit (%zu, est: %zu) reached, removing oldest entry (size = %.3f MiB)\n",
+                        limit_tokens, limit_tokens_cur, states.front().size() / (1024.0 * 1024.0));
+
+                evict();
+            }
+        }
+
+        SRV_WRN(" - cache state: %zu prompts, %.3f MiB (limits: %.3f MiB, %zu tokens, %zu est)\n",
+                states.size(), size() / (1024.0 * 1024.0), limit_size / (1024.0 * 1024.0), limit_tokens, limit_tokens_cur);
+
+        for (const auto & state : states) {
+            SRV_WRN("   - prompt %p: %7d tokens, checkpoints: %2zu, %9.3f MiB\n",
+                    (const void *)&state, state.n_tokens(), state.checkpoints.size(), state.size() / (1024.0 * 1024.0));
+        }
+
+        if (disk) {
+            SRV_WRN(" - disk cache state: %zu prompts, %.3f MiB (limit: %.3f MiB)\n",
+                    disk->states.size(), disk->size() / (1024.0 * 1024.0), disk->limit_size / (1024.0 * 1024.0));
+        }
+    }
+};
+
+// index of the tokens held by the slots, keyed by chained hashes of their leading blocks of tokens
+// the slot with the longest matching prefix is found with one hash lookup per block of the prompt
+struct server_slot_index {
+    static constexpr size_t n_block = 16;
+
+    // hash of a block of tokens -> slots that contain this block after the same preceding blocks
+    std::unordered_map<uint64_t, std::vector<int>> blocks;
+
+    // hashes registered for each slot, indexed by slot id
+    std::vector<std::vector<uint64_t>> slot_hashes;
+
+    // FNV-1a over the tokens of each full block, seeded with the hash of the previous block
+    // stops at the first multimodal chunk, since its placeholder tokens do not identify the media
+    static std::vector<uint64_t> hash_blocks(const llama_tokens & tokens) {
+        std::vector<uint64_t> res;
+
+        uint64_t hash = 0xcbf29ce484222325ULL;
+
+        for (size_t i = 0; i + n_block <= tokens.size(); i += n_block) {
+            for (size_t j = i; j < i + n_block; ++j) {
+                if (tokens[j] == LLAMA_TOKEN_NULL) {
+                    return res;
+                }
+
+                hash ^= (uint32_t) tokens[j];
+                hash *= 0x100000001b3ULL;
+            }
+
+            res.push_back(hash);
+        }
+
+        return res;
+    }
+
+    void update(int id_slot, const server_tokens & tokens) {
+        if ((size_t) id_slot >= slot_hashes.size()) {
+            slot_hashes.resize(id_slot + 1);
+        }
+
+        auto & cur = slot_hashes[id_slot];
+
+        for (const uint64_t hash : cur) {
+            auto it = blocks.find(hash);
+            if (it == blocks.end()) {
+                continue;
+            }
+
+            auto & ids = it->second;
+            ids.erase(std::remove(ids.begin(), ids.end(), id_slot), ids.end());
+
+            if (ids.empty()) {
+                blocks.erase(it);
+            }
+        }
+
+        // the multimodal prompts are not indexed, the slots are scanned for them instead
+        cur.clear();
+        if (!tokens.has_mtmd) {
+            cur = hash_blocks(tokens.get_text_tokens());
+        }
+
+        for (const uint64_t hash : cur) {
+            blocks[hash].push_back(id_slot);
+        }
+    }
+
+    // find the slot accepted by the filter that shares the most full blocks with the tokens
+    // returns the number of tokens in the matching blocks, and -1 in id_slot if there is no match
+    size_t find(const llama_tokens & tokens, const std::function<bool(int)> & accept, int & id_slot) const {
+        id_slot = -1;
+
+        size_t res = 0;
+
+        const auto hashes = hash_blocks(tokens);
+
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            const auto it = blocks.find(hashes[i]);
+            if (it == blocks.end()) {
+                break;
+            }
+
+            for (const int id : it->second) {
+                if (accept(id)) {
+                    id_slot = id;
+                    res     = (i + 1)*n_block;
+                    break;
+                }
+            }
+        }
+
+        return res;
+    }
+};
+
+// generation state of a slot that was preempted by a higher priority task
+// the KV cache of the sequence goes to the prompt cache, and is recomputed if it is no longer there on resume
+struct server_task_resume {
+    llama_tokens tokens; // tokens in the KV cache of the slot
+    llama_token  sampled;
+
+    common_sampler * smpl = nullptr;
+
+    int32_t n_decoded   = 0;
+    int32_t n_remaining = -1;
+
+    int32_t n_prompt_tokens_cache     = 0;
+    int32_t n_prompt_tokens_processed = 0;
+
+    size_t n_sent_text = 0;
+    size_t last_nl_pos = 0;
+    bool   has_new_line = false;
+    bool   truncated    = false;
+
+    std::string  generated_text;
+    llama_tokens generated_tokens;
+
+    common_chat_msg chat_msg;
+    std::vector<std::string> generated_tool_call_ids;
+
+    std::vector<completion_token_output> generated_token_probs;
+
+    int32_t n_draft_total    = 0;
+    int32_t n_draft_accepted = 0;
+
+    int64_t t_start_process_prompt = 0;
+    int64_t t_start_generation     = 0;
+    int64_t t_suspend              = 0;
+
+    double t_prompt_processing = 0.0;
+
+    server_task_resume() = default;
+
+    server_task_resume(const server_task_resume &) = delete;
+    server_task_resume & operator=(const server_task_resume &) = delete;
+
+    ~server_task_resume() {
+        if (smpl != nullptr) {
+            common_sampler_free(smpl);
+        }
+    }
+};
+
+struct server_slot {
+    int id;
+
+    // TODO: change to unique_ptrs for consistency:
+    llama_context * ctx = nullptr;
+    llama_context * ctx_dft = nullptr; // shared by all slots, the slot drafts in the sequence with its id
+
+    // multimodal
+    mtmd_context * mctx = nullptr;
+
+    common_speculative * spec = nullptr;
+
+    // target sequences for the branches of the draft trees, see common_speculative_tree_add()
+    std::vector<llama_seq_id> seq_ids_branch;
+
+    std::unique_ptr<const server_task> task;
+    std::unique_ptr<const server_task> task_prev; // used for debugging
+
+    // used to determine the slot that has been used the longest
+    int64_t t_last_used = -1;
+
+    // generation props
+    int32_t n_ctx       = 0;  // context size per slot
+    int32_t n_past      = 0;
+    int32_t n_keep      = 0;
+    int32_t n_decoded   = 0;
+    int32_t n_remaining = -1;
+    int32_t i_batch     = -1;
+
+    int32_t n_prompt_tokens_cache     = 0;
+    int32_t n_prompt_tokens_processed = 0;
+
+    int32_t n_prompt_tokens() const {
+        return task->tokens.size();
+    }
+
+    size_t last_nl_pos = 0;
+
+    std::string  generated_text;
+    llama_tokens generated_tokens;
+
+    common_chat_msg chat_msg;
+
+    std::vector<completion_token_output> generated_token_probs;
+
+    bool has_next_token = true;
+    bool has_new_line   = false;
+    bool truncated      = false;
+
+    stop_type stop;
+
+    std::string stopping_word;
+
+    // state
+    slot_state state = SLOT_STATE_IDLE;
+
+    server_prompt prompt;
+
+    void prompt_save(server_prompt_cache & prompt_cache) const {
+        assert(prompt.data.size() == 0);
+
+        const size_t cur_size = llama_state_seq_get_size_ext(ctx, id, 0);
+
+        SRV_WRN(" - saving prompt with length %d, total state size = %.3f MiB\n",
+                (int) prompt.tokens.size(), cur_size / (1024.0 * 1024.0));
+
+        auto * cur = prompt_cache.alloc(prompt, cur_size);
+        if (cur == nullptr) {
+            return;
+        }
+
+        llama_state_seq_get_data_ext(ctx, cur->data.data(), cur_size, id, 0);
+    }
+
+    void prompt_load(server_prompt_cache & prompt_cache, const server_tokens & tokens) {
+        bool res = prompt_cache.load(prompt, tokens, ctx, id);
+        if (!res) {
+            SLT_WRN(*this, "%s", "failed to load prompt from cache\n");
+        }
+    }
+
+    std::vector<common_adapter_lora_info> lora;
+    int32_t alora_invocation_start = -1;
+
+    // sampling
+    json json_schema;
+
+    struct common_sampler * smpl = nullptr;
+
+    llama_token sampled;
+
+    common_chat_format chat_format = COMMON_CHAT_FORMAT_CONTENT_ONLY;
+    std::vector<std::string> generated_tool_call_ids;
+
+    // stats
+    size_t n_sent_text = 0; // number of sent text character
+
+    int64_t t_start_process_prompt;
+    int64_t t_start_generation;
+
+    double t_prompt_processing; // ms
+    double t_token_generation;  // ms
+
+    std::function<void(int)> callback_on_release;
+
+    // Speculative decoding stats
+    int32_t n_draft_total = 0;      // Total draft tokens generated
+    int32_t n_draft_accepted = 0;   // Draft tokens actually accepted
 
     void reset() {
         SLT_DBG(*this, "%s", "\n");
@@ -1802,33 +2800,125 @@ struct server_slot {
         return state != SLOT_STATE_IDLE;
     }
 
-    bool can_speculate() const {
-        return ctx_dft;
-    }
+    bool can_speculate() const {
+        return spec;
+    }
+
+    void add_token(const completion_token_output & token) {
+        if (!is_processing()) {
+            SLT_WRN(*this, "%s", "slot is not processing\n");
+            return;
+        }
+        generated_token_probs.push_back(token);
+    }
+
+    void release() {
+        if (is_processing()) {
+            GGML_ASSERT(task);
+
+            SLT_INF(*this, "stop processing: n_past = %d, truncated = %d\n", n_past, truncated);
+
+            t_last_used = ggml_time_us();
+            t_token_generation = (ggml_time_us() - t_start_generation) / 1e3;
+            state = SLOT_STATE_IDLE;
+
+            task_prev = std::move(task);
+            task.reset();
+
+            callback_on_release(id);
+        }
+    }
+
+    // move the generation state out of the slot and stop processing, without releasing the slot to the queue
+    std::shared_ptr<server_task_resume> suspend() {
+        GGML_ASSERT(state == SLOT_STATE_GENERATING);
+
+        auto res = std::make_shared<server_task_resume>();
+
+        res->tokens  = prompt.tokens.get_text_tokens();
+        res->sampled = sampled;
+
+        res->smpl = smpl;
+        smpl = nullptr;
+
+        res->n_decoded   = n_decoded;
+        res->n_remaining = n_remaining;
+
+        res->n_prompt_tokens_cache     = n_prompt_tokens_cache;
+        res->n_prompt_tokens_processed = n_prompt_tokens_processed;
+
+        res->n_sent_text  = n_sent_text;
+        res->last_nl_pos  = last_nl_pos;
+        res->has_new_line = has_new_line;
+        res->truncated    = truncated;
+
+        res->generated_text          = std::move(generated_text);
+        res->generated_tokens        = std::move(generated_tokens);
+        res->chat_msg                = std::move(chat_msg);
+        res->generated_tool_call_ids = std::move(generated_tool_call_ids);
+        res->generated_token_probs   = std::move(generated_token_probs);
+
+        res->n_draft_total    = n_draft_total;
+        res->n_draft_accepted = n_draft_accepted;
+
+        res->t_start_process_prompt = t_start_process_prompt;
+        res->t_start_generation     = t_start_generation;
+        res->t_prompt_processing    = t_prompt_processing;
+        res->t_suspend              = ggml_time_us();
+
+        SLT_INF(*this, "suspend processing: n_past = %d, n_decoded = %d\n", n_past, n_decoded);
+
+        t_last_used = ggml_time_us();
+        state = SLOT_STATE_IDLE;
+
+        task_prev = std::move(task);
+        task.reset();
+
+        return res;
+    }
+
+    // continue the generation of a suspended task, the KV cache of the slot must already hold res.tokens
+    void resume(server_task_resume & res) {
+        if (smpl != nullptr) {
+            common_sampler_free(smpl);
+        }
+
+        smpl = res.smpl;
+        res.smpl = nullptr;
+
+        sampled = res.sampled;
+
+        n_past      = res.tokens.size();
+        n_decoded   = res.n_decoded;
+        n_remaining = res.n_remaining;
+
+        n_prompt_tokens_cache     = res.n_prompt_tokens_cache;
+        n_prompt_tokens_processed = res.n_prompt_tokens_processed;
+
+        n_sent_text  = res.n_sent_text;
+        last_nl_pos  = res.last_nl_pos;
+        has_new_line = res.has_new_line;
+        truncated    = res.truncated;
 
-    void add_token(const completion_token_output & token) {
-        if (!is_processing()) {
-            SLT_WRN(*this, "%s", "slot is not processing\n");
-            return;
-        }
-        generated_token_probs.push_back(token);
-    }
+        generated_text          = std::move(res.generated_text);
+        generated_tokens        = std::move(res.generated_tokens);
+        chat_msg                = std::move(res.chat_msg);
+        generated_tool_call_ids = std::move(res.generated_tool_call_ids);
+        generated_token_probs   = std::move(res.generated_token_probs);
 
-    void release() {
-        if (is_processing()) {
-            GGML_ASSERT(task);
+        n_draft_total    = res.n_draft_total;
+        n_draft_accepted = res.n_draft_accepted;
 
-            SLT_INF(*this, "stop processing: n_past = %d, truncated = %d\n", n_past, truncated);
+        // the time spent suspended does not count as generation time
+        t_start_process_prompt = res.t_start_process_prompt;
+        t_start_generation     = res.t_start_generation + (ggml_time_us() - res.t_suspend);
+        t_prompt_processing    = res.t_prompt_processing;
 
-            t_last_used = ggml_time_us();
-            t_token_generation = (ggml_time_us() - t_start_generation) / 1e3;
-            state = SLOT_STATE_IDLE;
+        has_next_token = true;
 
-            task_prev = std::move(task);
-            task.reset();
+        state = SLOT_STATE_GENERATING;
 
-            callback_on_release(id);
-        }
+        SLT_INF(*this, "resume processing: n_past = %d, n_decoded = %d\n", n_past, n_decoded);
     }
 
     result_timings get_timings() const {
@@ -1958,6 +3048,21 @@ struct server_slot {
             }
         }
 
+        if (spec) {
+            const auto stats = common_speculative_get_stats(spec);
+
+            res["speculative_stats"] = {
+                {"n_draft",       stats.n_draft_last},
+                {"n_drafts",      stats.n_drafts},
+                {"n_branch_hit",  stats.n_branch_hit},
+                {"p_accept",      stats.p_accept},
+                {"hist_n_draft",  stats.hist_n_draft},
+                {"hist_n_accept", stats.hist_n_accept},
+                {"t_draft_ms",    stats.t_draft_ms},
+                {"t_verify_ms",   stats.t_verify_ms},
+            };
+        }
+
         return res;
     }
 };
@@ -1981,6 +3086,15 @@ struct server_metrics {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    uint64_t n_prompt_tokens_cached_total = 0;
+
+    uint64_t n_slot_select_total  = 0;
+    uint64_t n_slot_select_prefix = 0; // slots selected by the longest cached prefix
+    uint64_t n_slot_select_cache  = 0; // selections deferred to the prompt cache because it holds a longer prefix
+
+    uint64_t n_preempted = 0; // generations suspended for a higher priority task
+    uint64_t n_offloaded = 0; // idle slots moved to the prompt cache
+
     void init() {
         t_start = ggml_time_us();
     }
@@ -1988,6 +3102,7 @@ struct server_metrics {
     void on_prompt_eval(const server_slot & slot) {
         n_prompt_tokens_processed_total += slot.n_prompt_tokens_processed;
         n_prompt_tokens_processed       += slot.n_prompt_tokens_processed;
+        n_prompt_tokens_cached_total    += slot.n_prompt_tokens_cache;
         t_prompt_processing             += slot.t_prompt_processing;
         t_prompt_processing_total       += slot.t_prompt_processing;
 
@@ -2037,6 +3152,10 @@ struct server_queue {
     // callback functions
     std::function<void(server_task &&)> callback_new_task;
     std::function<void(void)>           callback_update_slots;
+    std::function<void(void)>           callback_idle;
+
+    // interval between the calls of callback_idle while waiting for new tasks
+    int64_t t_idle_ms = 1000;
 
     // Add a new task to the end of the queue
     int post(server_task && task, bool front = false) {
@@ -2051,7 +3170,7 @@ struct server_queue {
         if (front) {
             queue_tasks.push_front(std::move(task));
         } else {
-            queue_tasks.push_back(std::move(task));
+            insert_ordered(queue_tasks, std::move(task));
         }
         condition_tasks.notify_one();
         return task_id;
@@ -2072,7 +3191,7 @@ struct server_queue {
             if (front) {
                 queue_tasks.push_front(std::move(task));
             } else {
-                queue_tasks.push_back(std::move(task));
+                insert_ordered(queue_tasks, std::move(task));
             }
         }
         condition_tasks.notify_one();
@@ -2082,11 +3201,20 @@ struct server_queue {
     // Add a new task, but defer until one slot is available
     void defer(server_task && task) {
         std::unique_lock<std::mutex> lock(mutex_tasks);
-        QUE_DBG("defer task, id = %d\n", task.id);
-        queue_tasks_deferred.push_back(std::move(task));
+        QUE_DBG("defer task, id = %d, priority = %d\n", task.id, task.params.priority);
+        insert_ordered(queue_tasks_deferred, std::move(task));
         condition_tasks.notify_one();
     }
 
+    // Insert a task after all the tasks that should be served before it
+    static void insert_ordered(std::deque<server_task> & queue, server_task && task) {
+        auto it = queue.end();
+        while (it != queue.begin() && server_task::is_before(task, *std::prev(it))) {
+            --it;
+        }
+        queue.insert(it, std::move(task));
+    }
+
     // Get the next id for creating a new task
     int get_new_id() {
         std::unique_lock<std::mutex> lock(mutex_tasks);
@@ -2104,6 +3232,12 @@ struct server_queue {
         callback_update_slots = std::move(callback);
     }
 
+    // Register the function to be called periodically while there are no new tasks
+    void on_idle(std::function<void(void)> callback, int64_t interval_ms) {
+        callback_idle = std::move(callback);
+        t_idle_ms     = interval_ms;
+    }
+
     // Call when the state of one slot is changed, it will move one task from deferred to main queue
     void pop_deferred_task() {
         std::unique_lock<std::mutex> lock(mutex_tasks);
@@ -2164,10 +3298,18 @@ struct server_queue {
                     QUE_DBG("%s", "terminate\n");
                     return;
                 }
-                if (queue_tasks.empty()) {
-                    condition_tasks.wait(lock, [&]{
-                        return (!queue_tasks.empty() || !running);
-                    });
+                const auto has_work = [&]{
+                    return (!queue_tasks.empty() || !running);
+                };
+                if (!callback_idle) {
+                    condition_tasks.wait(lock, has_work);
+                }
+                while (callback_idle && !has_work()) {
+                    if (!condition_tasks.wait_for(lock, std::chrono::milliseconds(t_idle_ms), has_work)) {
+                        lock.unlock();
+                        callback_idle();
+                        lock.lock();
+                    }
                 }
             }
         }
@@ -2337,6 +3479,10 @@ struct server_context {
     bool vocab_dft_compatible = true;
 
     llama_model * model_dft = nullptr;
+    llama_context * ctx_dft = nullptr;
+
+    // static corpus of the lookup speculators, shared by all slots
+    common_suffix_automaton lookup_corpus;
 
     llama_context_params cparams_dft;
 
@@ -2344,12 +3490,22 @@ struct server_context {
 
     bool clean_kv_cache = true;
     bool add_bos_token  = true;
+    bool kv_share       = false; // share common prompt prefixes between the slots, see share_prompt_prefix()
+    bool kv_evict       = false; // the KV cache evicts the old or least attended tokens of the slots instead of shifting the context
+
+    int32_t n_kv_draft = 0; // cells of the paged KV cache taken by the drafts in the batch, until they are verified
+    bool spec_tree      = false; // verify the drafts as token trees, with the alternative tokens in extra sequences
 
     int32_t n_ctx; // total context for all clients / slots
 
     // slots / clients
     std::vector<server_slot> slots;
 
+    server_slot_index slot_index;
+
+    // first slot to receive prompt tokens in the next batch, see n_prefill_chunk
+    size_t i_slot_prefill = 0;
+
     int slots_debug = 0;
 
     server_queue    queue_tasks;
@@ -2373,15 +3529,13 @@ struct server_context {
             common_sampler_free(slot.smpl);
             slot.smpl = nullptr;
 
-            llama_free(slot.ctx_dft);
-            slot.ctx_dft = nullptr;
-
             common_speculative_free(slot.spec);
             slot.spec = nullptr;
-
-            llama_batch_free(slot.batch_spec);
         }
 
+        llama_free(ctx_dft);
+        ctx_dft = nullptr;
+
         llama_batch_free(batch);
     }
 
@@ -2416,9 +3570,14 @@ struct server_context {
             params_dft.n_ctx        = params_base.speculative.n_ctx == 0 ? params_base.n_ctx / params_base.n_parallel : params_base.speculative.n_ctx;
             params_dft.n_gpu_layers = params_base.speculative.n_gpu_layers;
             params_dft.n_parallel   = 1;
+            params_dft.speculative.n_branch = 0;
             params_dft.cache_type_k = params_base.speculative.cache_type_k;
             params_dft.cache_type_v = params_base.speculative.cache_type_v;
 
+            // the per-layer KV cache types are those of the target model
+            params_dft.cache_type_layers.clear();
+            params_dft.cache_type_auto = 0.0f;
+
             params_dft.cpuparams.n_threads = params_base.speculative.cpuparams.n_threads;
             params_dft.cpuparams_batch.n_threads = params_base.speculative.cpuparams_batch.n_threads;
             params_dft.tensor_buft_overrides = params_base.speculative.tensor_buft_overrides;
@@ -2440,12 +3599,42 @@ struct server_context {
             const int n_ctx_dft = llama_n_ctx(llama_init_dft.context.get());
 
             cparams_dft = common_context_params_to_llama(params_dft);
+            cparams_dft.n_ctx   = n_ctx_dft;
             cparams_dft.n_batch = n_ctx_dft;
 
-            // the context is not needed - we will create one for each slot
+            // the overrides would point into params_dft, which does not outlive load_model()
+            cparams_dft.kv_type_overrides = nullptr;
+
+            // the context is not needed - we will create one with a sequence for each slot
             llama_init_dft.context.reset();
         }
 
+        if (params_base.speculative.lookup && model_dft) {
+            SRV_WRN("%s", "--draft-lookup is ignored when a draft model is used\n");
+            params_base.speculative.lookup = false;
+        }
+
+        if (params_base.speculative.lookup) {
+            for (const auto & fname : params_base.speculative.lookup_corpus) {
+                std::ifstream file(fname, std::ios::binary);
+                if (!file) {
+                    SRV_ERR("failed to open lookup corpus '%s'\n", fname.c_str());
+                    return false;
+                }
+
+                const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                const llama_tokens tokens = common_tokenize(vocab, text, false, false);
+
+                // the separator ends the drafts at the end of each file
+                const llama_token sep = LLAMA_TOKEN_NULL;
+
+                common_suffix_automaton_add(lookup_corpus, tokens.data(), tokens.size());
+                common_suffix_automaton_add(lookup_corpus, &sep, 1);
+
+                SRV_INF("loaded lookup corpus '%s', %zu tokens\n", fname.c_str(), tokens.size());
+            }
+        }
+
         chat_templates = common_chat_templates_init(model, params_base.chat_template);
         try {
             common_chat_format_example(chat_templates.get(), params.use_jinja, params.default_template_kwargs);
@@ -2483,6 +3672,11 @@ struct server_context {
                 SRV_ERR("%s\n", "err: speculative decode is not supported by multimodal");
                 return false;
             }
+
+            if (params_base.speculative.lookup) {
+                params_base.speculative.lookup = false;
+                SRV_WRN("%s\n", "lookup drafting is not supported by multimodal, it will be disabled");
+            }
         }
 
         if (!llama_memory_can_shift(llama_get_memory(ctx))) {
@@ -2501,10 +3695,51 @@ struct server_context {
     }
 
     void init() {
-        const int32_t n_ctx_slot = n_ctx / params_base.n_parallel;
+        // the flags are ignored by the memory of some models, e.g. recurrent ones
+        kv_evict = llama_memory_can_evict(llama_get_memory(ctx));
+
+        if (kv_evict && params_base.ctx_shift) {
+            params_base.ctx_shift = false;
+            SRV_INF("%s\n", "the KV cache evicts the tokens of the slots, ctx_shift will be disabled");
+        }
+
+        // with a paged KV cache, the slots share the cells of the whole context
+        // with eviction, a slot is limited to the share of the context of a sequence, beyond which its tokens are evicted
+        // note: with speculative token trees, the branches of the slots are sequences too
+        int32_t n_ctx_slot = n_ctx / params_base.n_parallel;
+        if (kv_evict) {
+            n_ctx_slot = n_ctx / llama_n_seq_max(ctx);
+        } else if (params_base.kv_paged) {
+            n_ctx_slot = n_ctx;
+        }
 
         SRV_INF("initializing slots, n_slots = %d\n", params_base.n_parallel);
 
+        if (model_dft) {
+            // a single draft context, so that the drafts of all slots are evaluated together
+            cparams_dft.n_ctx      = cparams_dft.n_ctx*params_base.n_parallel;
+            cparams_dft.n_seq_max  = params_base.n_parallel;
+            cparams_dft.kv_unified = false;
+
+            ctx_dft = llama_init_from_model(model_dft, cparams_dft);
+            if (ctx_dft == nullptr) {
+                SRV_ERR("%s", "failed to create draft context\n");
+                return;
+            }
+
+            // the branches are verified in sequences n_parallel and above, which need a single KV stream
+            if (params_base.speculative.n_branch > 0) {
+                spec_tree = params_base.kv_unified && llama_n_seq_max(ctx) >= (uint32_t) (params_base.n_parallel*(1 + params_base.speculative.n_branch));
+                spec_tree = spec_tree && !llama_model_is_recurrent(model) && !llama_model_is_hybrid(model);
+
+                if (spec_tree) {
+                    SRV_INF("drafts are verified as token trees with up to %d branches\n", params_base.speculative.n_branch);
+                } else {
+                    SRV_WRN("%s", "draft branches require --kv-unified and a non-recurrent target model - disabling them\n");
+                }
+            }
+        }
+
         for (int i = 0; i < params_base.n_parallel; i++) {
             server_slot slot;
 
@@ -2514,16 +3749,10 @@ struct server_context {
             slot.mctx = mctx;
             slot.prompt.tokens.has_mtmd = mctx != nullptr;
 
-            if (model_dft) {
-                slot.batch_spec = llama_batch_init(params_base.speculative.n_max + 1, 0, 1);
-
-                slot.ctx_dft = llama_init_from_model(model_dft, cparams_dft);
-                if (slot.ctx_dft == nullptr) {
-                    SRV_ERR("%s", "failed to create draft context\n");
-                    return;
-                }
+            if (ctx_dft) {
+                slot.ctx_dft = ctx_dft;
 
-                slot.spec = common_speculative_init(slot.ctx, slot.ctx_dft);
+                slot.spec = common_speculative_init(slot.ctx, slot.ctx_dft, slot.id);
                 if (slot.spec == nullptr) {
                     SRV_ERR("%s", "failed to create speculator\n");
                     return;
@@ -2531,11 +3760,21 @@ struct server_context {
                 for (auto & pair : params_base.speculative.replacements) {
                     common_speculative_add_replacement_tgt_dft(slot.spec, pair.first.c_str(), pair.second.c_str());
                 }
+
+                if (spec_tree) {
+                    for (int b = 0; b < params_base.speculative.n_branch; ++b) {
+                        slot.seq_ids_branch.push_back(params_base.n_parallel + i*params_base.speculative.n_branch + b);
+                    }
+                }
+            } else if (params_base.speculative.lookup) {
+                slot.spec = common_speculative_init_lookup(slot.ctx, lookup_corpus.text.empty() ? nullptr : &lookup_corpus);
             }
 
             SLT_INF(slot, "new slot n_ctx_slot = %d\n", slot.n_ctx);
 
-            slot.callback_on_release = [this](int) {
+            slot.callback_on_release = [this](int id_slot) {
+                slot_index.update(id_slot, slots[id_slot].prompt.tokens);
+
                 queue_tasks.pop_deferred_task();
             };
 
@@ -2544,6 +3783,16 @@ struct server_context {
             slots.push_back(std::move(slot));
         }
 
+        // the cells of a shared prefix belong to several sequences at once, so they must live in a single KV stream
+        // and their positions must never be shifted or partially rolled back by any of the sequences
+        kv_share = params_base.kv_prefix_share && params_base.kv_unified && params_base.n_parallel > 1;
+        kv_share = kv_share && !params_base.ctx_shift && !kv_evict && params_base.n_cache_reuse == 0 && mctx == nullptr;
+        kv_share = kv_share && llama_model_n_swa(model) == 0 && !llama_model_is_recurrent(model) && !llama_model_is_hybrid(model);
+
+        if (kv_share) {
+            SRV_INF("%s", "prompt prefixes will be shared between the slots\n");
+        }
+
         {
             const char * LLAMA_SERVER_SLOTS_DEBUG = getenv("LLAMA_SERVER_SLOTS_DEBUG");
             slots_debug = LLAMA_SERVER_SLOTS_DEBUG ? atoi(LLAMA_SERVER_SLOTS_DEBUG) : 0;
@@ -2557,7 +3806,8 @@ struct server_context {
         // note that n_batch can be > n_ctx (e.g. for non-causal attention models such as BERT where the KV cache is not used)
         {
             const int32_t n_batch = llama_n_batch(ctx);
-            batch = llama_batch_init(std::max(n_batch, params_base.n_parallel), 0, 1);
+            // the drafts are verified in the batch, with the tokens of their branches in extra sequences
+            batch = llama_batch_init(std::max(n_batch, params_base.n_parallel), 0, 1 + (spec_tree ? params_base.speculative.n_branch : 0));
         }
 
         metrics.init();
@@ -2571,8 +3821,44 @@ struct server_context {
             SRV_WRN("%s", "use `--cache-ram 0` to disable the prompt cache\n");
 
             prompt_cache = std::make_unique<server_prompt_cache>(params_base.cache_ram_mib, n_ctx);
+
+            if (!params_base.cache_disk_path.empty()) {
+                char desc[256];
+                llama_model_desc(model, desc, sizeof(desc));
+
+                // the states can be restored only by the same model with the same KV cache types
+                std::string fingerprint = string_format("%s, %" PRIu64 " params, %s, K %s, V %s", desc, llama_model_n_params(model),
+                        server_model_identity(model, params_base.model.path).c_str(),
+                        ggml_type_name(params_base.cache_type_k), ggml_type_name(params_base.cache_type_v));
+
+                // the per-layer types, set on the command line or by the calibration
+                for (const auto & o : params_base.cache_type_layers) {
+                    if (o.il < 0) {
+                        break;
+                    }
+
+                    fingerprint += string_format(", layer %d K %s V %s", o.il,
+                            ggml_type_name(o.type_k == GGML_TYPE_COUNT ? params_base.cache_type_k : o.type_k),
+                            ggml_type_name(o.type_v == GGML_TYPE_COUNT ? params_base.cache_type_v : o.type_v));
+                }
+
+                if (params_base.cache_disk_mib < 0) {
+                    SRV_WRN("prompt cache disk tier is enabled in '%s', size limit: %s\n", params_base.cache_disk_path.c_str(), "no limit");
+                } else {
+                    SRV_WRN("prompt cache disk tier is enabled in '%s', size limit: %d MiB\n", params_base.cache_disk_path.c_str(), params_base.cache_disk_mib);
+                }
+
+                prompt_cache->disk = std::make_unique<server_prompt_cache_disk>(params_base.cache_disk_path, params_base.cache_disk_mib, fingerprint);
+            }
         } else {
             SRV_WRN("%s", "prompt cache is disabled - use `--cache-ram N` to enable it\n");
+
+            if (!params_base.cache_disk_path.empty()) {
+                SRV_WRN("%s", "the prompt cache disk tier requires the prompt cache, it will be disabled\n");
+            }
+            if (params_base.cache_idle_sec > 0) {
+                SRV_WRN("%s", "the offload of the idle slots requires the prompt cache, it will be disabled\n");
+            }
         }
         SRV_WRN("%s", "for more info see https://github.com/ggml-org/llama.cpp/pull/16391\n");
 
@@ -2613,27 +3899,56 @@ struct server_context {
         if (ret == nullptr && slot_prompt_similarity != 0.0f) {
             float sim_best = 0;
 
-            for (server_slot & slot : slots) {
-                // skip the slot if it is not available
-                if (slot.is_processing()) {
-                    continue;
-                }
+            int id_slot = -1;
+            int n_lcp   = 0;
 
-                const auto & tokens = slot.prompt.tokens;
+            // skip the slots that are not available or do not contain cached tokens
+            const auto accept = [&](int id) {
+                return !slots[id].is_processing() && !slots[id].prompt.tokens.empty();
+            };
 
-                // skip the slot if it does not contains cached tokens
-                if (tokens.empty()) {
-                    continue;
+            if (mctx == nullptr) {
+                slot_index.find(task.tokens.get_text_tokens(), accept, id_slot);
+            }
+
+            if (id_slot >= 0) {
+                // the index matches full blocks only, so count the exact Longest Common Prefix of the candidate
+                n_lcp = slots[id_slot].prompt.tokens.get_common_prefix(task.tokens);
+            } else {
+                // no full block matches, or the prompt is multimodal - scan the slots for a shorter common prefix
+                for (const server_slot & slot : slots) {
+                    if (!accept(slot.id)) {
+                        continue;
+                    }
+
+                    const int n_cur = slot.prompt.tokens.get_common_prefix(task.tokens);
+                    if (n_cur > n_lcp) {
+                        n_lcp   = n_cur;
+                        id_slot = slot.id;
+                    }
                 }
+            }
+
+            if (id_slot >= 0) {
+                server_slot & slot = slots[id_slot];
 
                 // fraction of the Longest Common Prefix length with respect to the input prompt length
-                const float sim_cur = float(tokens.get_common_prefix(task.tokens)) / task.tokens.size();
+                const float sim_cur = float(n_lcp) / task.tokens.size();
 
-                // select the current slot if the criteria match
-                if (sim_cur > sim_best && sim_cur > slot_prompt_similarity) {
-                    sim_best = sim_cur;
+                sim_best = sim_cur;
+
+                // a longer prefix in the prompt cache is restored into the least recently used slot below
+                const bool prefer_cache = prompt_cache && task.type == SERVER_TASK_TYPE_COMPLETION && mctx == nullptr &&
+                    prompt_cache->n_match(task.tokens) > (size_t) n_lcp;
 
+                if (prefer_cache) {
+                    SLT_INF(slot, "prompt cache holds a longer prefix than the slot (n_lcp = %d)\n", n_lcp);
+
+                    metrics.n_slot_select_cache++;
+                } else if (sim_cur > slot_prompt_similarity) {
                     ret = &slot;
+
+                    metrics.n_slot_select_prefix++;
                 }
             }
 
@@ -2677,13 +3992,16 @@ struct server_context {
         if (ret) {
             const auto & tokens = ret->prompt.tokens;
 
+            metrics.n_slot_select_total++;
+
             update_cache = update_cache && prompt_cache;
 
             // cache prompts only for completion tasks
             update_cache = update_cache && task.type == SERVER_TASK_TYPE_COMPLETION;
 
-            // don't update the cache if the slot's context is empty
-            update_cache = update_cache && tokens.size() > 0;
+            // don't update the cache if the slot's context is empty, unless the disk tier can provide a prompt after a restart
+            // or the KV cache of an idle slot has been offloaded to the cache
+            update_cache = update_cache && (tokens.size() > 0 || prompt_cache->disk || params_base.cache_idle_sec > 0);
 
             // TODO: mtmd does not support prompt cache
             update_cache = update_cache && (ret->mctx == nullptr);
@@ -2693,7 +4011,9 @@ struct server_context {
 
                 const int64_t t_start = ggml_time_us();
 
-                ret->prompt_save(*prompt_cache);
+                if (tokens.size() > 0) {
+                    ret->prompt_save(*prompt_cache);
+                }
                 ret->prompt_load(*prompt_cache, task.tokens);
 
                 prompt_cache->update();
@@ -2705,9 +4025,154 @@ struct server_context {
         return ret;
     }
 
+    // map the longest prefix of the prompt that another slot already holds in the KV cache into the sequence of
+    // this slot, so that it is neither stored nor computed twice. returns the new number of cached tokens
+    int32_t share_prompt_prefix(server_slot & slot, const server_tokens & tokens) {
+        const server_slot * src = nullptr;
+
+        int32_t n_share = slot.n_past;
+
+        for (const server_slot & other : slots) {
+            if (other.id == slot.id || other.prompt.tokens.size() <= (size_t) n_share) {
+                continue;
+            }
+
+            // the cached KV data depends on the active adapters
+            if (!are_lora_equal(other.lora, slot.lora)) {
+                continue;
+            }
+
+            // tokens that were only added to the batch are not in the KV cache yet
+            const int32_t n_kv = llama_memory_seq_pos_max(llama_get_memory(ctx), other.id) + 1;
+
+            const int32_t n_cur = std::min<int32_t>(other.prompt.tokens.get_common_prefix(tokens), n_kv);
+            if (n_cur > n_share) {
+                n_share = n_cur;
+                src     = &other;
+            }
+        }
+
+        if (src == nullptr) {
+            return slot.n_past;
+        }
+
+        SLT_INF(slot, "sharing %d prompt tokens with slot %d (n_past = %d)\n", n_share, src->id, slot.n_past);
+
+        llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+        llama_memory_seq_cp(llama_get_memory(ctx), src->id, slot.id, 0, n_share);
+
+        const llama_tokens & text = tokens.get_text_tokens();
+
+        slot.prompt.tokens.clear();
+        slot.prompt.tokens.insert({ text.begin(), text.begin() + n_share });
+
+        return n_share;
+    }
+
+    // suspend the lowest priority generation below the priority of the task and defer it, so that its slot can be
+    // assigned to the task. the KV cache of the suspended slot is saved in the prompt cache
+    server_slot * preempt_slot(const server_task & task) {
+        // TODO: mtmd does not support prompt cache
+        if (!params_base.slot_preempt || mctx != nullptr) {
+            return nullptr;
+        }
+
+        server_slot * ret = nullptr;
+
+        for (server_slot & slot : slots) {
+            // a slot that is still processing its prompt cannot be suspended
+            if (slot.state != SLOT_STATE_GENERATING || slot.task->params.priority >= task.params.priority) {
+                continue;
+            }
+
+            if (!ret || slot.task->params.priority < ret->task->params.priority) {
+                ret = &slot;
+            }
+        }
+
+        if (ret == nullptr) {
+            return nullptr;
+        }
+
+        server_slot & slot = *ret;
+
+        SLT_INF(slot, "preempting task %d (priority = %d) for task %d (priority = %d)\n",
+                slot.task->id, slot.task->params.priority, task.id, task.params.priority);
+
+        server_task task_susp(slot.task->type);
+
+        task_susp.id      = slot.task->id;
+        task_susp.index   = slot.task->index;
+        task_susp.id_slot = slot.task->id_slot;
+        task_susp.params  = slot.task->params;
+        task_susp.tokens  = server_tokens(slot.task->tokens.get_text_tokens(), false);
+        task_susp.resume  = slot.suspend();
+
+        if (prompt_cache) {
+            slot.prompt_save(*prompt_cache);
+            prompt_cache->update();
+        }
+
+        llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+        slot.prompt.tokens.clear();
+        slot.prompt.checkpoints.clear();
+
+        slot_index.update(slot.id, slot.prompt.tokens);
+
+        metrics.n_preempted++;
+
+        queue_tasks.defer(std::move(task_susp));
+
+        return ret;
+    }
+
+    // bring the KV cache of the slot to the state of the suspended task, from the prompt cache if it is still there
+    // otherwise the missing tokens are recomputed in the next batches like a prompt, see SLOT_STATE_RESUMING
+    void resume_slot(server_slot & slot, server_task_resume & res) {
+        const server_tokens tokens(res.tokens, false);
+
+        if (prompt_cache && slot.prompt.tokens.get_common_prefix(tokens) < tokens.size()) {
+            slot.prompt_load(*prompt_cache, tokens);
+        }
+
+        auto * mem = llama_get_memory(ctx);
+
+        int32_t n_keep = slot.prompt.tokens.get_common_prefix(tokens);
+
+        if (n_keep < (int32_t) tokens.size()) {
+            // note: when n_swa == 0, the model does not use SWA, which is equivalent to a window of 1
+            const auto n_swa = std::max(1, llama_model_n_swa(model));
+
+            // the positions before the kept tokens that are still needed may already be gone
+            if (llama_memory_seq_pos_min(mem, slot.id) > std::max(0, n_keep - n_swa) || !llama_memory_seq_rm(mem, slot.id, n_keep, -1)) {
+                llama_memory_seq_rm(mem, slot.id, -1, -1);
+                n_keep = 0;
+            }
+
+            SLT_WRN(slot, "suspended state is not in the prompt cache, recomputing %d tokens\n", (int) tokens.size() - n_keep);
+
+            slot.prompt.tokens.keep_first(n_keep);
+
+            slot.n_past  = n_keep;
+            slot.i_batch = -1;
+            slot.state   = SLOT_STATE_RESUMING;
+
+            return;
+        }
+
+        slot.prompt.tokens = server_tokens(res.tokens, false);
+
+        slot.resume(res);
+    }
+
     bool launch_slot_with_task(server_slot & slot, server_task && task) {
         slot.reset();
 
+        // the prompt of the task is not a continuation of the drafts of the previous one
+        if (slot.spec) {
+            common_speculative_reset(slot.spec);
+        }
+
         if (!are_lora_equal(task.params.lora, slot.lora)) {
             // if lora has changed, check to see if the cache should be cleared
             if (lora_should_clear_cache(slot.lora, task.params.lora)) {
@@ -2774,8 +4239,8 @@ struct server_context {
 
         SLT_DBG(slot, "launching slot : %s\n", safe_json_to_str(slot.to_json()).c_str());
 
-        // initialize samplers
-        {
+        // initialize samplers, a resumed task continues with its own sampler
+        if (!task.resume) {
             if (slot.smpl != nullptr) {
                 common_sampler_free(slot.smpl);
             }
@@ -2788,14 +4253,15 @@ struct server_context {
             }
         }
 
-        // initialize draft batch
-        if (slot.ctx_dft) {
-            llama_batch_free(slot.batch_spec);
+        slot.task = std::make_unique<const server_task>(std::move(task));
+
+        if (slot.task->resume) {
+            resume_slot(slot, *slot.task->resume);
 
-            slot.batch_spec = llama_batch_init(task.params.speculative.n_max + 1, 0, 1);
-        }
+            slot_index.update(slot.id, slot.prompt.tokens);
 
-        slot.task = std::make_unique<const server_task>(std::move(task));
+            return true;
+        }
 
         slot.state = SLOT_STATE_STARTED;
 
@@ -2804,6 +4270,98 @@ struct server_context {
         return true;
     }
 
+    // move the KV cache of the slots that have not been used for --cache-idle seconds to the prompt cache, from where
+    // it spills to the disk tier. the cells are freed for the active slots, and the prompt is restored from the cache
+    // when a new task selects the slot
+    void offload_idle_slots() {
+        if (!prompt_cache || params_base.cache_idle_sec <= 0) {
+            return;
+        }
+
+        const int64_t t_now = ggml_time_us();
+
+        for (server_slot & slot : slots) {
+            // TODO: mtmd does not support prompt cache
+            if (slot.is_processing() || slot.prompt.tokens.empty() || slot.mctx != nullptr) {
+                continue;
+            }
+
+            if (t_now - slot.t_last_used < params_base.cache_idle_sec*1000000LL) {
+                continue;
+            }
+
+            SLT_INF(slot, "offloading the KV cache of the idle slot, n_tokens = %d, idle for %.1f s\n",
+                    (int) slot.prompt.tokens.size(), (t_now - slot.t_last_used) / 1e6);
+
+            offload_slot(slot);
+        }
+    }
+
+    // free the KV cells of an idle slot, its prompt is saved in the prompt cache if there is one
+    void offload_slot(server_slot & slot) {
+        if (prompt_cache && slot.mctx == nullptr) {
+            slot.prompt_save(*prompt_cache);
+            prompt_cache->update();
+
+            metrics.n_offloaded++;
+        }
+
+        llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+        slot.prompt.tokens.clear();
+        slot.prompt.checkpoints.clear();
+
+        slot_index.update(slot.id, slot.prompt.tokens);
+    }
+
+    // with a paged KV cache, each slot can use the whole context, so the cells are counted against the shared pool:
+    // the cells used by the slots, and the ones still needed by the admitted prompts that are being processed
+    // the cells shared by several slots are counted for each of them, so this is an upper bound
+    int32_t n_kv_used() const {
+        int32_t n_used = 0;
+
+        for (const auto & slot : slots) {
+            int32_t n = slot.prompt.n_tokens();
+
+            if (slot.state == SLOT_STATE_PROCESSING_PROMPT) {
+                n = std::max(n, slot.n_prompt_tokens());
+            } else if (slot.state == SLOT_STATE_RESUMING) {
+                n = std::max(n, (int32_t) slot.task->resume->tokens.size());
+            }
+
+            n_used += n;
+        }
+
+        return n_used + n_kv_draft;
+    }
+
+    // check that n_tokens more cells are available in the shared pool, the idle slots are offloaded if needed
+    // without a paged KV cache, each slot has its own part of the context, and this always succeeds
+    bool kv_reserve(int32_t n_tokens) {
+        if (!params_base.kv_paged || kv_evict) {
+            return true;
+        }
+
+        if (n_kv_used() + n_tokens <= n_ctx) {
+            return true;
+        }
+
+        for (server_slot & slot : slots) {
+            if (slot.is_processing() || slot.prompt.tokens.empty()) {
+                continue;
+            }
+
+            SLT_INF(slot, "offloading the KV cache of the idle slot to free cells in the pool, n_tokens = %d\n", slot.prompt.n_tokens());
+
+            offload_slot(slot);
+
+            if (n_kv_used() + n_tokens <= n_ctx) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     void kv_cache_clear() {
         SRV_DBG("%s", "clearing KV cache\n");
 
@@ -2865,7 +4423,7 @@ struct server_context {
         }
 
         // if context shifting is disabled, make sure that we don't run out of context
-        if (!params_base.ctx_shift && slot.n_past + 1 >= slot.n_ctx) {
+        if (!params_base.ctx_shift && !kv_evict && slot.n_past + 1 >= slot.n_ctx) {
             slot.stop           = STOP_TYPE_LIMIT;
             slot.has_next_token = false;
 
@@ -2930,7 +4488,7 @@ struct server_context {
         }
 
         // if context shift is disabled, we stop when it reaches the context limit
-        if (slot.n_past >= slot.n_ctx) {
+        if (!kv_evict && slot.n_past >= slot.n_ctx) {
             slot.truncated      = true;
             slot.stop           = STOP_TYPE_LIMIT;
             slot.has_next_token = false;
@@ -3328,8 +4886,18 @@ struct server_context {
                 {
                     const int id_slot = task.id_slot;
 
+                    // a task that missed its deadline while waiting for a slot is not started anymore
+                    if (!task.resume && task.params.t_deadline >= 0 && ggml_time_us() > task.params.t_deadline) {
+                        send_error(task, "the deadline of the request passed before a slot became available", ERROR_TYPE_UNAVAILABLE);
+                        break;
+                    }
+
                     server_slot * slot = id_slot != -1 ? get_slot_by_id(id_slot) : get_available_slot(task);
 
+                    if (slot == nullptr && id_slot == -1 && preempt_slot(task) != nullptr) {
+                        slot = get_available_slot(task);
+                    }
+
                     if (slot == nullptr) {
                         // if no slot is available, we defer this task for processing later
                         SRV_DBG("no slot is available, defer task, id_task = %d\n", task.id);
@@ -3370,9 +4938,26 @@ struct server_context {
                     int n_idle_slots       = 0;
                     int n_processing_slots = 0;
 
+                    std::vector<uint64_t> hist_n_draft;
+                    std::vector<uint64_t> hist_n_accept;
+
+                    const auto hist_add = [](std::vector<uint64_t> & dst, const std::vector<uint64_t> & src) {
+                        dst.resize(std::max(dst.size(), src.size()), 0);
+                        for (size_t i = 0; i < src.size(); ++i) {
+                            dst[i] += src[i];
+                        }
+                    };
+
                     for (server_slot & slot : slots) {
                         json slot_data = slot.to_json(slots_debug == 0);
 
+                        if (slot.spec) {
+                            const auto stats = common_speculative_get_stats(slot.spec);
+
+                            hist_add(hist_n_draft,  stats.hist_n_draft);
+                            hist_add(hist_n_accept, stats.hist_n_accept);
+                        }
+
                         if (slot.is_processing()) {
                             n_processing_slots++;
                         } else {
@@ -3406,6 +4991,18 @@ struct server_context {
                     res->n_decode_total          = metrics.n_decode_total;
                     res->n_busy_slots_total      = metrics.n_busy_slots_total;
 
+                    res->n_prompt_tokens_cached_total = metrics.n_prompt_tokens_cached_total;
+
+                    res->n_slot_select_total     = metrics.n_slot_select_total;
+                    res->n_slot_select_prefix    = metrics.n_slot_select_prefix;
+                    res->n_slot_select_cache     = metrics.n_slot_select_cache;
+                    res->n_prompt_cache_restored = prompt_cache ? prompt_cache->n_restored : 0;
+                    res->n_preempted             = metrics.n_preempted;
+                    res->n_offloaded             = metrics.n_offloaded;
+
+                    res->hist_n_draft  = std::move(hist_n_draft);
+                    res->hist_n_accept = std::move(hist_n_accept);
+
                     if (task.metrics_reset_bucket) {
                         metrics.reset_bucket();
                     }
@@ -3486,6 +5083,8 @@ struct server_context {
                     slot->prompt.tokens.clear();
                     slot->prompt.tokens.insert(tokens);
 
+                    slot_index.update(slot->id, slot->prompt.tokens);
+
                     const int64_t t_end = ggml_time_us();
                     const double t_restore_ms = (t_end - t_start) / 1000.0;
 
@@ -3522,6 +5121,8 @@ struct server_context {
                     llama_memory_seq_rm(llama_get_memory(ctx), slot->id, -1, -1);
                     slot->prompt.tokens.clear();
 
+                    slot_index.update(slot->id, slot->prompt.tokens);
+
                     auto res = std::make_unique<server_task_result_slot_erase>();
                     res->id       = task.id;
                     res->id_slot  = id_slot;
@@ -3540,6 +5141,8 @@ struct server_context {
     }
 
     void update_slots() {
+        offload_idle_slots();
+
         // check if all slots are idle
         {
             bool all_idle = true;
@@ -3573,6 +5176,12 @@ struct server_context {
         // TODO: simplify and improve
         for (server_slot & slot : slots) {
             if (slot.is_processing() && slot.n_past + 1 >= slot.n_ctx) {
+                if (kv_evict) {
+                    // the KV cache evicts the old tokens of the slot by itself
+                    slot.truncated = true;
+                    continue;
+                }
+
                 if (!params_base.ctx_shift) {
                     // this check is redundant (for good)
                     // we should never get here, because generation should already stopped in process_token()
@@ -3616,6 +5225,10 @@ struct server_context {
                     slot.prompt.tokens.insert(new_tokens);
                 }
 
+                if (slot.spec) {
+                    common_speculative_reset(slot.spec);
+                }
+
                 slot.n_past -= n_discard;
 
                 slot.truncated = true;
@@ -3633,6 +5246,184 @@ struct server_context {
                 slot.task->params.sampling.preserved_tokens.find(token) != slot.task->params.sampling.preserved_tokens.end();
         };
 
+        // accept the longest path of the draft tree that the target model agrees with
+        // the tree was decoded at the indices idxs of the batch, in the view of n_view tokens that starts at i_view
+        auto verify_draft = [&](server_slot & slot, const common_speculative_draft & draft, const std::vector<int> & idxs, int32_t i_view, int32_t n_view, int64_t t_verify) {
+            GGML_ASSERT(idxs.front() >= i_view && idxs.back() < i_view + n_view);
+
+            std::vector<int> idxs_view(idxs.size());
+            for (size_t j = 0; j < idxs.size(); ++j) {
+                idxs_view[j] = idxs[j] - i_view;
+            }
+
+            // the accepted tokens from the speculation, possibly ending with one of the branches
+            int i_branch = -1;
+
+            const auto ids = common_speculative_tree_sample(slot.smpl, ctx, idxs_view, draft.result, draft.branches, i_branch);
+
+            // n_past was already increased for the sampled token
+            common_speculative_tree_keep(ctx, slot.id, { slot.seq_ids_branch.begin(), slot.seq_ids_branch.begin() + draft.branches.size() }, slot.n_past - 1, ids.size(), i_branch);
+
+            slot.n_past += ids.size() - 1;
+
+            slot.t_token_generation = std::max<int64_t>(1, ggml_time_us() - slot.t_start_generation) / 1e3;
+
+            // update how many tokens out of those tested were accepted
+            slot.n_draft_accepted += ids.size() - 1;
+
+            // a token accepted on a branch is not an acceptance of the draft at that position
+            const int n_accept_draft = ids.size() - 1 - (i_branch >= 0 ? 1 : 0);
+
+            common_speculative_accept(slot.spec, draft.result.size(), n_accept_draft, i_branch >= 0, n_view, n_view - (int) idxs.size(), t_verify);
+
+            slot.prompt.tokens.insert({ids.begin(), ids.end() - 1});
+
+            for (size_t j = 0; j < ids.size(); ++j) {
+                // counted one by one, so that the limit of n_predict is checked after each token
+                slot.n_decoded += 1;
+
+                completion_token_output result;
+
+                result.tok          = ids[j];
+                result.text_to_send = common_token_to_piece(ctx, result.tok, accept_special_token(slot, result.tok));
+                result.prob         = 1.0f; // set later
+
+                // TODO: set result.probs
+
+                if (!process_token(result, slot)) {
+                    slot.print_timings();
+                    send_final_response(slot);
+                    metrics.on_prediction(slot);
+                    slot.release();
+
+                    break;
+                }
+            }
+
+            SLT_DBG(slot, "accepted %d/%d draft tokens, branch = %d, new n_past = %d\n", (int) ids.size() - 1, (int) draft.result.size(), i_branch, slot.n_past);
+        };
+
+        // process in chunks of params.n_batch
+        int32_t n_batch  = llama_n_batch(ctx);
+        int32_t n_ubatch = llama_n_ubatch(ctx);
+
+        // the drafts of the speculating slots are generated together on the shared draft context
+        // each draft is verified in this batch, together with the sampled token of its slot
+        std::vector<common_speculative_draft> drafts;
+
+        // for each slot, the index of its draft (-1 if none), and the batch indices of its sampled token, draft and branches
+        std::vector<int>              i_draft(slots.size(), -1);
+        std::vector<std::vector<int>> idxs_draft(slots.size());
+
+        {
+            // only the slots that can be batched with the first generating one are decoded in this batch
+            const server_slot * slot_gen = nullptr;
+
+            std::vector<server_slot *> slots_spec;
+
+            // with a paged KV cache, the drafts are verified in the cells of the shared pool that are not used
+            const bool kv_pool = params_base.kv_paged && !kv_evict;
+
+            int32_t n_kv_spec = kv_pool ? n_ctx - n_kv_used() : 0;
+
+            for (auto & slot : slots) {
+                if (slot.state != SLOT_STATE_GENERATING) {
+                    continue;
+                }
+
+                if (!slot_gen) {
+                    slot_gen = &slot;
+                }
+
+                if (!slot.can_speculate() || !slot_gen->can_batch_with(slot)) {
+                    continue;
+                }
+
+                if (mctx) {
+                    // we should never reach this, as speculative is automatically disabled if mmproj is loaded
+                    GGML_ABORT("not supported by multimodal");
+                }
+
+                // determine the max draft that fits the current slot state
+                int n_draft_max = slot.task->params.speculative.n_max;
+
+                // note: n_past is not yet increased for the sampled token
+                //       also, need to leave space for 1 extra token to allow context shifts
+                n_draft_max = std::min(n_draft_max, slot.n_ctx - slot.n_past - 2);
+
+                // the draft is verified together with the sampled token in a single batch
+                n_draft_max = std::min(n_draft_max, n_batch - 1);
+
+                // the sampled token and the branches also take cells of the pool
+                const int32_t n_kv_other = 1 + (int32_t) slot.seq_ids_branch.size();
+                if (kv_pool) {
+                    n_draft_max = std::min(n_draft_max, n_kv_spec - n_kv_other);
+                }
+
+                if (slot.n_remaining > 0) {
+                    n_draft_max = std::min(n_draft_max, slot.n_remaining - 1);
+                }
+
+                SLT_DBG(slot, "max possible draft: %d\n", n_draft_max);
+
+                if (n_draft_max < slot.task->params.speculative.n_min) {
+                    SLT_DBG(slot, "the max possible draft is too small: %d < %d - skipping speculative decoding\n", n_draft_max, slot.task->params.speculative.n_min);
+
+                    continue;
+                }
+
+                if (slot.task->params.speculative.adaptive) {
+                    n_draft_max = common_speculative_n_draft(slot.spec, slot.task->params.speculative.n_min, n_draft_max);
+
+                    SLT_DBG(slot, "adaptive draft length: %d\n", n_draft_max);
+
+                    if (n_draft_max == 0) {
+                        continue;
+                    }
+                } else {
+                    // only record the draft length for the statistics
+                    common_speculative_n_draft(slot.spec, n_draft_max, n_draft_max);
+                }
+
+                common_speculative_draft draft;
+                draft.spec            = slot.spec;
+                draft.params.n_draft  = n_draft_max;
+                draft.params.n_reuse  = slot.ctx_dft ? llama_n_ctx(slot.ctx_dft)/llama_n_seq_max(slot.ctx_dft) - slot.task->params.speculative.n_max : 0;
+                draft.params.p_min    = slot.task->params.speculative.p_min;
+                draft.params.n_branch = slot.seq_ids_branch.size();
+                draft.params.p_split  = params_base.speculative.p_split;
+                draft.params.n_lookup_min = params_base.speculative.lookup_min;
+                draft.prompt          = &slot.prompt.tokens.get_text_tokens();
+                draft.id_last         = slot.sampled;
+
+                drafts.push_back(std::move(draft));
+                slots_spec.push_back(&slot);
+
+                n_kv_spec -= n_kv_other + n_draft_max;
+            }
+
+            common_speculative_gen_draft_batch(drafts);
+
+            for (size_t k = 0; k < drafts.size(); ++k) {
+                const server_slot & slot = *slots_spec[k];
+
+                // the lookup speculators draft nothing when the end of the context has no earlier match
+                if (drafts[k].result.empty()) {
+                    continue;
+                }
+
+                if (slot.task->params.speculative.n_min > (int) drafts[k].result.size()) {
+                    SLT_DBG(slot, "ignoring small draft: %d < %d\n", (int) drafts[k].result.size(), slot.task->params.speculative.n_min);
+
+                    continue;
+                }
+
+                i_draft[slot.id] = k;
+            }
+        }
+
+        n_kv_draft = 0;
+
         // frist, add sampled tokens from any ongoing sequences
         for (auto & slot : slots) {
             if (slot.state != SLOT_STATE_GENERATING) {
@@ -3640,15 +5431,46 @@ struct server_context {
             }
 
             // check if we can batch this slot with the previous one
+            if (slot_batched && !slot_batched->can_batch_with(slot)) {
+                continue;
+            }
+
+            // the cells of a paged KV cache are used by the other slots
+            if (!kv_reserve(1)) {
+                send_error(slot, "the KV cache is full", ERROR_TYPE_UNAVAILABLE);
+                slot.release();
+                continue;
+            }
+
             if (!slot_batched) {
                 slot_batched = &slot;
-            } else if (!slot_batched->can_batch_with(slot)) {
-                continue;
             }
 
             slot.i_batch = batch.n_tokens;
 
-            common_batch_add(batch, slot.sampled, slot.n_past, { slot.id }, true);
+            if (i_draft[slot.id] >= 0) {
+                const auto & draft = drafts[i_draft[slot.id]];
+
+                const int32_t n_tree = draft.result.size() + draft.branches.size();
+
+                // the sampled token is decoded alone if its draft does not fit in the batch or in the KV cache
+                if (batch.n_tokens + 1 + n_tree > n_batch || !kv_reserve(1 + n_tree)) {
+                    i_draft[slot.id] = -1;
+                }
+            }
+
+            if (i_draft[slot.id] >= 0) {
+                const auto & draft = drafts[i_draft[slot.id]];
+
+                // keep track of total number of drafted tokens tested
+                slot.n_draft_total += draft.result.size();
+
+                idxs_draft[slot.id] = common_speculative_tree_add(ctx, batch, slot.id, slot.seq_ids_branch, slot.n_past, slot.sampled, draft.result, draft.branches);
+
+                n_kv_draft += draft.result.size() + draft.branches.size();
+            } else {
+                common_batch_add(batch, slot.sampled, slot.n_past, { slot.id }, true);
+            }
 
             slot.n_past += 1;
             slot.prompt.tokens.push_back(slot.sampled);
@@ -3657,15 +5479,22 @@ struct server_context {
                     slot.n_ctx, slot.n_past, (int) slot.prompt.tokens.size(), slot.truncated);
         }
 
-        // process in chunks of params.n_batch
-        int32_t n_batch  = llama_n_batch(ctx);
-        int32_t n_ubatch = llama_n_ubatch(ctx);
+        // the generated tokens above are always admitted, the prompts only fill the rest of the token budget
+        const int32_t n_batch_prompt = params_base.n_batch_budget > 0 ? std::min(n_batch, params_base.n_batch_budget) : n_batch;
+
+        // with a per-slot prompt chunk, visit the slots round-robin so that the chunks are shared fairly
+        const size_t i_slot_first = params_base.n_prefill_chunk > 0 ? i_slot_prefill++ % slots.size() : 0;
+
+        // number of generated tokens in the batch, the prompt tokens are added after them
+        const int32_t n_tokens_gen = batch.n_tokens;
 
         // next, batch any pending prompts without exceeding n_batch
         float alora_scale = -1.0f;
         size_t alora_disabled_id = 0;
         if (params_base.cont_batching || batch.n_tokens == 0) {
-            for (auto & slot : slots) {
+            for (size_t i_slot = 0; i_slot < slots.size(); ++i_slot) {
+                auto & slot = slots[(i_slot_first + i_slot) % slots.size()];
+
                 // check if we can batch this slot with the previous one
                 if (slot.is_processing()) {
                     if (!slot_batched) {
@@ -3675,6 +5504,22 @@ struct server_context {
                     }
                 }
 
+                // this slot recomputes the KV cache of its suspended task, the generation resumes once it is decoded
+                if (slot.state == SLOT_STATE_RESUMING) {
+                    const llama_tokens & tokens = slot.task->resume->tokens;
+
+                    while (slot.n_past < (int32_t) tokens.size() && batch.n_tokens < n_batch_prompt) {
+                        common_batch_add(batch, tokens[slot.n_past], slot.n_past, { slot.id }, false);
+
+                        slot.prompt.tokens.push_back(tokens[slot.n_past]);
+                        slot.n_past++;
+                    }
+
+                    if (slot.n_past == (int32_t) tokens.size()) {
+                        slot.i_batch = batch.n_tokens - 1;
+                    }
+                }
+
                 // this slot still has a prompt to be processed
                 if (slot.state == SLOT_STATE_PROCESSING_PROMPT || slot.state == SLOT_STATE_STARTED) {
                     const auto & input_tokens = slot.task->tokens;
@@ -3721,6 +5566,13 @@ struct server_context {
                             continue;
                         }
 
+                        // with a paged KV cache, the prompt is admitted only if its cells are available in the pool
+                        if (!kv_reserve(0)) {
+                            send_error(slot, "not enough free cells in the KV cache for the request, try again later", ERROR_TYPE_UNAVAILABLE);
+                            slot.release();
+                            continue;
+                        }
+
                         if (!slot.can_split()) {
                             if (slot.n_prompt_tokens() > n_ubatch) {
                                 send_error(slot, "input is too large to process. increase the physical batch size", ERROR_TYPE_SERVER);
@@ -3728,13 +5580,13 @@ struct server_context {
                                 continue;
                             }
 
-                            if (slot.n_prompt_tokens() > slot.n_ctx) {
+                            if (!kv_evict && slot.n_prompt_tokens() > slot.n_ctx) {
                                 send_error(slot, "input is larger than the max context size. skipping", ERROR_TYPE_EXCEED_CONTEXT_SIZE);
                                 slot.release();
                                 continue;
                             }
                         } else {
-                            if (slot.n_prompt_tokens() >= slot.n_ctx) {
+                            if (!kv_evict && slot.n_prompt_tokens() >= slot.n_ctx) {
                                 send_error(slot, "the request exceeds the available context size, try increasing it", ERROR_TYPE_EXCEED_CONTEXT_SIZE);
                                 slot.release();
                                 continue;
@@ -3744,6 +5596,12 @@ struct server_context {
                                 // reuse any previously computed tokens that are common with the new prompt
                                 slot.n_past = slot.prompt.tokens.get_common_prefix(input_tokens);
 
+                                // once tokens of the slot were evicted, the KV cache no longer matches its tokens
+                                const int n_kv_kept = params_base.n_kv_budget > 0 ? std::min(params_base.n_kv_budget, slot.n_ctx) : slot.n_ctx;
+                                if (kv_evict && (int) slot.prompt.tokens.size() > n_kv_kept) {
+                                    slot.n_past = 0;
+                                }
+
                                 // if there is an alora invoked, don't cache after the invocation start
                                 if (slot.alora_invocation_start >= 0) {
                                     SLT_DBG(slot, "only caching to alora invocation start (n_past=%d, alora_invocation_start=%d)\n", slot.n_past, slot.alora_invocation_start);
@@ -3798,6 +5656,10 @@ struct server_context {
 
                                     SLT_DBG(slot, "after context reuse, new slot.n_past = %d\n", slot.n_past);
                                 }
+
+                                if (kv_share && slot.task->type == SERVER_TASK_TYPE_COMPLETION && !lora_all_alora(slot.lora)) {
+                                    slot.n_past = share_prompt_prefix(slot, input_tokens);
+                                }
                             } else {
                                 // if we don't cache the prompt, we have to remove the entire KV cache
                                 slot.n_past = 0;
@@ -3922,9 +5784,13 @@ struct server_context {
                         slot.n_prompt_tokens_processed = 0;
                     }
 
+                    // the prompts that cannot be split are added whole, within the prompt budget of the batch, or up to
+                    // n_batch if they are the first prompt of the batch so that they are not starved by the budget
+                    const int32_t n_batch_slot = slot.can_split() || batch.n_tokens > n_tokens_gen ? n_batch_prompt : n_batch;
+
                     if (!slot.can_split()) {
                         // cannot fit the prompt in the current batch - will try next iter
-                        if (batch.n_tokens + slot.n_prompt_tokens() > n_batch) {
+                        if (batch.n_tokens + slot.n_prompt_tokens() > n_batch_slot) {
                             continue;
                         }
                     }
@@ -3999,8 +5865,11 @@ struct server_context {
                             (llama_model_n_swa(model) > 0 && !params_base.swa_full)
                             );
 
+                    // limit the number of prompt tokens of this slot in the current batch
+                    const int32_t n_past_max = params_base.n_prefill_chunk > 0 && slot.can_split() ? slot.n_past + params_base.n_prefill_chunk : slot.n_prompt_tokens();
+
                     // add prompt tokens for processing in the current batch
-                    while (slot.n_past < slot.n_prompt_tokens() && batch.n_tokens < n_batch) {
+                    while (slot.n_past < std::min(slot.n_prompt_tokens(), n_past_max) && batch.n_tokens < n_batch_slot) {
                         // get next token to process
                         llama_token cur_tok = input_tokens[slot.n_past];
                         if (cur_tok == LLAMA_TOKEN_NULL) {
@@ -4092,7 +5961,7 @@ struct server_context {
                     }
                 }
 
-                if (batch.n_tokens >= n_batch) {
+                if (batch.n_tokens >= n_batch_prompt) {
                     break;
                 }
             }
@@ -4123,7 +5992,14 @@ struct server_context {
 
         // process the created batch of tokens
         for (int32_t i = 0; i < batch.n_tokens; i = i_next) {
-            const int32_t n_tokens = std::min(n_batch, batch.n_tokens - i);
+            int32_t n_tokens = std::min(n_batch, batch.n_tokens - i);
+
+            // the logits of a draft tree are sampled together, so the tree is not split between two views
+            for (const auto & idxs : idxs_draft) {
+                if (!idxs.empty() && idxs.front() < i + n_tokens && idxs.back() >= i + n_tokens) {
+                    n_tokens = idxs.front() > i ? idxs.front() - i : idxs.back() + 1 - i;
+                }
+            }
 
             llama_batch batch_view = {
                 n_tokens,
@@ -4135,6 +6011,8 @@ struct server_context {
                 batch.logits   + i,
             };
 
+            const int64_t t_decode_start = ggml_time_us();
+
             const int ret = llama_decode(ctx, batch_view);
 
             metrics.on_decoded(slots);
@@ -4182,6 +6060,13 @@ struct server_context {
             // on successful decode, restore the original batch size
             n_batch = llama_n_batch(ctx);
 
+            // the time to verify the drafts of the batch, to adapt their length
+            int64_t t_decode = 0;
+            if (!drafts.empty()) {
+                llama_synchronize(ctx);
+                t_decode = ggml_time_us() - t_decode_start;
+            }
+
             for (auto & slot : slots) {
                 // optionally send prompt processing progress
                 if (slot.state == SLOT_STATE_PROCESSING_PROMPT || slot.state == SLOT_STATE_DONE_PROMPT) {
@@ -4194,6 +6079,15 @@ struct server_context {
                     continue; // continue loop of slots
                 }
 
+                if (slot.state == SLOT_STATE_RESUMING) {
+                    // the KV cache of the suspended task is restored, the generation continues with its sampled token
+                    slot.i_batch = -1;
+                    slot.resume(*slot.task->resume);
+
+                    slot_index.update(slot.id, slot.prompt.tokens);
+                    continue; // continue loop of slots
+                }
+
                 if (slot.state == SLOT_STATE_DONE_PROMPT) {
                     if (slot.task->type == SERVER_TASK_TYPE_EMBEDDING) {
                         // prompt evaluated for embedding
@@ -4216,6 +6110,12 @@ struct server_context {
                     continue; // continue loop of slots
                 }
 
+                if (i_draft[slot.id] >= 0) {
+                    // the sampled token and the draft of the slot were decoded together
+                    verify_draft(slot, drafts[i_draft[slot.id]], idxs_draft[slot.id], i, n_tokens, t_decode);
+                    continue; // continue loop of slots
+                }
+
                 const int tok_idx = slot.i_batch - i;
 
                 llama_token id = common_sampler_sample(slot.smpl, ctx, tok_idx);
@@ -4255,110 +6155,10 @@ struct server_context {
                     continue;
                 }
             }
-
-            // do speculative decoding
-            for (auto & slot : slots) {
-                if (!slot.is_processing() || !slot.can_speculate()) {
-                    continue;
-                }
-
-                if (slot.state != SLOT_STATE_GENERATING) {
-                    continue;
-                }
-
-                if (mctx) {
-                    // we should never reach this, as speculative is automatically disabled if mmproj is loaded
-                    GGML_ABORT("not supported by multimodal");
-                }
-
-                // determine the max draft that fits the current slot state
-                int n_draft_max = slot.task->params.speculative.n_max;
-
-                // note: n_past is not yet increased for the `id` token sampled above
-                //       also, need to leave space for 1 extra token to allow context shifts
-                n_draft_max = std::min(n_draft_max, slot.n_ctx - slot.n_past - 2);
-
-                if (slot.n_remaining > 0) {
-                    n_draft_max = std::min(n_draft_max, slot.n_remaining - 1);
-                }
-
-                SLT_DBG(slot, "max possible draft: %d\n", n_draft_max);
-
-                if (n_draft_max < slot.task->params.speculative.n_min) {
-                    SLT_DBG(slot, "the max possible draft is too small: %d < %d - skipping speculative decoding\n", n_draft_max, slot.task->params.speculative.n_min);
-
-                    continue;
-                }
-
-                llama_token id = slot.sampled;
-
-                struct common_speculative_params params_spec;
-                params_spec.n_draft = n_draft_max;
-                params_spec.n_reuse = llama_n_ctx(slot.ctx_dft) - slot.task->params.speculative.n_max;
-                params_spec.p_min   = slot.task->params.speculative.p_min;
-
-                const llama_tokens & cached_text_tokens = slot.prompt.tokens.get_text_tokens();
-                llama_tokens draft = common_speculative_gen_draft(slot.spec, params_spec, cached_text_tokens, id);
-
-                // ignore small drafts
-                if (slot.task->params.speculative.n_min > (int) draft.size()) {
-                    SLT_DBG(slot, "ignoring small draft: %d < %d\n", (int) draft.size(), slot.task->params.speculative.n_min);
-
-                    continue;
-                }
-
-                // keep track of total number of drafted tokens tested
-                slot.n_draft_total += draft.size();
-
-                // construct the speculation batch
-                common_batch_clear(slot.batch_spec);
-                common_batch_add  (slot.batch_spec, id, slot.n_past, { slot.id }, true);
-
-                for (size_t i = 0; i < draft.size(); ++i) {
-                    common_batch_add(slot.batch_spec, draft[i], slot.n_past + 1 + i, { slot.id }, true);
-                }
-
-                SLT_DBG(slot, "decoding speculative batch, size = %d\n", slot.batch_spec.n_tokens);
-
-                llama_decode(ctx, slot.batch_spec);
-
-                // the accepted tokens from the speculation
-                const auto ids = common_sampler_sample_and_accept_n(slot.smpl, ctx, draft);
-
-                slot.n_past    += ids.size();
-                slot.n_decoded += ids.size();
-
-                // update how many tokens out of those tested were accepted
-                slot.n_draft_accepted += ids.size() - 1;
-
-                slot.prompt.tokens.push_back(id);
-                slot.prompt.tokens.insert({ids.begin(), ids.end() - 1});
-
-                llama_memory_seq_rm(llama_get_memory(ctx), slot.id, slot.n_past, -1);
-
-                for (size_t i = 0; i < ids.size(); ++i) {
-                    completion_token_output result;
-
-                    result.tok          = ids[i];
-                    result.text_to_send = common_token_to_piece(ctx, result.tok, accept_special_token(slot, result.tok));
-                    result.prob         = 1.0f; // set later
-
-                    // TODO: set result.probs
-
-                    if (!process_token(result, slot)) {
-                        slot.print_timings();
-                        send_final_response(slot);
-                        metrics.on_prediction(slot);
-                        slot.release();
-
-                        break;
-                    }
-                }
-
-                SLT_DBG(slot, "accepted %d/%d draft tokens, new n_past = %d\n", (int) ids.size() - 1, (int) draft.size(), slot.n_past);
-            }
         }
 
+        n_kv_draft = 0;
+
         SRV_DBG("%s", "run slots completed\n");
     }
 
@@ -4690,6 +6490,34 @@ int main(int argc, char ** argv) {
                     {"name",  "n_busy_slots_per_decode"},
                     {"help",  "Average number of busy slots per llama_decode() call"},
                     {"value",  (float) res_task->n_busy_slots_total / std::max((float) res_task->n_decode_total, 1.f)}
+            }, {
+                    {"name",  "prompt_tokens_cached_total"},
+                    {"help",  "Number of prompt tokens reused from the cache."},
+                    {"value",  res_task->n_prompt_tokens_cached_total}
+            }, {
+                    {"name",  "slot_selections_total"},
+                    {"help",  "Number of tasks assigned to a slot."},
+                    {"value",  res_task->n_slot_select_total}
+            }, {
+                    {"name",  "slot_selections_prefix_total"},
+                    {"help",  "Number of tasks assigned to the slot with the longest cached prefix."},
+                    {"value",  res_task->n_slot_select_prefix}
+            }, {
+                    {"name",  "slot_selections_cache_total"},
+                    {"help",  "Number of tasks routed to the prompt cache because it holds a longer prefix than any slot."},
+                    {"value",  res_task->n_slot_select_cache}
+            }, {
+                    {"name",  "prompt_cache_restored_total"},
+                    {"help",  "Number of prompts restored from the prompt cache."},
+                    {"value",  res_task->n_prompt_cache_restored}
+            }, {
+                    {"name",  "preemptions_total"},
+                    {"help",  "Number of generations suspended for a higher priority request."},
+                    {"value",  res_task->n_preempted}
+            }, {
+                    {"name",  "offloaded_slots_total"},
+                    {"help",  "Number of idle slots whose KV cache was moved to the prompt cache."},
+                    {"value",  res_task->n_offloaded}
             }}},
             {"gauge", {{
                     {"name",  "prompt_tokens_seconds"},
@@ -4707,6 +6535,15 @@ int main(int argc, char ** argv) {
                     {"name",  "requests_deferred"},
                     {"help",  "Number of requests deferred."},
                     {"value",  (uint64_t) res_task->n_tasks_deferred}
+            }}},
+            {"histogram", {{
+                    {"name",   "draft_length"},
+                    {"help",   "Speculative decoding draft lengths chosen for the slots."},
+                    {"counts", res_task->hist_n_draft}
+            },{
+                    {"name",   "draft_accepted_tokens"},
+                    {"help",   "Number of accepted tokens per speculative decoding draft."},
+                    {"counts", res_task->hist_n_accept}
             }}}
         };
 
@@ -4720,10 +6557,28 @@ int main(int argc, char ** argv) {
                 const std::string name = metric_def.at("name");
                 const std::string help = metric_def.at("help");
 
-                auto value = json_value(metric_def, "value", 0.);
                 prometheus << "# HELP llamacpp:" << name << " " << help  << "\n"
-                            << "# TYPE llamacpp:" << name << " " << type  << "\n"
-                            << "llamacpp:"        << name << " " << value << "\n";
+                            << "# TYPE llamacpp:" << name << " " << type  << "\n";
+
+                if (type == "histogram") {
+                    // the buckets are the counts of the integer values 0, 1, 2, ...
+                    const std::vector<uint64_t> counts = metric_def.at("counts");
+
+                    uint64_t n   = 0;
+                    uint64_t sum = 0;
+                    for (size_t i = 0; i < counts.size(); ++i) {
+                        n   += counts[i];
+                        sum += counts[i]*i;
+                        prometheus << "llamacpp:" << name << "_bucket{le=\"" << i << "\"} " << n << "\n";
+                    }
+                    prometheus << "llamacpp:" << name << "_bucket{le=\"+Inf\"} " << n   << "\n"
+                                << "llamacpp:" << name << "_sum "                   << sum << "\n"
+                                << "llamacpp:" << name << "_count "                 << n   << "\n";
+                    continue;
+                }
+
+                auto value = json_value(metric_def, "value", 0.);
+                prometheus << "llamacpp:" << name << " " << value << "\n";
             }
         }
 
@@ -4939,11 +6794,27 @@ int main(int argc, char ** argv) {
             server_task_type type,
             json & data,
             const std::vector<raw_buffer> & files,
-            const std::function<bool()> & is_connection_closed,
+            const httplib::Request & req,
             httplib::Response & res,
             oaicompat_type oaicompat) -> void {
         GGML_ASSERT(type == SERVER_TASK_TYPE_COMPLETION || type == SERVER_TASK_TYPE_INFILL);
 
+        // the priority class of the API key caps the priority of the request, the requests without one cannot raise
+        // their priority above the default
+        std::optional<int32_t> priority_max;
+        {
+            const auto & api_key_priority = ctx_server.params_base.api_key_priority;
+
+            const std::string prefix = "Bearer ";
+            const std::string auth_header = req.get_header_value("Authorization");
+            if (!api_key_priority.empty() && auth_header.substr(0, prefix.size()) == prefix) {
+                const auto it = api_key_priority.find(auth_header.substr(prefix.size()));
+                if (it != api_key_priority.end()) {
+                    priority_max = it->second;
+                }
+            }
+        }
+
         auto completion_id = gen_chatcmplid();
         std::unordered_set<int> task_ids;
         try {
@@ -4963,11 +6834,11 @@ int main(int argc, char ** argv) {
                 // Everything else, including multimodal completions.
                 inputs = tokenize_input_prompts(ctx_server.vocab, ctx_server.mctx, prompt, true, true);
             }
-            const size_t n_ctx_slot = ctx_server.n_ctx / ctx_server.params_base.n_parallel;
+            const size_t n_ctx_slot = ctx_server.slots.front().n_ctx;
             tasks.reserve(inputs.size());
             for (size_t i = 0; i < inputs.size(); i++) {
                 auto n_prompt_tokens = inputs[i].size();
-                if (n_prompt_tokens >= n_ctx_slot) {
+                if (!ctx_server.kv_evict && n_prompt_tokens >= n_ctx_slot) {
                     json error_data = format_error_response("the request exceeds the available context size, try increasing it", ERROR_TYPE_EXCEED_CONTEXT_SIZE);
                     error_data["n_prompt_tokens"] = n_prompt_tokens;
                     error_data["n_ctx"] = n_ctx_slot;
@@ -4986,6 +6857,12 @@ int main(int argc, char ** argv) {
                         data);
                 task.id_slot = json_value(data, "id_slot", -1);
 
+                if (priority_max) {
+                    task.params.priority = data.contains("priority") ? std::min(task.params.priority, *priority_max) : *priority_max;
+                } else {
+                    task.params.priority = std::min(task.params.priority, 0);
+                }
+
                 // OAI-compat
                 task.params.oaicompat                 = oaicompat;
                 task.params.oaicompat_cmpl_id         = completion_id;
@@ -5019,7 +6896,7 @@ int main(int argc, char ** argv) {
                 }
             }, [&](const json & error_data) {
                 res_error(res, error_data);
-            }, is_connection_closed);
+            }, req.is_connection_closed);
 
             ctx_server.queue_results.remove_waiting_task_ids(task_ids);
         } else {
@@ -5066,7 +6943,7 @@ int main(int argc, char ** argv) {
             SERVER_TASK_TYPE_COMPLETION,
             data,
             files,
-            req.is_connection_closed,
+            req,
             res,
             OAICOMPAT_TYPE_NONE);
     };
@@ -5078,7 +6955,7 @@ int main(int argc, char ** argv) {
             SERVER_TASK_TYPE_COMPLETION,
             data,
             files,
-            req.is_connection_closed,
+            req,
             res,
             OAICOMPAT_TYPE_COMPLETION);
     };
@@ -5157,7 +7034,7 @@ int main(int argc, char ** argv) {
             SERVER_TASK_TYPE_INFILL,
             data,
             files,
-            req.is_connection_closed,
+            req,
             res,
             OAICOMPAT_TYPE_NONE); // infill is not OAI compatible
     };
@@ -5176,7 +7053,7 @@ int main(int argc, char ** argv) {
             SERVER_TASK_TYPE_COMPLETION,
             data,
             files,
-            req.is_connection_closed,
+            req,
             res,
             OAICOMPAT_TYPE_CHAT);
     };
@@ -5686,6 +7563,12 @@ int main(int argc, char ** argv) {
         ctx_server.update_slots();
     });
 
+    if (params.cache_idle_sec > 0) {
+        ctx_server.queue_tasks.on_idle([&ctx_server]() {
+            ctx_server.offload_idle_slots();
+        }, std::min<int64_t>(params.cache_idle_sec*1000LL, 1000));
+    }
+
     shutdown_handler = [&](int) {
         // this will unblock start_loop()
         ctx_server.queue_tasks.terminate();